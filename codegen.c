@@ -63,606 +63,1480 @@ static const char* new_label() {
   return string(buf);
 }
 
-static void gen_expr(Node n);
-static void gen_stat(Node n);
-
 /******************************
- *    generate expressions    *
+ *     operand selection      *
  ******************************/
+// A constant that fits a 32-bit immediate has no slot, it's an operand of
+// the instructions that use it. An address is rematerialized by a lea
+// wherever it's needed.
+//
+// The address of a load or a store is folded into an x86 memory operand
+// disp(base, index, scale): the offsets added to it, a variable's address
+// and an index multiplied by 1, 2, 4 or 8 become part of the operand when
+// they are only used there, so member and subscript chains cost nothing
+// apart from loading base and index. An addition that isn't an address
+// is folded the same way into a lea. A load only used by an arithmetic
+// operation later in its block, with no write in between, is read by the
+// operation as its memory operand.
+
+struct address {
+  Node var;          // variable the address is in, or NULL
+  Inst base, index;  // values loaded into r10 and r11, or NULL
+  int scale;
+  long long disp;
+};
+
+static char* inlined;              // by id
+static struct address* addresses;  // by id, of loads, stores and leas
+static char* is_lea;               // by id
+static int* nuses;                 // by id
+static int* nmem_uses;             // by id, as an address in its block
+
+static long long imm_value(Inst v) {
+  // sign extend the constant to 64 bits
+  int bits = v->size * 8;
+  if (bits == 64)
+    return v->imm;
+  unsigned long long sign = 1ULL << (bits - 1);
+  return ((v->imm & ((sign << 1) - 1)) ^ sign) - sign;
+}
+
+static int is_imm32(Inst v) {
+  return v->op == IR_IMM && imm_value(v) >= INT_MIN &&
+         imm_value(v) <= INT_MAX;
+}
+
+static int is_inlined_imm(Inst v) {
+  return v->op == IR_IMM && inlined[v->id];
+}
+
+// global variables, string literals and labels are addressed from rip
+static int is_static(Node var) {
+  return var->kind == A_STRING_LITERAL || var->kind == A_LABEL ||
+         var->is_global;
+}
+
+// the scale of an index times a scale of an address, or 0
+static int index_scale(Inst v) {
+  if ((v->op != IR_MUL && v->op != IR_SHL) || v->args[1]->op != IR_IMM)
+    return 0;
+  long long k = imm_value(v->args[1]);
+  if (v->op == IR_SHL)
+    return k >= 0 && k <= 3 ? 1 << k : 0;
+  return k == 1 || k == 2 || k == 4 || k == 8 ? k : 0;
+}
+
+static int static_in_reg;  // a static variable's address goes in a register
+static int fold_size;      // of the sum being folded
+
+static int fold_sum(struct address* m, Inst a, Block b, int mark);
+
+// adds a to m, folding the values only used there
+static int fold_address(struct address* m, Inst a, Block b, int mark) {
+  if (is_imm32(a)) {
+    m->disp += imm_value(a);
+    return m->disp >= INT_MIN && m->disp <= INT_MAX;
+  }
+  if (a->op == IR_ADDR && !m->var && !(is_static(a->var) && static_in_reg)) {
+    m->var = a->var;
+    return 1;
+  }
+
+  int single = nuses[a->id] == 1 && a->block == b && a->size == fold_size;
+  if (single && a->op == IR_ADD)
+    return fold_sum(m, a, b, mark);
+  if (single && index_scale(a) && !m->index) {
+    inlined[a->id] |= mark;
+    m->index = a->args[0];
+    m->scale = index_scale(a);
+    return 1;
+  }
+
+  if (!m->base) {
+    m->base = a;
+  } else if (!m->index) {
+    m->index = a;
+    m->scale = 1;
+  } else {
+    return 0;
+  }
+  return 1;
+}
 
-static void gen_iconst(Node n) {
-  // TODO: to hold a unsigned int , maybe use long type for n->intvalue?
-  assert(is_integer(n->type));
-  output("\tmov%c\t$%llu, %%%s\n", size_suffix(n->type->size), n->intvalue,
-         regs(n->type->size, RAX));
-  output("\tpushq\t%%rax\n");
+static int fold_sum(struct address* m, Inst a, Block b, int mark) {
+  if (!fold_address(m, a->args[0], b, mark) ||
+      !fold_address(m, a->args[1], b, mark))
+    return 0;
+
+  // rbp is the base of a local variable, rip allows no registers
+  if (m->var && !is_static(m->var) && m->base && !m->index) {
+    m->index = m->base;
+    m->scale = 1;
+    m->base = NULL;
+  }
+  if (m->var && (m->base || (is_static(m->var) && m->index)))
+    return 0;
+  inlined[a->id] |= mark;
+  return 1;
 }
 
-static void gen_load(Type ty) {
-  ty = unqual(ty);
+// the sum a, with the values only used in it marked inlined
+static int select_sum(struct address* m, Inst a) {
+  for (static_in_reg = 0; static_in_reg < 2; static_in_reg++) {
+    struct address t = {0};
+    if (fold_sum(&t, a, a->block, 0)) {
+      memset(m, 0, sizeof(struct address));
+      fold_sum(m, a, a->block, 1);
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  if (is_array(ty))  // for array, the address is it's value
+// the address a of a load or store, a sum only used as an address in its
+// block is computed by each of them
+static void select_address(Inst v, Inst a) {
+  struct address* m = &addresses[v->id];
+  memset(m, 0, sizeof(struct address));
+  fold_size = 8;
+  if (a->op == IR_ADD && a->block == v->block &&
+      nmem_uses[a->id] == nuses[a->id] && select_sum(m, a))
     return;
-  if (is_struct_or_union(ty))  // for struct, keep the address
+  static_in_reg = 0;
+  fold_address(m, a, v->block, 1);
+}
+
+// a lea is worth it if it does more than an add
+static void select_lea(Inst v) {
+  struct address m;
+  if (inlined[v->id] || (v->size != 4 && v->size != 8))
+    return;
+  fold_size = v->size;
+  static_in_reg = 0;
+  struct address t = {0};
+  if (!fold_sum(&t, v, v->block, 0))
+    return;
+  if (!t.var && t.scale <= 1 && !!t.base + !!t.index + !!t.disp <= 2)
     return;
+  if (!select_sum(&m, v))
+    return;
+  inlined[v->id] = 0;  // select_sum marks sums as part of an address
+  is_lea[v->id] = 1;
+  addresses[v->id] = m;
+}
 
-  output("\tpopq\t%%rax\n");
-  if (is_scalar(ty))
-    output("\tmov%c\t(%%rax), %%%s\n", size_suffix(ty->size),
-           regs(ty->size, RAX));
-  else
-    error("load unknown type");
-
-  output("\tpushq\t%%rax\n");
-}
-
-static void gen_store(Type ty) {
-  ty = unqual(ty);
-
-  output("\tpopq\t%%rax\n");
-  output("\tpopq\t%%rdi\n");
-  if (is_scalar(ty))
-    output("\tmov%c\t%%%s, (%%rdi)\n", size_suffix(ty->size),
-           regs(ty->size, RAX));
-  else if (is_array(ty))
-    error("assignment to expression with array type");
-  else if (is_struct_or_union(ty)) {
-    int offset = 0;
-    for (int s = 8; s; s >>= 1)
-      for (; ty->size - offset >= s; offset += s) {
-        output("\tmov%c\t%d(%%rax), %%%s\n", size_suffix(s), offset,
-               regs(s, RSI));
-        output("\tmov%c\t%%%s, %d(%%rdi)\n", size_suffix(s), regs(s, RSI),
-               offset);
-      }
-  } else
-    error("store unknown type");
+static int is_compare_op(int op) {
+  return op >= IR_EQ && op <= IR_UGE;
+}
 
-  output("\tpushq\t%%rax\n");
+static int is_arithmetic_op(int op) {
+  return (op >= IR_ADD && op <= IR_XOR) || is_compare_op(op);
 }
 
-static void gen_addr(Node n) {
-  if (n->kind == A_IDENT) {
-    gen_addr(n->ref);
-    return;
+static int is_commutative(int op) {
+  return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR ||
+         op == IR_XOR || op == IR_EQ || op == IR_NE;
+}
+
+// a load that u may read as a memory operand
+static int is_foldable_load(Inst v, Inst u) {
+  if (v->op != IR_LOAD || v->is_volatile || nuses[v->id] != 1 ||
+      v->block != u->block)
+    return 0;
+  for (Inst w = v->next; w != u; w = w->next) {
+    if (w->op == IR_STORE || w->op == IR_COPY || w->op == IR_ZERO ||
+        w->op == IR_CALL)
+      return 0;
   }
+  return 1;
+}
 
-  if (n->kind == A_VAR) {
-    if (n->is_global)
-      output("\tleaq\t%s(%%rip), %%rax\n", n->name);
-    else
-      output("\tleaq\t-%d(%%rbp), %%rax\n", n->offset);
-    output("\tpushq\t%%rax\n");
-    return;
+static void select_operands(Func f) {
+  nuses = realloc(nuses, f->ninsts * sizeof(int));
+  nmem_uses = realloc(nmem_uses, f->ninsts * sizeof(int));
+  inlined = realloc(inlined, f->ninsts);
+  is_lea = realloc(is_lea, f->ninsts);
+  addresses = realloc(addresses, f->ninsts * sizeof(struct address));
+  memset(nuses, 0, f->ninsts * sizeof(int));
+  memset(nmem_uses, 0, f->ninsts * sizeof(int));
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      inlined[v->id] = is_imm32(v) || v->op == IR_ADDR;
+      is_lea[v->id] = 0;
+      for (int i = 0; i < v->nargs; i++)
+        nuses[v->args[i]->id]++;
+      if ((v->op == IR_LOAD || v->op == IR_STORE) && v->args[0]->block == b)
+        nmem_uses[v->args[0]->id]++;
+    }
   }
 
-  if (n->kind == A_DEFERENCE) {
-    if (!is_ptr(n->left->type))
-      error("can only dereference pointer");
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->op == IR_LOAD || v->op == IR_STORE)
+        select_address(v, v->args[0]);
+    }
+  }
 
-    if (n->left->kind == A_VAR) {
-      gen_addr(n->left);
-      gen_load(n->left->type);
-      return;
+  // the sums not used as an address, last to first to make the largest
+  // leas
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->last; v; v = v->prev) {
+      if (v->op == IR_ADD)
+        select_lea(v);
     }
-    gen_expr(n->left);
-    return;
   }
 
-  if (n->kind == A_ARRAY_SUBSCRIPTING) {
-    if (is_array(n->array->type))
-      gen_addr(n->array);
-    else  // pointer
-      gen_expr(n->array);
+  // a compare only used by a branch or a select sets the flags they test
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      Inst c = v->op == IR_BR || v->op == IR_SELECT ? v->args[0] : NULL;
+      if (c && is_compare_op(c->op) && c->block == b && nuses[c->id] == 1)
+        inlined[c->id] = 1;
+    }
+  }
 
-    gen_expr(n->index);
-    output("\tpopq\t%%rax\n");
-    output("\tpopq\t%%rdi\n");
-    int size = n->array->type->base->size;
-    if (size <= 8) {
-      output("\tleaq\t(%%rdi, %%rax, %d), %%rax\n", size);
-    } else {
-      output("\timulq\t$%d, %%rax\n", size);
-      output("\tleaq\t(%%rdi, %%rax), %%rax\n");
+  // at is where the operands of v are read
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst at = b->first; at; at = at->next) {
+      Inst v = at;
+      if ((at->op == IR_BR || at->op == IR_SELECT) &&
+          inlined[at->args[0]->id])
+        v = at->args[0];
+      if (!is_arithmetic_op(v->op) || is_lea[v->id] ||
+          (v == at && inlined[v->id]))
+        continue;
+      if (is_foldable_load(v->args[1], at))
+        inlined[v->args[1]->id] = 1;
+      else if (is_commutative(v->op) && is_foldable_load(v->args[0], at) &&
+               !inlined[v->args[1]->id])
+        inlined[v->args[0]->id] = 1;
     }
-    output("\tpushq\t%%rax\n");
-    return;
   }
+}
+
+/******************************
+ *       value locations      *
+ ******************************/
+// Each value lives in an 8 byte slot in the frame, below the local
+// variables. An operation loads its operands into registers and stores
+// the result back. A value of size n is kept in the low n bytes of its
+// slot, the rest is undefined.
+//
+// Slots are assigned by a linear scan over live intervals, so a slot is
+// reused once its value is dead. The interval of a value runs from the
+// first to the last position, in layout order, where it may be live.
+//
+// A phi is a move into its slot at the end of each predecessor, so its
+// operands are used there and the phi is live there.
+
+static Func fn;          // function being generated
+static int locals_size;  // bytes of local variables in the frame
+static int nslots;       // slots used by the function
+
+static int* slots;  // slot of each value, by id
+static int* pos;    // position of each instruction, by id
+static int* lo;     // live interval of each value, by id
+static int* hi;
+static int* block_mark;  // last value whose liveness reached a block, by id
+static struct far_use {  // a value used in a block other than its own
+  Inst v;
+  Block b;
+} * far_uses;
+static int nfar_uses, far_use_cap;
+static int *block_start, *block_end;
+
+static void cover(Inst v, int from, int to) {
+  if (from < lo[v->id])
+    lo[v->id] = from;
+  if (to > hi[v->id])
+    hi[v->id] = to;
+}
+
+// v is used in block b, which doesn't define it: it's live from the
+// definition along every path into b.
+static void extend_interval(Inst v, Block b) {
+  static Block* stack;
+  static int cap;
+  int n = 0;
 
-  if (n->kind == A_MEMBER_SELECTION) {
-    gen_addr(n->structure);
-    output("\tpopq\t%%rax\n");
-    output("\taddq\t$%d, %%rax\n", n->member->offset);
-    output("\tpushq\t%%rax\n");
+  if (cap < fn->nblocks) {
+    cap = fn->nblocks;
+    stack = realloc(stack, cap * sizeof(Block));
+  }
+  // a block is marked once pushed, so the stack holds each one once
+  if (block_mark[b->id] == v->id + 1)
     return;
+  block_mark[b->id] = v->id + 1;
+  stack[n++] = b;
+  while (n) {
+    b = stack[--n];
+    cover(v, block_start[b->id], block_end[b->id]);
+    if (b == v->block)
+      continue;
+    for (int i = 0; i < b->npred; i++) {
+      Block p = b->pred[i];
+      if (block_mark[p->id] != v->id + 1) {
+        block_mark[p->id] = v->id + 1;
+        stack[n++] = p;
+      }
+    }
   }
+}
 
-  if (n->kind == A_STRING_LITERAL) {
-    output("\tleaq\t%s(%%rip), %%rax\n", n->name);
-    output("\tpushq\t%%rax\n");
+// a is used at position p of block b, an inlined value uses its operands
+// there instead
+static void cover_use(Inst a, Block b, int p) {
+  if (inlined[a->id]) {
+    for (int i = 0; i < a->nargs; i++)
+      cover_use(a->args[i], b, p);
+    return;
+  }
+  if (a->block == b) {
+    cover(a, pos[a->id], p);
     return;
   }
+  if (nfar_uses == far_use_cap) {
+    far_use_cap = far_use_cap ? far_use_cap * 2 : 64;
+    far_uses = realloc(far_uses, far_use_cap * sizeof(struct far_use));
+  }
+  far_uses[nfar_uses].v = a;
+  far_uses[nfar_uses++].b = b;
+}
 
-  assert(0);  // generate address for unknown kind
+static int by_value(const void* a, const void* b) {
+  const struct far_use *x = a, *y = b;
+  return x->v->id - y->v->id;
 }
 
-static void gen_funccall(Node n) {
-  output("// call function \"%s\"\n", n->name);
-  Node node;
+// Walks the uses of a value one after another, so that each stops at the
+// blocks marked by the ones before. The marks only hold for one value: in
+// program order the walks of different values interleave, and a value used
+// in many blocks was walked back to its definition from every one of them.
+static void extend_intervals() {
+  qsort(far_uses, nfar_uses, sizeof(struct far_use), by_value);
+  for (int i = 0; i < nfar_uses; i++)
+    extend_interval(far_uses[i].v, far_uses[i].b);
+  nfar_uses = 0;
+}
 
-  int nargs = list_length(n->args);
-  int nregargs = nargs > 6 ? 6 : nargs;
-  int nmemargs = nargs - nregargs;
-
-  if (nmemargs % 2)
-    output("\tsubq\t$8, %%rsp\n");
-
-  list_for_each_reverse(n->args, node) gen_expr(node->body);
-
-  for (int i = 0; i < nregargs; i++) {
-    output("\tpopq\t%%%s\n", regs(8, i));
-  }
-
-  output("\tcall\t%s\n", n->name);
-  if (nmemargs % 2)
-    output("\taddq\t$8, %%rsp\n");
-  output("\tpushq\t%%rax\n");
-  output("// ---- call function \"%s\"\n", n->name);
-}
-
-static void gen_conversion(Node n) {
-  gen_expr(n->body);
-
-  int src_size = is_array(n->body->type) ? 8 : unqual(n->body->type)->size;
-  int dst_size = unqual(n->type)->size;
-  if (src_size < dst_size) {
-    output("\tpopq\t%%rax\n");
-    output("\tmov%c%c%c\t%%%s, %%%s\n", is_signed(n->body->type) ? 's' : 'z',
-           size_suffix(src_size), size_suffix(dst_size), regs(src_size, RAX),
-           regs(dst_size, RAX));
-    output("\tpushq\t%%rax\n");
-  }
-}
-
-static void gen_ternary(Node n) {
-  const char* rlabel = new_label();
-  const char* elabel = new_label();
-  gen_expr(n->cond);
-  output("\tpopq\t%%rax\n");
-  output("\tcmp%c\t$0, %%%s\n", size_suffix(n->cond->type->size),
-         regs(n->cond->type->size, RAX));
-  output("\tje\t%s\n", rlabel);
-  gen_expr(n->left);
-  output("\tjmp\t%s\n", elabel);
-  output("%s:\n", rlabel);
-  gen_expr(n->right);
-  output("%s:\n", elabel);
-}
-
-static void gen_unary_arithmetic(Node n) {
-  gen_expr(n->left);
-  output("\tpopq\t%%rax\n");
-  if (n->kind == A_B_NOT) {
-    output("\tnot%c\t%%%s\n", size_suffix(n->type->size),
-           regs(n->type->size, RAX));
-  } else if (n->kind == A_MINUS) {
-    output("\tneg%c\t%%%s\n", size_suffix(n->type->size),
-           regs(n->type->size, RAX));
-  } else if (n->kind == A_PLUS) {
-  } else if (n->kind == A_L_NOT) {
-    const char* olabel = new_label();
-    const char* elabel = new_label();
-    output("\tcmp%c\t$0, %%%s\n", size_suffix(n->left->type->size),
-           regs(n->left->type->size, RAX));
-    output("\tje\t%s\n", olabel);
-    output("\tmovl\t$0, %%eax\n");
-    output("\tjmp\t%s\n", elabel);
-    output("%s:\n", olabel);
-    output("\tmovl\t$1, %%eax\n");
-    output("%s:\n", elabel);
+static int by_start(const void* a, const void* b) {
+  Inst x = *(Inst*)a, y = *(Inst*)b;
+  if (lo[x->id] != lo[y->id])
+    return lo[x->id] - lo[y->id];
+  return x->id - y->id;
+}
+
+static void assign_slots(Func f) {
+  int n = 0, nvalues = 0;
+
+  slots = realloc(slots, f->ninsts * sizeof(int));
+  pos = realloc(pos, f->ninsts * sizeof(int));
+  lo = realloc(lo, f->ninsts * sizeof(int));
+  hi = realloc(hi, f->ninsts * sizeof(int));
+  block_mark = calloc(f->nblocks, sizeof(int));
+  block_start = realloc(block_start, f->nblocks * sizeof(int));
+  block_end = realloc(block_end, f->nblocks * sizeof(int));
+
+  for (Block b = f->entry; b; b = b->next) {
+    block_start[b->id] = n;
+    for (Inst v = b->first; v; v = v->next) {
+      pos[v->id] = lo[v->id] = hi[v->id] = n++;
+      nvalues += v->size && !inlined[v->id];
+    }
+    block_end[b->id] = n - 1;
   }
 
-  output("\tpushq\t%%rax\n");
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (inlined[v->id])
+        continue;
+      for (int i = 0; v->op == IR_PHI && i < v->nargs; i++) {
+        Block p = b->pred[i];
+        cover(v, block_end[p->id], block_end[p->id]);
+        cover_use(v->args[i], p, block_end[p->id]);
+      }
+      for (int i = 0; v->op != IR_PHI && i < v->nargs; i++)
+        cover_use(v->args[i], b, pos[v->id]);
+    }
+  }
+  extend_intervals();
+
+  // visit values by the start of their interval, slots of the values whose
+  // interval has ended are free
+  Inst* order = malloc(nvalues * sizeof(Inst));
+  Inst* active = malloc(nvalues * sizeof(Inst));  // heap by the end
+  int* free_slots = malloc(nvalues * sizeof(int));
+  int nactive = 0, nfree = 0;
+
+  n = 0;
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->size && !inlined[v->id])
+        order[n++] = v;
+    }
+  }
+  qsort(order, nvalues, sizeof(Inst), by_start);
+
+  nslots = 0;
+  for (int i = 0; i < nvalues; i++) {
+    Inst v = order[i];
+    while (nactive && hi[active[0]->id] < lo[v->id]) {
+      free_slots[nfree++] = slots[active[0]->id];
+      active[0] = active[--nactive];
+      for (int j = 0, k; (k = 2 * j + 1) < nactive; j = k) {
+        if (k + 1 < nactive && hi[active[k + 1]->id] < hi[active[k]->id])
+          k++;
+        if (hi[active[j]->id] <= hi[active[k]->id])
+          break;
+        Inst t = active[j];
+        active[j] = active[k];
+        active[k] = t;
+      }
+    }
+
+    slots[v->id] = nfree ? free_slots[--nfree] : nslots++;
+    int j = nactive++;
+    for (; j && hi[active[(j - 1) / 2]->id] > hi[v->id]; j = (j - 1) / 2)
+      active[j] = active[(j - 1) / 2];
+    active[j] = v;
+  }
+
+  free(order);
+  free(active);
+  free(free_slots);
+  free(block_mark);
+}
+
+static int slot(Inst v) {
+  return locals_size + 8 * (slots[v->id] + 1);
+}
+
+/******************************
+ *           frame            *
+ ******************************/
+// The variables and slots are addressed from where rbp points once the
+// frame is set up, below the return address. The prologue is only run on
+// the paths that need it: calls, and the pushes of the phi moves, must
+// have rsp below the frame. Elsewhere, rsp is still where the caller left
+// it and the frame lies in the red zone under it, the 128 bytes a leaf
+// may use without moving rsp. So a function that doesn't call has no
+// prologue at all. With --omit-frame-pointer, rsp also addresses the
+// frame once it's set up and rbp isn't saved.
+
+#define RED_ZONE 128
+
+static Block prologue_block;  // where the frame is set up, NULL if never
+static int frame_size;        // bytes the prologue moves rsp down
+static int framed;            // the frame is set up in the current block
+static int sp_offset;         // bytes from rsp up to where rbp would be
+
+static const char* frame_ref(long long disp, const char* index) {
+  char buf[64];
+  if (framed && !options.omit_frame_pointer)
+    sprintf(buf, "%lld(%%rbp%s)", disp, index);
+  else
+    sprintf(buf, "%lld(%%rsp%s)", disp + sp_offset, index);
+  return string(buf);
+}
+
+static void push(const char* src) {
+  output("	pushq	%s\n", src);
+  sp_offset += 8;
 }
 
-static void gen_postfix_incdec(Node n) {
-  gen_addr(n->left);
-  gen_load(n->type);
+static void pop(Inst v) {
+  sp_offset -= 8;
+  output("	popq	%s\n", frame_ref(-slot(v), ""));
+}
 
-  gen_addr(n->left);
-  output("\tpopq\t%%rax\n");
-  if (is_arithmetic(n->type))
-    output("\t%s%c\t(%%rax)\n", n->kind == A_POSTFIX_INC ? "inc" : "dec",
-           size_suffix(n->type->size));
-  else  // pointer
-    output("\t%sq\t$%d, (%%rax)\n", n->kind == A_POSTFIX_INC ? "add" : "sub",
-           n->type->base->size);
+static void set_frame(Block b) {
+  framed = prologue_block && dominates(prologue_block, b);
+  sp_offset = framed && options.omit_frame_pointer ? frame_size - 8 : -8;
+  if (b != prologue_block)
+    return;
+  if (!options.omit_frame_pointer) {
+    output("	pushq	%%rbp\n");
+    output("	movq	%%rsp, %%rbp\n");
+  }
+  output("	subq	$%d, %%rsp\n", frame_size);
 }
 
-// binary expressions
-// get operand from: %rax(left) and %rdi(right)
-// store result to : %rax
-static void gen_ementary_arithmetic(Node n) {
-  const char* inst;
-  if (n->kind == A_ADD)
-    inst = "add";
-  else if (n->kind == A_SUB)
-    inst = "sub";
-  else if (n->kind == A_MUL)
-    inst = "imul";
-  else {
-    char from = size_suffix(n->type->size), to = size_suffix(n->type->size * 2);
-    output("\tc%c%c\n", from == 'l' ? 'd' : from, to == 'l' ? 'd' : to);
-    output("\t%sdiv%c\t%%%s\n", is_signed(n->type) ? "i" : "",
-           size_suffix(n->type->size), regs(n->type->size, RDI));
-    if (n->kind == A_MOD)
-      output("\tmov%c\t%%%s, %%%s\n", size_suffix(n->type->size),
-             regs(n->type->size, RDX), regs(n->type->size, RAX));
-    return;
-  }
-
-  output("\t%s%c\t%%%s, %%%s\n", inst, size_suffix(n->type->size),
-         regs(n->type->size, RDI), regs(n->type->size, RAX));
-}
-
-static void gen_compare(Node n) {
-  if (n->type == inttype || n->type == uinttype)
-    output("\tcmpl\t%%edi, %%eax\n");
-  else if (n->type == longtype || n->type == ulongtype)
-    output("\tcmpq\t%%rdi, %%rax\n");
-  char* cd;
-  if (is_signed(n->left->type)) {
-    if (n->kind == A_EQ)
-      cd = "e";
-    else if (n->kind == A_NE)
-      cd = "ne";
-    else if (n->kind == A_GT)
-      cd = "g";
-    else if (n->kind == A_GE)
-      cd = "ge";
-    else if (n->kind == A_LT)
-      cd = "l";
-    else if (n->kind == A_LE)
-      cd = "le";
-  } else if (is_unsigned(n->left->type) || is_ptr(n->left->type)) {
-    if (n->kind == A_EQ)
-      cd = "e";
-    else if (n->kind == A_NE)
-      cd = "ne";
-    else if (n->kind == A_GT)
-      cd = "a";
-    else if (n->kind == A_GE)
-      cd = "ae";
-    else if (n->kind == A_LT)
-      cd = "b";
-    else if (n->kind == A_LE)
-      cd = "be";
-  } else
-    assert(0);  // compare what
-
-  output("\tset%s\t%%al\n", cd);
-  output("\tmovzbl\t%%al, %%eax\n");
+static void gen_epilogue() {
+  if (!framed)
+    return;
+  if (options.omit_frame_pointer)
+    output("	addq	$%d, %%rsp\n", frame_size);
+  else
+    output("	leave\n");
 }
 
-static void gen_logical_and(Node n) {
-  const char* flabel = new_label();
-  const char* elabel = new_label();
-  output("\tcmp%c\t$0, %%%s\n", size_suffix(n->left->type->size),
-         regs(n->left->type->size, RAX));
-  output("\tje\t%s\n", flabel);
-  output("\tcmp%c\t$0, %%%s\n", size_suffix(n->right->type->size),
-         regs(n->right->type->size, RDI));
-  output("\tje\t%s\n", flabel);
-  output("\tmovl\t$1, %%eax\n");
-  output("\tjmp\t%s\n", elabel);
-  output("%s:\n", flabel);
-  output("\tmovl\t$0, %%eax\n");
-  output("%s:\n", elabel);
-}
-
-static void gen_logical_or(Node n) {
-  const char* tlabel = new_label();
-  const char* elabel = new_label();
-  output("\tcmp%c\t$0, %%%s\n", size_suffix(n->left->type->size),
-         regs(n->left->type->size, RAX));
-  output("\tjne\t%s\n", tlabel);
-  output("\tcmp%c\t$0, %%%s\n", size_suffix(n->right->type->size),
-         regs(n->right->type->size, RDI));
-  output("\tjne\t%s\n", tlabel);
-  output("\tmovl\t$0, %%eax\n");
-  output("\tjmp\t%s\n", elabel);
-  output("%s:\n", tlabel);
-  output("\tmovl\t$1, %%eax\n");
-  output("%s:\n", elabel);
+// where an instruction reads v from, an immediate or its slot
+static void load(Inst v, int reg);
+
+// the memory operand of m, its base and index are loaded into r10 and r11
+static const char* address(struct address* m) {
+  char buf[128], index[32] = "";
+  if (m->base)
+    load(m->base, R10);
+  if (m->index) {
+    load(m->index, R11);
+    sprintf(index, ",%%r11,%d", m->scale);
+  }
+
+  if (m->var && is_static(m->var)) {
+    sprintf(buf, "%s%+lld(%%rip)", m->var->name, m->disp);
+  } else if (m->var || m->base || m->index) {
+    if (m->var)
+      return frame_ref(m->disp - m->var->offset, index);
+    sprintf(buf, "%lld(%s%s)", m->disp, m->base ? "%r10" : "", index);
+  } else {
+    sprintf(buf, "%lld", m->disp);
+  }
+  return string(buf);
 }
 
-static void gen_bitwise(Node n) {
-  const char* inst;
-  if (n->kind == A_B_AND)
-    inst = "and";
-  else if (n->kind == A_B_INCLUSIVEOR)
-    inst = "or";
-  else if (n->kind == A_B_EXCLUSIVEOR)
-    inst = "xor";
+// where an instruction of the given size reads v from: an immediate,
+// memory read by an inlined load, a register holding an address, or its
+// slot
+static const char* operand(Inst v, int size) {
+  char buf[32];
+  if (v->op == IR_ADDR) {
+    load(v, R11);
+    sprintf(buf, "%%%s", regs(size, R11));
+    return string(buf);
+  }
+  if (v->op == IR_LOAD && inlined[v->id])
+    return address(&addresses[v->id]);
+  if (is_inlined_imm(v))
+    sprintf(buf, "$%lld", imm_value(v));
+  else
+    return frame_ref(-slot(v), "");
+  return string(buf);
+}
+
+static void load(Inst v, int reg) {
+  if (v->op == IR_ADDR) {
+    struct address m = {v->var, NULL, NULL, 0, 0};
+    output("\tleaq\t%s, %%%s\n", address(&m), regs(8, reg));
+    return;
+  }
+  assert(v->op == IR_IMM || !inlined[v->id]);
+  if (is_inlined_imm(v) && imm_value(v) == 0)
+    output("\txorl\t%%%s, %%%s\n", regs(4, reg), regs(4, reg));
   else
-    assert(0);  // what bitwise operator;
+    output("\tmovq\t%s, %%%s\n", operand(v, 8), regs(8, reg));
+}
 
-  output("\t%s%c\t%%%s, %%%s\n", inst, size_suffix(n->type->size),
-         regs(n->type->size, RDI), regs(n->type->size, RAX));
+static void store(Inst v, int reg) {
+  output("\tmovq\t%%%s, %s\n", regs(8, reg), frame_ref(-slot(v), ""));
 }
 
-static void gen_shift(Node n) {
-  const char* inst;
-  if (n->kind == A_LEFT_SHIFT)
-    inst = is_signed(n->left->type) ? "sal" : "shl";
+static const char* block_label(Block b) {
+  char buf[64];
+  sprintf(buf, ".L.%s.%d", fn->node->name, b->id);
+  return string(buf);
+}
+
+/******************************
+ *     calling convention     *
+ ******************************/
+// Every argument is of the SysV INTEGER class, or of the MEMORY class for
+// a struct above MAX_REG_STRUCT bytes. One of the INTEGER class takes the
+// next of the six argument registers for each of its eightbytes, if they
+// are all left. Otherwise its eightbytes go on the stack after those of
+// the previous argument. The address a struct is returned to is the first
+// argument, passed only for one of the MEMORY class: a smaller one comes
+// back in rax and rdx.
+
+struct place {
+  int size;    // of a struct passed by value, 0 for a scalar, -1 if the
+               // argument isn't passed
+  int reg;     // first register, or -1 if on the stack
+  int offset;  // from the first argument on the stack
+};
+
+// places the arguments, of the sizes set, returns the bytes of stack they
+// take
+static int place_args(struct place* p, int n) {
+  int nregs = 0, stack = 0;
+  for (int i = 0; i < n; i++) {
+    int eightbytes = p[i].size > 0 ? (p[i].size + 7) / 8 : 1;
+    p[i].reg = -1;
+    if (p[i].size < 0)
+      continue;
+    if (p[i].size <= MAX_REG_STRUCT && nregs + eightbytes <= 6) {
+      p[i].reg = nregs;
+      nregs += eightbytes;
+    } else {
+      p[i].offset = stack;
+      stack += 8 * eightbytes;
+    }
+  }
+  return stack;
+}
+
+static struct place* call_places;  // of the arguments of a call
+static int ncall_places;
+
+static int place_call(Inst v) {
+  if (ncall_places < v->nargs) {
+    ncall_places = v->nargs;
+    call_places = realloc(call_places, v->nargs * sizeof(struct place));
+  }
+  for (int i = 0; i < v->nargs; i++)
+    call_places[i].size = v->arg_sizes ? v->arg_sizes[i] : 0;
+  if (v->imm && v->imm <= MAX_REG_STRUCT)
+    call_places[0].size = -1;
+  return place_args(call_places, v->nargs);
+}
+
+static struct place* param_places;  // of fn, by IR_PARAM index
+
+static void place_params(Func f) {
+  Type ret = f->node->type->base;
+  int n = list_length(f->node->params) + is_struct_or_union(ret), i = 0;
+  Node node;
+  param_places = realloc(param_places, (n + 1) * sizeof(struct place));
+  if (is_struct_or_union(ret))
+    param_places[i++].size = is_memory_class(ret) ? 0 : -1;
+  list_for_each(f->node->params, node) {
+    Type ty = unqual(node->body->type);
+    param_places[i++].size = is_struct_or_union(ty) ? ty->size : 0;
+  }
+  place_args(param_places, n);
+}
+
+// the place of a struct parameter, NULL for other variables
+static struct place* struct_param_place(Node var) {
+  Node node;
+  int i = is_struct_or_union(fn->node->type->base);
+  list_for_each(fn->node->params, node) {
+    if (node->body == var)
+      return param_places[i].size > 0 ? &param_places[i] : NULL;
+    i++;
+  }
+  return NULL;
+}
+
+// The size bytes at disp(base) are loaded in pieces of 4, 2 and 1 bytes
+// when they aren't a register width: the highest piece first, then each
+// lower one shifted in under it through r10. A store moves the pieces out
+// from the lowest, shifting reg.
+static void load_zext(int reg, int base, int disp, int size) {
+  if (size == 8 || size == 4)
+    output("\tmov%c\t%d(%%%s), %%%s\n", size_suffix(size), disp,
+           regs(8, base), regs(size, reg));
   else
-    inst = is_signed(n->left->type) ? "sar" : "shr";
+    output("\tmovz%cl\t%d(%%%s), %%%s\n", size_suffix(size), disp,
+           regs(8, base), regs(4, reg));
+}
 
-  output("\tmovq\t%%rdi, %%rcx\n");
-  output("\t%s%c\t%%cl, %%%s\n", inst, size_suffix(n->left->type->size),
-         regs(n->left->type->size, RAX));
+static void load_bytes(int reg, int base, int disp, int size) {
+  int s = size == 8 ? 8 : size & -size;  // the highest piece
+  int top = size - s;
+  load_zext(reg, base, disp + top, s);
+  while (top) {
+    s = top & -top;
+    top -= s;
+    output("\tshlq\t$%d, %%%s\n", 8 * s, regs(8, reg));
+    load_zext(R10, base, disp + top, s);
+    output("\torq\t%%r10, %%%s\n", regs(8, reg));
+  }
 }
 
-static void gen_expr(Node n) {
-  switch (n->kind) {
-    case A_NOOP:
-      return;
-    case A_IDENT:
-      gen_expr(n->ref);
-      return;
-    case A_NUM:
-    case A_ENUM_CONST:
-      gen_iconst(n);
-      return;
-    case A_STRING_LITERAL:
-      gen_addr(n);
-      return;
-    case A_VAR:
-    case A_ARRAY_SUBSCRIPTING:
-    case A_MEMBER_SELECTION:
-      gen_addr(n);
-      gen_load(n->type);
-      return;
-    case A_DEFERENCE:
-      gen_expr(n->left);
-      gen_load(deref_type(n->left->type));
-      return;
-    case A_ADDRESS_OF:
-      gen_addr(n->left);
-      return;
-    case A_ASSIGN:
-      output("\t// assignment\n");
-      gen_addr(n->left);
-      gen_expr(n->right);
-      gen_store(n->left->type);
-      return;
-    case A_FUNC_CALL:
-      gen_funccall(n);
-      return;
-    case A_CONVERSION:
-      gen_conversion(n);
-      return;
-    case A_TERNARY:
-      gen_ternary(n);
-      return;
-    case A_COMMA:
-      gen_expr(n->left);
-      output("\tpopq\t%%rax\n");
-      gen_expr(n->right);
-      return;
-    case A_MINUS:
-    case A_PLUS:
-    case A_L_NOT:
-    case A_B_NOT:
-      gen_unary_arithmetic(n);
-      return;
-    case A_POSTFIX_INC:
-    case A_POSTFIX_DEC:
-      gen_postfix_incdec(n);
-      return;
+static void store_bytes(int reg, int base, int disp, int size) {
+  int offset = 0;
+  for (int s = 8; s; s >>= 1) {
+    if (!(size & s))
+      continue;
+    output("\tmov%c\t%%%s, %d(%%%s)\n", size_suffix(s), regs(s, reg),
+           disp + offset, regs(8, base));
+    offset += s;
+    if (offset < size)
+      output("\tshrq\t$%d, %%%s\n", 8 * s, regs(8, reg));
   }
+}
 
-  // binary expr
-  // The order of evaluation is unspecified
-  // https://en.cppreference.com/w/cpp/language/eval_order
-  gen_expr(n->left);
-  gen_expr(n->right);
-  output("\tpopq\t%%rdi\n");
-  output("\tpopq\t%%rax\n");
-  switch (n->kind) {
-    case A_ADD:
-    case A_SUB:
-    case A_DIV:
-    case A_MUL:
-    case A_MOD:
-      gen_ementary_arithmetic(n);
-      break;
-    case A_EQ:
-    case A_NE:
-    case A_GT:
-    case A_LT:
-    case A_GE:
-    case A_LE:
-      gen_compare(n);
-      break;
-    case A_L_AND:
-      gen_logical_and(n);
-      break;
-    case A_L_OR:
-      gen_logical_or(n);
-      break;
-    case A_B_AND:
-    case A_B_EXCLUSIVEOR:
-    case A_B_INCLUSIVEOR:
-      gen_bitwise(n);
-      break;
-    case A_LEFT_SHIFT:
-    case A_RIGHT_SHIFT:
-      gen_shift(n);
-      break;
-    default:
-      assert(0);  // unknown ast node
+// a struct of up to 16 bytes at base, in reg0 and reg1
+static void load_struct(int reg0, int reg1, int base, int size) {
+  load_bytes(reg0, base, 0, size < 8 ? size : 8);
+  if (size > 8)
+    load_bytes(reg1, base, 8, size - 8);
+}
+
+static void store_struct(int reg0, int reg1, int base, int size) {
+  store_bytes(reg0, base, 0, size < 8 ? size : 8);
+  if (size > 8)
+    store_bytes(reg1, base, 8, size - 8);
+}
+
+// the arguments of v in registers, the structs first as they use r11
+static void load_args(Inst v) {
+  struct place* p = call_places;
+  for (int i = 0; i < v->nargs; i++) {
+    if (p[i].reg < 0 || !p[i].size)
+      continue;
+    load(v->args[i], R11);
+    load_struct(p[i].reg, p[i].reg + 1, R11, p[i].size);
+  }
+  for (int i = 0; i < v->nargs; i++) {
+    if (p[i].reg >= 0 && !p[i].size)
+      load(v->args[i], p[i].reg);
   }
-  output("\tpushq\t%%rax\n");
 }
 
 /******************************
- *    generate statements    *
+ *    generate instructions   *
  ******************************/
-// jump locations for iteration statements (for, while, do-while)
-typedef struct jumploc* JumpLoc;
-struct jumploc {
-  const char** lcontinue;
-  const char** lbreak;
-  JumpLoc next;
-};
-static JumpLoc iterjumploc;
 
-static void iter_enter(const char** lcontinue, const char** lbreak) {
-  JumpLoc j = malloc(sizeof(struct jumploc));
-  j->lbreak = lbreak;
-  j->lcontinue = lcontinue;
-  j->next = iterjumploc;
-  iterjumploc = j;
+// the constants that don't fit an immediate
+static void gen_imm(Inst v) {
+  output("\tmovabsq\t$%lld, %%rax\n", imm_value(v));
+  store(v, RAX);
+}
+
+static void gen_param(Inst v) {
+  struct place* p = &param_places[v->imm];
+  if (v->var) {  // a struct passed on the stack is used where it is
+    if (p->reg >= 0) {
+      output("\tleaq\t%s, %%r11\n", frame_ref(-v->var->offset, ""));
+      store_struct(p->reg, p->reg + 1, R11, p->size);
+    }
+    return;
+  }
+  if (p->reg >= 0) {
+    store(v, p->reg);
+    return;
+  }
+  output("\tmovq\t%s, %%rax\n", frame_ref(16 + p->offset, ""));
+  store(v, RAX);
+}
+
+static void gen_load(Inst v) {
+  const char* src = address(&addresses[v->id]);
+  output("\tmov%c\t%s, %%%s\n", size_suffix(v->size), src,
+         regs(v->size, RAX));
+  store(v, RAX);
+}
+
+static void gen_store(Inst v) {
+  int size = v->args[1]->size;
+  char src[32];
+  if (is_inlined_imm(v->args[1])) {
+    strcpy(src, operand(v->args[1], size));
+  } else {
+    load(v->args[1], RAX);
+    sprintf(src, "%%%s", regs(size, RAX));
+  }
+  const char* dst = address(&addresses[v->id]);
+  output("\tmov%c\t%s, %s\n", size_suffix(size), src, dst);
+}
+
+// A block is copied from %rsi, or zeroed, to %rdi by the widest moves
+// that fit it. Below 16 bytes, two moves of a register width overlap to
+// cover it. Up to SMALL_BLOCK bytes, 16 byte chunks move through %xmm0
+// and %xmm1 in pairs, and up to LARGE_BLOCK bytes a loop moves 32 bytes
+// at a time. A tail that isn't a whole chunk is moved by a chunk
+// overlapping the one before it. Longer blocks go to rep movsb or stosb,
+// whose startup pays off there.
+#define SMALL_BLOCK 64
+#define LARGE_BLOCK 512
+
+static void gen_chunks(int copy, long* offsets, int n) {
+  for (int i = 0; i < n; i += 2) {
+    int pair = n - i < 2 ? 1 : 2;
+    for (int j = 0; copy && j < pair; j++)
+      output("\tmovdqu\t%ld(%%rsi), %%xmm%d\n", offsets[i + j], j);
+    for (int j = 0; j < pair; j++)
+      output("\tmovdqu\t%%xmm%d, %ld(%%rdi)\n", copy ? j : 0,
+             offsets[i + j]);
+  }
+}
+
+static void gen_short_block(int copy, long size) {
+  int s = 8;
+  while (s > size)
+    s >>= 1;
+  long offsets[2] = {0, size - s};
+  int n = size > s ? 2 : 1;
+  for (int i = 0; copy && i < n; i++)
+    output("\tmov%c\t%ld(%%rsi), %%%s\n", size_suffix(s), offsets[i],
+           regs(s, i ? RDX : RAX));
+  for (int i = 0; i < n; i++) {
+    if (copy)
+      output("\tmov%c\t%%%s, %ld(%%rdi)\n", size_suffix(s),
+             regs(s, i ? RDX : RAX), offsets[i]);
+    else
+      output("\tmov%c\t$0, %ld(%%rdi)\n", size_suffix(s), offsets[i]);
+  }
+}
+
+static void gen_moves(int copy, long size) {
+  if (size > LARGE_BLOCK) {
+    if (!copy)
+      output("\txorl\t%%eax, %%eax\n");
+    output("\tmovl\t$%ld, %%ecx\n", size);
+    output("\trep %s\n", copy ? "movsb" : "stosb");
+    return;
+  }
+  if (size < 16) {
+    if (size)
+      gen_short_block(copy, size);
+    return;
+  }
+  if (!copy)
+    output("\tpxor\t%%xmm0, %%xmm0\n");
+
+  long offsets[SMALL_BLOCK / 16 + 1];
+  long rest = size;
+  int n = 0;
+  if (size > SMALL_BLOCK) {
+    const char* loop = new_label();
+    output("\tmovl\t$%ld, %%ecx\n", size / 32);
+    output("%s:\n", loop);
+    offsets[0] = 0;
+    offsets[1] = 16;
+    gen_chunks(copy, offsets, 2);
+    if (copy)
+      output("\taddq\t$32, %%rsi\n");
+    output("\taddq\t$32, %%rdi\n");
+    output("\tsubl\t$1, %%ecx\n");
+    output("\tjnz\t%s\n", loop);
+    rest = size % 32;
+  }
+  for (long offset = 0; offset + 16 <= rest; offset += 16)
+    offsets[n++] = offset;
+  if (rest % 16)
+    offsets[n++] = rest - 16;
+  gen_chunks(copy, offsets, n);
 }
 
-static void iter_exit() {
-  iterjumploc = iterjumploc->next;
+static void gen_block(Inst v) {
+  load(v->args[0], RDI);
+  if (v->op == IR_COPY)
+    load(v->args[1], RSI);
+  gen_moves(v->op == IR_COPY, v->imm);
 }
 
-static void gen_if(Node n) {
-  const char* lend = new_label();
-  const char* lfalse = n->els ? new_label() : lend;
+// A call whose value is returned right away, with its arguments in
+// registers, is a jump once the frame is gone: the callee returns to our
+// caller. The frame must not hold variables the arguments may point to,
+// nor a struct returned.
+static int is_tail_call(Inst v) {
+  Inst ret = v->next;
+  if (v->op != IR_CALL || v->imm || locals_size || ret->op != IR_RET ||
+      place_call(v))
+    return 0;
+  return ret->nargs ? ret->args[0] == v : v->size == 0;
+}
 
-  // condition
-  gen_expr(n->cond);
-  output("\tpopq\t%%rax\n");
-  output("\tcmpl\t$0, %%eax\n");
-  output("\tjz\t%s\n", lfalse);
+static void gen_funccall(Inst v) {
+  output("// call function \"%s\"\n", v->name);
 
-  // true statement
-  gen_stat(n->then);
+  int stack = place_call(v);
+  if (is_tail_call(v)) {
+    load_args(v);
+    output("\tmovl\t$0, %%eax\n");
+    gen_epilogue();
+    output("\tjmp\t%s\n", v->name);
+    return;
+  }
 
-  // false statement
-  if (n->els) {
-    output("\tjmp\t%s\n", lend);
-    output("%s:\n", lfalse);
-    gen_stat(n->els);
+  // The arguments on the stack are stored first, the copies of structs use
+  // registers. The stack is kept 16 byte aligned at the call.
+  int area = (stack + 15) & -16;
+  if (area) {
+    output("\tsubq\t$%d, %%rsp\n", area);
+    sp_offset += area;
   }
+  for (int i = 0; i < v->nargs; i++) {
+    struct place* p = &call_places[i];
+    if (p->reg >= 0 || p->size < 0)
+      continue;
+    if (p->size) {
+      output("\tleaq\t%d(%%rsp), %%rdi\n", p->offset);
+      load(v->args[i], RSI);
+      gen_moves(1, p->size);
+    } else if (is_inlined_imm(v->args[i])) {
+      output("\tmovq\t%s, %d(%%rsp)\n", operand(v->args[i], 8), p->offset);
+    } else {
+      load(v->args[i], RAX);
+      output("\tmovq\t%%rax, %d(%%rsp)\n", p->offset);
+    }
+  }
+  load_args(v);
 
-  output("%s:\n", lend);
+  // no vector registers are used for variadic arguments
+  output("\tmovl\t$0, %%eax\n");
+  output("\tcall\t%s\n", v->name);
+  if (area) {
+    output("\taddq\t$%d, %%rsp\n", area);
+    sp_offset -= area;
+  }
+  if (v->size)
+    store(v, RAX);
+  if (v->imm && v->imm <= MAX_REG_STRUCT) {
+    load(v->args[0], R11);
+    store_struct(RAX, RDX, R11, v->imm);
+  }
+  output("// ---- call function \"%s\"\n", v->name);
 }
 
-static void gen_dowhile(Node n) {
-  const char* lstat = new_label();
-  const char* lend = NULL;
+static void gen_conversion(Inst v) {
+  int from = v->args[0]->size, to = v->size;
+  load(v->args[0], RAX);
+  if (v->op == IR_ZEXT && from == 4)  // writing a 32 bit register clears the rest
+    output("\tmovl\t%%eax, %%eax\n");
+  else if (v->op != IR_TRUNC)
+    output("\tmov%c%c%c\t%%%s, %%%s\n", v->op == IR_SEXT ? 's' : 'z',
+           size_suffix(from), size_suffix(to), regs(from, RAX),
+           regs(to, RAX));
+  store(v, RAX);
+}
 
-  iter_enter(&lstat, &lend);
+static void gen_unary_arithmetic(Inst v) {
+  load(v->args[0], RAX);
+  output("\t%s%c\t%%%s\n", v->op == IR_NEG ? "neg" : "not",
+         size_suffix(v->size), regs(v->size, RAX));
+  store(v, RAX);
+}
 
-  // statement
-  output("%s:\n", lstat);
-  gen_stat(n->body);
+// Division by a constant d that isn't a power of two multiplies by a
+// fixed-point reciprocal m of d and takes the high half of the product
+// (Granlund and Montgomery, as in Hacker's Delight). A 32-bit dividend
+// is extended to 64 bits and multiplied by ceil(2^64 / |d|), which is
+// close enough that the high half is the quotient, plus one for a
+// negative dividend. A 64-bit dividend needs m and a shift s chosen for
+// d.
+
+static void signed_magic(long long d, long long* m, int* s) {
+  const unsigned long long two63 = 1ULL << 63;
+  unsigned long long ad = d < 0 ? -(unsigned long long)d : d;
+  unsigned long long t = two63 + ((unsigned long long)d >> 63);
+  unsigned long long anc = t - 1 - t % ad;  // |nc|
+  unsigned long long q1 = two63 / anc, r1 = two63 - q1 * anc;
+  unsigned long long q2 = two63 / ad, r2 = two63 - q2 * ad;
+  unsigned long long delta;
+  int p = 63;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *m = q2 + 1;
+  if (d < 0)
+    *m = -*m;
+  *s = p - 64;
+}
+
+// add is set if m doesn't fit 64 bits, then the quotient is
+// ((x - q) / 2 + q) >> (s - 1), where q is the high half of x * m
+static void unsigned_magic(unsigned long long d, unsigned long long* m,
+                           int* add, int* s) {
+  const unsigned long long two63 = 1ULL << 63;
+  unsigned long long nc = -1 - (-d) % d;
+  unsigned long long q1 = two63 / nc, r1 = two63 - q1 * nc;
+  unsigned long long q2 = (two63 - 1) / d, r2 = (two63 - 1) - q2 * d;
+  unsigned long long delta;
+  int p = 63;
+  *add = 0;
+  do {
+    p++;
+    if (r1 >= nc - r1) {
+      q1 = 2 * q1 + 1;
+      r1 = 2 * r1 - nc;
+    } else {
+      q1 = 2 * q1;
+      r1 = 2 * r1;
+    }
+    if (r2 + 1 >= d - r2) {
+      if (q2 >= two63 - 1)
+        *add = 1;
+      q2 = 2 * q2 + 1;
+      r2 = 2 * r2 + 1 - d;
+    } else {
+      if (q2 >= two63)
+        *add = 1;
+      q2 = 2 * q2;
+      r2 = 2 * r2 + 1;
+    }
+    delta = d - 1 - r2;
+  } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+  *m = q2 + 1;
+  *s = p - 64;
+}
+
+static int log2_exact(unsigned long long x) {
+  if (x == 0 || (x & (x - 1)))
+    return -1;
+  int k = 0;
+  while (x >>= 1)
+    k++;
+  return k;
+}
+
+// rdx = q * d, d of the operation's size
+static void gen_mul_imm(int size, long long d) {
+  if (d >= INT_MIN && d <= INT_MAX) {
+    output("\timul%c\t$%lld, %%%s, %%%s\n", size_suffix(size), d,
+           regs(size, RDX), regs(size, RDX));
+    return;
+  }
+  output("\tmovabsq\t$%lld, %%rcx\n", d);
+  output("\timulq\t%%rcx, %%rdx\n");
+}
+
+// x in rax, the quotient in rdx, leaves the result of v in rax
+static void gen_div_result(Inst v, long long d) {
+  int size = v->size;
+  char c = size_suffix(size);
+  if (v->op == IR_DIV || v->op == IR_UDIV) {
+    output("\tmov%c\t%%%s, %%%s\n", c, regs(size, RDX), regs(size, RAX));
+    return;
+  }
+  // the remainder is x - q * d
+  gen_mul_imm(size, d);
+  output("\tsub%c\t%%%s, %%%s\n", c, regs(size, RDX), regs(size, RAX));
+}
+
+static void gen_signed_div_imm(Inst v, long long d) {
+  int size = v->size, bits = 8 * size;
+  char c = size_suffix(size);
+  unsigned long long ad = d < 0 ? -(unsigned long long)d : d;
+  int k = log2_exact(ad);
+
+  if (k == 0) {
+    if (v->op == IR_MOD)
+      output("\txorl\t%%eax, %%eax\n");
+    else if (d < 0)
+      output("\tneg%c\t%%%s\n", c, regs(size, RAX));
+    return;
+  }
+  if (k > 0) {
+    // round toward zero: add 2^k - 1 to a negative dividend
+    output("\tmov%c\t%%%s, %%%s\n", c, regs(size, RAX), regs(size, RDX));
+    output("\tsar%c\t$%d, %%%s\n", c, bits - 1, regs(size, RDX));
+    output("\tshr%c\t$%d, %%%s\n", c, bits - k, regs(size, RDX));
+    output("\tadd%c\t%%%s, %%%s\n", c, regs(size, RAX), regs(size, RDX));
+    output("\tsar%c\t$%d, %%%s\n", c, k, regs(size, RDX));
+    if (v->op == IR_MOD) {
+      output("\tshl%c\t$%d, %%%s\n", c, k, regs(size, RDX));
+      output("\tsub%c\t%%%s, %%%s\n", c, regs(size, RDX), regs(size, RAX));
+      return;
+    }
+    output("\tmov%c\t%%%s, %%%s\n", c, regs(size, RDX), regs(size, RAX));
+    if (d < 0)
+      output("\tneg%c\t%%%s\n", c, regs(size, RAX));
+    return;
+  }
+
+  if (size == 4) {
+    output("\tmovslq\t%%eax, %%rax\n");
+    output("\tmovq\t%%rax, %%rsi\n");
+    output("\tmovq\t%%rax, %%rcx\n");
+    output("\tmovabsq\t$%lld, %%rdx\n", (long long)(~0ULL / ad + 1));
+    output("\timulq\t%%rdx\n");
+    output("\tsarq\t$63, %%rcx\n");
+    output("\tsubq\t%%rcx, %%rdx\n");
+    output("\tmovq\t%%rsi, %%rax\n");
+    // the quotient by |d|: x / d is -(x / |d|) and x % d is x % |d|
+    if (d < 0 && v->op == IR_DIV)
+      output("\tnegl\t%%edx\n");
+    gen_div_result(v, ad);
+    return;
+  }
+  long long m;
+  int s;
+  signed_magic(d, &m, &s);
+  output("\tmovq\t%%rax, %%rsi\n");
+  output("\tmovabsq\t$%lld, %%rdx\n", m);
+  output("\timulq\t%%rdx\n");
+  if (d > 0 && m < 0)
+    output("\taddq\t%%rsi, %%rdx\n");
+  if (d < 0 && m > 0)
+    output("\tsubq\t%%rsi, %%rdx\n");
+  if (s)
+    output("\tsarq\t$%d, %%rdx\n", s);
+  output("\tmovq\t%%rdx, %%rax\n");
+  output("\tshrq\t$63, %%rax\n");
+  output("\taddq\t%%rax, %%rdx\n");
+  output("\tmovq\t%%rsi, %%rax\n");
+  gen_div_result(v, d);
+}
+
+static void gen_unsigned_div_imm(Inst v, unsigned long long d) {
+  int size = v->size;
+  char c = size_suffix(size);
+  int k = log2_exact(d);
+
+  if (k >= 0) {
+    if (v->op == IR_UDIV) {
+      output("\tshr%c\t$%d, %%%s\n", c, k, regs(size, RAX));
+    } else if (k < 32) {
+      output("\tand%c\t$%llu, %%%s\n", c, d - 1, regs(size, RAX));
+    } else {
+      output("\tmovabsq\t$%llu, %%rdx\n", d - 1);
+      output("\tandq\t%%rdx, %%rax\n");
+    }
+    return;
+  }
+
+  output("\tmovq\t%%rax, %%rsi\n");
+  if (size == 4) {
+    output("\tmovl\t%%eax, %%eax\n");
+    output("\tmovabsq\t$%lld, %%rdx\n", (long long)(~0ULL / d + 1));
+    output("\tmulq\t%%rdx\n");
+  } else {
+    unsigned long long m;
+    int add, s;
+    unsigned_magic(d, &m, &add, &s);
+    output("\tmovabsq\t$%lld, %%rdx\n", (long long)m);
+    output("\tmulq\t%%rdx\n");
+    if (add) {
+      output("\tmovq\t%%rsi, %%rax\n");
+      output("\tsubq\t%%rdx, %%rax\n");
+      output("\tshrq\t$1, %%rax\n");
+      output("\taddq\t%%rax, %%rdx\n");
+      s--;
+    }
+    if (s)
+      output("\tshrq\t$%d, %%rdx\n", s);
+  }
+  output("\tmovq\t%%rsi, %%rax\n");
+  gen_div_result(v, d);
+}
+
+// binary instructions
+// get operand from: %rax(left) and args[1], see operand()
+// store result to : %rax
+static void gen_ementary_arithmetic(Inst v) {
+  Inst b = v->args[1];
+  int size = v->size;
+  char c = size_suffix(size);
+  const char* inst;
+
+  if (v->op == IR_MUL && is_inlined_imm(b)) {
+    long long k = imm_value(b);
+    int shift = log2_exact(k);
+    if (shift >= 0)
+      output("\tshl%c\t$%d, %%%s\n", c, shift, regs(size, RAX));
+    else if (k == 3 || k == 5 || k == 9)
+      output("\tlea%c\t(%%rax,%%rax,%lld), %%%s\n", c, k - 1,
+             regs(size, RAX));
+    else
+      output("\timul%c\t$%lld, %%%s, %%%s\n", c, k, regs(size, RAX),
+             regs(size, RAX));
+    return;
+  }
 
-  // condition
-  gen_expr(n->cond);
-  output("\tpopq\t%%rax\n");
-  output("\tcmpl\t$0, %%eax\n");
-  output("\tjnz\t%s\n", lstat);
+  if (v->op == IR_ADD)
+    inst = "add";
+  else if (v->op == IR_SUB)
+    inst = "sub";
+  else if (v->op == IR_MUL)
+    inst = "imul";
+  else if (v->op == IR_AND)
+    inst = "and";
+  else if (v->op == IR_OR)
+    inst = "or";
+  else if (v->op == IR_XOR)
+    inst = "xor";
+  else {
+    assert(size == 4 || size == 8);
+    int is_signed = v->op == IR_DIV || v->op == IR_MOD;
+    long long d = is_inlined_imm(b) ? imm_value(b) : 0;
+    if (is_signed && d) {
+      gen_signed_div_imm(v, d);
+      return;
+    }
+    // a divisor of 2^63 or more is left to div
+    if (d && (size == 4 || d > 0)) {
+      gen_unsigned_div_imm(v, size == 4 ? (unsigned)d : d);
+      return;
+    }
 
-  iter_exit();
-  if (lend) {
-    output("%s:\n", lend);
+    if (is_signed)
+      output("\t%s\n", size == 4 ? "cltd" : "cqto");
+    else
+      output("\txorl\t%%edx, %%edx\n");
+    if (is_inlined_imm(b)) {  // div takes no immediate
+      load(b, RDI);
+      output("\t%sdiv%c\t%%%s\n", is_signed ? "i" : "", c, regs(size, RDI));
+    } else {
+      output("\t%sdiv%c\t%s\n", is_signed ? "i" : "", c, operand(b, size));
+    }
+    if (v->op == IR_MOD || v->op == IR_UMOD)
+      output("\tmov%c\t%%%s, %%%s\n", c, regs(size, RDX), regs(size, RAX));
+    return;
   }
+
+  output("\t%s%c\t%s, %%%s\n", inst, c, operand(b, size), regs(size, RAX));
 }
 
-static void gen_break(Node n) {
-  if (!(*iterjumploc->lbreak)) {
-    *iterjumploc->lbreak = new_label();
+// condition codes of the compares, and of their negations
+static const char* cc[] = {
+    [IR_EQ] = "e",  [IR_NE] = "ne", [IR_LT] = "l",  [IR_LE] = "le",
+    [IR_GT] = "g",  [IR_GE] = "ge", [IR_ULT] = "b", [IR_ULE] = "be",
+    [IR_UGT] = "a", [IR_UGE] = "ae",
+};
+static const char* not_cc[] = {
+    [IR_EQ] = "ne", [IR_NE] = "e",  [IR_LT] = "ge",  [IR_LE] = "g",
+    [IR_GT] = "le", [IR_GE] = "l",  [IR_ULT] = "ae", [IR_ULE] = "a",
+    [IR_UGT] = "be", [IR_UGE] = "b",
+};
+
+// an immediate or a memory operand goes second
+static void swap_operands(Inst v) {
+  if (is_commutative(v->op) && inlined[v->args[0]->id] &&
+      !inlined[v->args[1]->id]) {
+    Inst t = v->args[0];
+    v->args[0] = v->args[1];
+    v->args[1] = t;
   }
-  output("\tjmp\t%s\n", *iterjumploc->lbreak);
 }
 
-static void gen_continue(Node n) {
-  if (!(*iterjumploc->lcontinue)) {
-    *iterjumploc->lcontinue = new_label();
+// sets the flags for the compare v, its first operand is in rax
+static void gen_flags(Inst v) {
+  Inst b = v->args[1];
+  int size = v->args[0]->size;
+
+  if (is_inlined_imm(b) && imm_value(b) == 0)
+    output("\ttest%c\t%%%s, %%%s\n", size_suffix(size), regs(size, RAX),
+           regs(size, RAX));
+  else
+    output("\tcmp%c\t%s, %%%s\n", size_suffix(size), operand(b, size),
+           regs(size, RAX));
+}
+
+static void gen_compare(Inst v) {
+  gen_flags(v);
+  output("\tset%s\t%%al\n", cc[v->op]);
+  output("\tmovzbl\t%%al, %%eax\n");
+}
+
+// the condition code for which v is true, with the flags set
+static const char* gen_condition(Inst v) {
+  if (is_compare_op(v->op) && inlined[v->id]) {
+    swap_operands(v);
+    load(v->args[0], RAX);
+    gen_flags(v);
+    return cc[v->op];
   }
-  output("\tjmp\t%s\n", *iterjumploc->lcontinue);
+  load(v, RAX);
+  output("\ttest%c\t%%%s, %%%s\n", size_suffix(v->size), regs(v->size, RAX),
+         regs(v->size, RAX));
+  return "ne";
 }
 
-static void gen_for(Node n) {
-  const char* lcond = new_label();
-  const char* lend = new_label();
-  const char* lcontinue = (n->post) ? NULL : lcond;
+// both values are computed, the flags pick one without a branch
+static void gen_select(Inst v) {
+  load(v->args[1], RCX);
+  load(v->args[2], RDX);
+  const char* c = gen_condition(v->args[0]);
+  output("\tmovq\t%%rdx, %%rax\n");
+  output("\tcmov%sq\t%%rcx, %%rax\n", c);
+  store(v, RAX);
+}
 
-  // init
-  if (n->init) {
-    gen_stat(n->init);
+static void gen_shift(Inst v) {
+  const char* inst;
+  if (v->op == IR_SHL)
+    inst = "shl";
+  else
+    inst = v->op == IR_SAR ? "sar" : "shr";
+
+  if (is_inlined_imm(v->args[1])) {
+    // the count is masked like the one in cl
+    int mask = v->size == 8 ? 63 : 31;
+    output("\t%s%c\t$%lld, %%%s\n", inst, size_suffix(v->size),
+           imm_value(v->args[1]) & mask, regs(v->size, RAX));
+    return;
   }
+  load(v->args[1], RCX);
+  output("\t%s%c\t%%cl, %%%s\n", inst, size_suffix(v->size),
+         regs(v->size, RAX));
+}
 
-  // condition
-  output("%s:\n", lcond);
-  if (n->cond) {
-    gen_expr(n->cond);
-    output("\tpopq\t%%rax\n");
-    output("\tcmpl\t$0, %%eax\n");
-    output("\tje\t%s\n", lend);
+static void gen_binary(Inst v) {
+  if (is_lea[v->id]) {
+    const char* src = address(&addresses[v->id]);
+    output("\tlea%c\t%s, %%%s\n", size_suffix(v->size), src,
+           regs(v->size, RAX));
+    store(v, RAX);
+    return;
   }
 
-  // stat
-  iter_enter(&lcontinue, &lend);
-  gen_stat(n->body);
-  iter_exit();
+  swap_operands(v);
+  load(v->args[0], RAX);
+  if (is_compare_op(v->op))
+    gen_compare(v);
+  else if (v->op == IR_SHL || v->op == IR_SAR || v->op == IR_SHR)
+    gen_shift(v);
+  else
+    gen_ementary_arithmetic(v);
+  store(v, RAX);
+}
+
+// Moves the operands of the phis in the successor to their slots. A phi
+// may be the operand of another one, then all the operands are read
+// before any phi is written.
+static int needs_swap(Block b) {
+  Block s = b->succ[0];
+  int i = pred_index(s, b), swap = 0;
+  for (Inst v = s->first; v->op == IR_PHI; v = v->next)
+    swap |= v->args[i]->op == IR_PHI && v->args[i]->block == s;
+  return swap;
+}
 
-  // post_expr
-  if (n->post) {
-    if (lcontinue)
-      output("%s:\n", lcontinue);
-    gen_stat(n->post);
+static void gen_phi_moves(Block b) {
+  Block s = b->succ[0];
+  int i = pred_index(s, b);
+  Inst v;
+
+  if (!needs_swap(b)) {
+    for (v = s->first; v->op == IR_PHI; v = v->next) {
+      if (is_inlined_imm(v->args[i])) {
+        output("\tmovq\t%s, %s\n", operand(v->args[i], 8),
+               frame_ref(-slot(v), ""));
+        continue;
+      }
+      load(v->args[i], RAX);
+      store(v, RAX);
+    }
+    return;
   }
-  output("\tjmp\t%s\n", lcond);
-  output("%s:\n", lend);
+
+  for (v = s->first; v->op == IR_PHI; v = v->next)
+    push(operand(v->args[i], 8));
+  for (v = v->prev; v; v = v->prev)
+    pop(v);
 }
 
-static void gen_return(Node n) {
-  if (n->body) {
-    if (current_func->type == voidtype)
-      warn("return with a value, in function returning void");
-    gen_expr(n->body);
-    output("\tpopq\t%%rax\n");
+// The table holds the offset of each label from the table, so it needs
+// no relocation when the code is position independent.
+static void gen_switch(Inst v) {
+  Block b = v->block;
+  const char* table = new_label();
+
+  load(v->args[0], RAX);
+  output("\tleaq\t%s(%%rip), %%rcx\n", table);
+  output("\tmovslq\t(%%rcx,%%rax,4), %%rax\n");
+  output("\taddq\t%%rcx, %%rax\n");
+  output("\tjmp\t*%%rax\n");
+
+  output("\t.section .rodata\n");
+  output("\t.align\t4\n");
+  output("%s:\n", table);
+  for (unsigned long long k = 0; k < v->imm; k++)
+    output("\t.long\t%s-%s\n", block_label(b->succ[v->table[k]]), table);
+  output("\t.text\n");
+}
+
+static void gen_branch(Inst v) {
+  Block b = v->block;
+
+  // the epilogue is short enough to repeat at each return
+  if (v->op == IR_RET && v->prev && is_tail_call(v->prev))
+    return;
+  if (v->op == IR_RET) {
+    Type ty = fn->node->type->base;
+    if (v->nargs && is_struct_or_union(ty) && !is_memory_class(ty)) {
+      load(v->args[0], R11);
+      load_struct(RAX, RDX, R11, unqual(ty)->size);
+    } else if (v->nargs)
+      load(v->args[0], RAX);
+    gen_epilogue();
+    output("\tret\n");
+    return;
+  }
+
+  if (v->op == IR_JMP) {
+    gen_phi_moves(b);
+    if (b->succ[0] != b->next)
+      output("\tjmp\t%s\n", block_label(b->succ[0]));
+    return;
+  }
+
+  if (v->op == IR_SWITCH) {
+    gen_switch(v);
+    return;
   }
-  output("\tjmp\t.L.return.%s\n", current_func->name);
+  if (v->op == IR_IJMP) {
+    load(v->args[0], RAX);
+    output("\tjmp\t*%%rax\n");
+    return;
+  }
+
+  Inst c = v->args[0];
+  const char* jump = gen_condition(c);
+  const char* not_jump =
+      is_compare_op(c->op) && inlined[c->id] ? not_cc[c->op] : "e";
+  if (b->succ[0] == b->next) {
+    output("\tj%s\t%s\n", not_jump, block_label(b->succ[1]));
+    return;
+  }
+  output("\tj%s\t%s\n", jump, block_label(b->succ[0]));
+  if (b->succ[1] != b->next)
+    output("\tjmp\t%s\n", block_label(b->succ[1]));
 }
 
-static void gen_stat(Node n) {
-  switch (n->kind) {
-    case A_BLOCK:
-      for (Node s = n->body; s; s = s->next)
-        gen_stat(s);
+static void gen_inst(Inst v) {
+  if (inlined[v->id])  // generated where it's used
+    return;
+  switch (v->op) {
+    case IR_IMM:
+      gen_imm(v);
       return;
-    case A_IF:
-      gen_if(n);
+    case IR_PARAM:
+      gen_param(v);
       return;
-    case A_FOR:
-      gen_for(n);
+    case IR_PHI:  // see gen_phi_moves
       return;
-    case A_DOWHILE:
-      gen_dowhile(n);
+    case IR_LOAD:
+      gen_load(v);
       return;
-    case A_BREAK:
-      gen_break(n);
+    case IR_STORE:
+      gen_store(v);
       return;
-    case A_CONTINUE:
-      gen_continue(n);
+    case IR_COPY:
+    case IR_ZERO:
+      gen_block(v);
       return;
-    case A_RETURN:
-      gen_return(n);
+    case IR_CALL:
+      gen_funccall(v);
       return;
-    case A_EXPR_STAT:
-      gen_expr(n->body);
-      output("\taddq\t$8, %%rsp\n");
+    case IR_SEXT:
+    case IR_ZEXT:
+    case IR_TRUNC:
+      gen_conversion(v);
+      return;
+    case IR_SELECT:
+      gen_select(v);
+      return;
+    case IR_NEG:
+    case IR_NOT:
+      gen_unary_arithmetic(v);
+      return;
+    case IR_BR:
+    case IR_SWITCH:
+    case IR_JMP:
+    case IR_IJMP:
+    case IR_RET:
+      gen_branch(v);
       return;
     default:
-      gen_expr(n);
+      gen_binary(v);
       return;
   }
 }
@@ -671,65 +1545,117 @@ static void gen_stat(Node n) {
  *  generate data and function  *
  ********************************/
 
-static void handle_lvars(Node n) {
+// An array variable of 16 bytes or more is aligned to 16 by the ABI.
+static int var_align(Node v) {
+  Type t = unqual(v->type);
+  return is_array(t) && t->size >= 16 ? 16 : t->align;
+}
+
+// The frame base is 16-aligned, so a local is aligned by its offset. They are
+// laid out from the most aligned down, leaving padding only at the very end.
+static void handle_lvars(Func f) {
+  Node n = f->node;
   int offset = 0;
   for (Node v = n->locals; v; v = v->next) {
-    if (v->kind == A_VAR) {
-      offset += unqual(v->type)->size;
+    struct place* p = v->kind == A_VAR ? struct_param_place(v) : NULL;
+    if (p && p->reg < 0)  // in the arguments on the stack
+      v->offset = -(16 + p->offset);
+  }
+  for (int align = 16; align; align /= 2) {
+    for (Node v = n->locals; v; v = v->next) {
+      struct place* p = v->kind == A_VAR ? struct_param_place(v) : NULL;
+      if (v->kind != A_VAR || (p && p->reg < 0) || var_align(v) != align)
+        continue;
+      offset = align_to(offset + unqual(v->type)->size, align);
       v->offset = offset;
     }
   }
-  if (offset % 8) {
-    offset += 8 - (offset % 8);
+  locals_size = align_to(offset, 8);
+  n->stack_size = align_to(locals_size + 8 * nslots, 16);
+}
+
+static int needs_frame(Block b) {
+  for (Inst v = b->first; v; v = v->next) {
+    if (v->op == IR_CALL && !is_tail_call(v))
+      return 1;
   }
-  n->stack_size = (offset + 15) & -16;
+  return b->last->op == IR_JMP && needs_swap(b);
 }
 
-static void gen_func() {
-  for (Node n = globals; n; n = n->next) {
-    if (n->kind != A_FUNCTION || !n->body)
+// whether the paths through p stay in the blocks it dominates, and don't
+// come back to it
+static int is_closed(Func f, Block p) {
+  for (int i = 0; i < p->npred; i++) {
+    if (dominates(p, p->pred[i]))
+      return 0;
+  }
+  for (Block b = f->entry; b; b = b->next) {
+    for (int i = 0; dominates(p, b) && i < b->nsucc; i++) {
+      if (!dominates(p, b->succ[i]))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// the block dominating all those needing the frame, moved up until it's
+// run once on their paths
+static Block place_prologue(Func f) {
+  // 8 more for the return address
+  if (f->node->stack_size + 8 > RED_ZONE)
+    return f->entry;
+  compute_dominators(f);
+  Block p = NULL;
+  for (Block b = f->entry; b; b = b->next) {
+    if (!needs_frame(b))
       continue;
+    if (!p)
+      p = b;
+    while (!dominates(p, b))
+      p = p->idom;
+  }
+  while (p && p != f->entry && !is_closed(f, p))
+    p = p->idom;
+  return p;
+}
 
-    enter_func(n);
-    handle_lvars(n);
+// The address of a label is the one of its block. A block merged into
+// another can't be jumped to any more, as no indirect jump was left, its
+// label is only compared.
+static void name_labels(Func f) {
+  for (Node l = f->node->labels; l; l = l->label_next) {
+    Block b = f->entry;
+    while (b && b != l->block)
+      b = b->next;
+    l->name = b ? block_label(b) : f->node->name;
+  }
+}
+
+static void gen_func() {
+  for (Func f = funcs; f; f = f->next) {
+    Node n = f->node;
+    fn = f;
+    split_critical_edges(f);
+    select_operands(f);
+    assign_slots(f);
+    place_params(f);
+    handle_lvars(f);
+    name_labels(f);
+    prologue_block = place_prologue(f);
+    // rsp is 8 below a multiple of 16 at the entry, and must be a multiple
+    // of 16 at calls
+    frame_size = n->stack_size + (options.omit_frame_pointer ? 8 : 0);
 
     output("\t.text\n");
     output("\t.global %s\n", n->name);
     output("%s:\n", n->name);
 
-    // Prologue
-    output("\tpushq\t%%rbp\n");
-    output("\tmovq\t%%rsp, %%rbp\n");
-    output("\tsubq\t$%d, %%rsp\n", n->stack_size);
-
-    // Load arguments to local variables
-    int i = 0;
-    Node node;
-    list_for_each(n->params, node) {
-      Node v = node->body;
-      if (i < 6)
-        output("\tmov%c\t%%%s, -%d(%%rbp)\n",
-               size_suffix(unqual(v->type)->size),
-               regs(unqual(v->type)->size, i), v->offset);
-      else {
-        output("\tmovq\t%d(%%rbp), %%rax\n", 8 * (i - 6) + 16);
-        output("\tmov%c\t%%%s, -%d(%%rbp)\n",
-               size_suffix(unqual(v->type)->size),
-               regs(unqual(v->type)->size, RAX), v->offset);
-      }
-      i++;
+    for (Block b = f->entry; b; b = b->next) {
+      output("%s:\n", block_label(b));
+      set_frame(b);
+      for (Inst v = b->first; v; v = v->next)
+        gen_inst(v);
     }
-
-    // Function body
-    gen_stat(n->body);
-
-    // Epilogue
-    output(".L.return.%s:\n", n->name);
-    output("\tmovq\t%%rbp, %%rsp\n");
-    output("\tpopq\t%%rbp\n");
-    output("\tret\n");
-
-    exit_func(n);
   }
 }
 
@@ -751,6 +1677,7 @@ static void gen_data() {
       if (n_bss++ == 0)
         output("\t.bss\n");
       output("\t.global %s\n", n->name);
+      output("\t.align\t%d\n", var_align(n));
       output("%s:\n", n->name);
       output("\t.zero %d\n", n->type->size);
     }
@@ -761,12 +1688,14 @@ static void gen_data() {
       if (n_data++ == 0)
         output("\t.data\n");
       output("\t.global %s\n", n->name);
+      output("\t.align\t%d\n", var_align(n));
       output("%s:\n", n->name);
       if (n->init_value->kind == A_NUM) {
         if (n->type->size == 1)
-          output("\t.byte\t%d\n", n->init_value->intvalue);
+          output("\t.byte\t%llu\n", n->init_value->intvalue);
         else
-          output("\t.%dbyte\t%d\n", n->type->size, n->init_value->intvalue);
+          output("\t.%dbyte\t%llu\n", n->type->size,
+                 n->init_value->intvalue);
       } else if (n->init_value->kind == A_STRING_LITERAL) {
         output("\t.8byte\t%s\n", n->init_value->name);
       }
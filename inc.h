@@ -12,6 +12,7 @@
  *************/
 
 #define max(x, y) (((x) > (y)) ? (x) : (y))
+#define align_to(x, a) (((x) + (a)-1) & -(a))  // a is a power of two
 
 typedef struct type* Type;
 typedef struct node* Node;
@@ -30,6 +31,11 @@ const char* string(const char* s);
 struct options {
   const char* input_filename;
   const char* output_filename;
+  int dump_ir;             // print the IR to stdout
+  int inline_limit;        // size of the largest function inlined
+  const char** no_inline;  // functions whose calls are kept
+  int nno_inline;
+  int omit_frame_pointer;  // address the frame from rsp
 };
 extern struct options options;
 void parse_arguments(int argc, char* argv[]);
@@ -73,6 +79,7 @@ enum {
   TY_POINTER,
   TY_ARRAY,
   TY_CONST,
+  TY_VOLATILE,  // inside TY_CONST when both apply
   TY_FUNCTION,
   TY_VARARG,
   TY_PLACEHOLDER,
@@ -92,6 +99,18 @@ extern Type uinttype;
 extern Type ulongtype;
 extern Type voidptrtype;
 
+// classification flags of a type, computed once when it's created
+enum {
+  TF_SIGNED = 1 << 0,
+  TF_UNSIGNED = 1 << 1,
+  TF_INTEGER = 1 << 2,
+  TF_SCALAR = 1 << 3,
+  TF_POINTER = 1 << 4,    // pointer or array
+  TF_AGGREGATE = 1 << 5,  // struct or union
+  TF_QUALIFIED = 1 << 6,
+  TF_VOLATILE = 1 << 7,
+};
+
 typedef struct proto* Proto;
 struct proto {
   Type type;
@@ -112,21 +131,30 @@ struct member {
 struct type {
   int kind;
   int size;
+  int align;
   Type base;
 
-  const char* str;
+  const char* str;  // built by type_str() on first use
+  int flags;
   Proto proto;
   const char* tag;  // for struct/union/enum
   Member member;
+  Member* member_index;  // open addressing, keyed by the interned name
+  unsigned member_mask;
+
+  Type ptr;   // cached ptr_type() of this type
+  Type qual;  // cached const_type() of this type
 };
 
 Type type(int kind, Type base, int size);
+const char* type_str(Type t);
 Type ptr_type(Type base);
 Type deref_type(Type ptr);
 Type array_type(Type base, int n);
 Type array_to_ptr(Type a);
 Type function_type(Type t, Proto p);
 Type const_type(Type t);
+Type volatile_type(Type t);
 Type unqual(Type t);
 Type struct_or_union_type(Member member, const char* tag, int kind);
 Member get_struct_or_union_member(Type t, const char* name);
@@ -143,10 +171,13 @@ int is_arithmetic(Type t);
 int is_scalar(Type t);
 int is_qual(Type t);
 int is_const(Type t);
+int is_volatile(Type t);
 int is_struct(Type t);
 int is_union(Type t);
 int is_struct_or_union(Type t);
 int is_struct_with_const_member(Type t);
+#define MAX_REG_STRUCT 16  // bytes of a struct passed in registers
+int is_memory_class(Type t);
 int is_enum(Type t);
 int is_compatible_type(Type t1, Type t2);
 Type composite_type(Type t1, Type t2);
@@ -222,9 +253,13 @@ enum {
   TK_SIZEOF,
   TK_IF,
   TK_ELSE,
+  TK_SWITCH,
+  TK_CASE,
+  TK_DEFAULT,
   TK_WHILE,
   TK_DO,
   TK_FOR,
+  TK_GOTO,
   TK_BREAK,
   TK_CONTINUE,
   TK_RETURN,
@@ -262,7 +297,7 @@ enum {
   A_COMMA,
   // 16 right
   A_ASSIGN,
-  A_INIT,  // init local variable(by assign)
+  A_INIT,  // init local variable(by assign), lowered like A_ASSIGN
   A_TERNARY,
   // 15 left
   A_L_OR,
@@ -303,6 +338,7 @@ enum {
   A_L_NOT,
   A_B_NOT,
   A_SIZE_OF,
+  A_LABEL_ADDRESS,  // &&label
   // 2 left
   A_FUNC_CALL,
   A_ARRAY_SUBSCRIPTING,
@@ -315,8 +351,13 @@ enum {
   A_STRING_LITERAL,
   /***** statement *****/
   A_IF,
+  A_SWITCH,
+  A_CASE,
+  A_DEFAULT,
+  A_LABEL,
   A_DOWHILE,
   A_FOR,
+  A_GOTO,
   A_BREAK,
   A_CONTINUE,
   A_RETURN,
@@ -325,6 +366,7 @@ enum {
   A_DLIST,
   A_BLOCK,
   A_EXPR_STAT,
+  A_ZERO_INIT,  // zero the local aggregate variable body
   A_CONVERSION,
   /***** other *****/
   A_VAR,
@@ -368,18 +410,27 @@ struct node {
   Node post;
 
   // A_WHILE, A_DOWHILE, A_FOR
-  // A_FUNCTION, A_CONVERSION, A_DLIST, A_EXPR_STAT, A_BLOCK
+  // A_FUNCTION, A_CONVERSION, A_DLIST, A_EXPR_STAT, A_ZERO_INIT, A_BLOCK
   Node body;
 
-  // A_NUM, A_ENUM_CONST
+  // A_NUM, A_ENUM_CONST, A_CASE
   unsigned long long intvalue;
 
+  // A_SWITCH: its case and default labels, A_CASE, A_DEFAULT: the next one
+  Node cases;
+  struct block* block;  // A_CASE, A_DEFAULT, A_LABEL: set by the lowering
+
+  // A_LABEL
+  Node label_next;  // linked in the labels of the function
+  int address_taken;
+
   // A_STRING_LITERAL
   const char* string_value;
 
   // A_VAR
   Node scope_next;  // linked in scope(for local var)
   int offset;       // stack offset(for local var)
+  int var_index;    // numbering of the locals, used by the optimizer
   int is_global;
   Node init_value;
 
@@ -398,9 +449,10 @@ struct node {
   Node globals;
   Node params;
   Node locals;
+  Node labels;
   int stack_size;
 
-  // A_IDNET
+  // A_IDNET, A_GOTO, A_LABEL_ADDRESS
   Node ref;
 };
 
@@ -413,6 +465,162 @@ int list_length(Node head);
 
 void parse();
 
+/*************
+ *    ir     *
+ *************/
+enum {
+  // values
+  IR_IMM,    // integer constant
+  IR_ADDR,   // address of a variable or string literal
+  IR_PARAM,  // incoming argument, a struct one is stored to var
+  IR_LOAD,
+  IR_CALL,   // a struct returned is stored to address args[0]
+  IR_PHI,  // args[i] is the value when coming from pred[i]
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_UDIV,
+  IR_MOD,
+  IR_UMOD,
+  IR_AND,
+  IR_OR,
+  IR_XOR,
+  IR_SHL,
+  IR_SAR,
+  IR_SHR,
+  IR_NEG,
+  IR_NOT,
+  // comparisons, yield int 0 or 1
+  IR_EQ,
+  IR_NE,
+  IR_LT,
+  IR_LE,
+  IR_GT,
+  IR_GE,
+  IR_ULT,
+  IR_ULE,
+  IR_UGT,
+  IR_UGE,
+  // conversions
+  IR_SEXT,
+  IR_ZEXT,
+  IR_TRUNC,
+  IR_SELECT,  // args[1] if args[0] is not zero, else args[2]
+  // no value
+  IR_STORE,  // store args[1] to address args[0]
+  IR_COPY,   // copy imm bytes from address args[1] to args[0]
+  IR_ZERO,   // zero imm bytes at address args[0]
+  // terminators
+  IR_BR,      // to succ[0] if args[0] is not zero, else succ[1]
+  IR_SWITCH,  // to succ[table[args[0]]], args[0] is below imm
+  IR_JMP,     // to succ[0]
+  IR_IJMP,    // to the address args[0], one of succ
+  IR_RET,
+};
+
+typedef struct inst* Inst;
+typedef struct block* Block;
+typedef struct func* Func;
+
+// An instruction is also the virtual register it defines, operands refer
+// to their defining instructions.
+struct inst {
+  int op;
+  int size;  // size of the value in bytes, 0 if there is none
+  int id;    // unique in the function
+  Inst* args;
+  int nargs;
+
+  unsigned long long imm;  // IR_IMM value, IR_PARAM index, IR_COPY and
+                           // IR_ZERO size, IR_SWITCH table length,
+                           // IR_CALL size of the struct returned
+  Node var;                // IR_ADDR: A_VAR, A_STRING_LITERAL or A_LABEL
+                           // IR_PHI: the variable it merges, if any
+                           // IR_PARAM: the struct parameter, if any
+  const char* name;        // IR_CALL: callee
+  int* arg_sizes;          // IR_CALL: size of the struct args[i] points to
+                           // if it's passed by value, else 0
+  int is_volatile;         // IR_LOAD, IR_STORE, IR_COPY, IR_ZERO: must not
+                           // be removed
+  int* table;              // IR_SWITCH: index in succ for each value
+
+  Block block;
+  Inst prev;
+  Inst next;
+};
+
+struct block {
+  int id;
+  Inst first;
+  Inst last;  // the terminator once the block is complete
+
+  Block* succ;
+  int nsucc;
+  Block* pred;
+  int npred;
+
+  Block next;  // in layout order
+
+  // set by compute_dominators
+  int rpo;  // index in reverse postorder, -1 if unreachable
+  Block idom;
+  Block dom_child;  // children in the dominator tree
+  Block dom_sibling;
+  int dom_pre, dom_post;  // order of a walk over the dominator tree
+};
+
+struct func {
+  Node node;  // A_FUNCTION
+  Block entry;
+  Block last;  // last block in layout order
+  int nblocks;
+  int ninsts;
+  Block* rpo;  // reachable blocks in reverse postorder
+  int nrpo;
+  int state;  // of optimize()
+  Func next;
+};
+
+extern Func funcs;
+
+Func new_func(Node n);
+Block new_block(Func f);
+void place_block(Func f, Block b);
+Inst new_inst(Func f, int op, int size, int nargs);
+void append_inst(Block b, Inst v);
+void insert_before(Inst pos, Inst v);
+void remove_inst(Inst v);
+void add_edge(Block from, Block to);
+void remove_edge(Block from, Block to);
+int pred_index(Block b, Block pred);
+int is_terminator(Inst v);
+int has_indirect_pred(Block b);
+void replace_values(Func f, Inst* map);
+void simplify_phis(Func f);
+void compute_rpo(Func f);
+void compute_dominators(Func f);
+int dominates(Block a, Block b);
+void remove_unreachable(Func f);
+void split_critical_edges(Func f);
+void dump_ir();
+void verify_ir(Func f);
+
+/*************
+ *    ssa    *
+ *************/
+void build_ssa(Func f);
+
+/*************
+ *    opt    *
+ *************/
+void optimize();
+
+/*************
+ *   lower   *
+ *************/
+void lower();
+
 /*********************
  *   code generate   *
  *********************/
@@ -0,0 +1,549 @@
+#include "inc.h"
+
+Func funcs;
+
+/******************************
+ *        construction        *
+ ******************************/
+
+Func new_func(Node n) {
+  Func f = calloc(1, sizeof(struct func));
+  f->node = n;
+  return f;
+}
+
+// A new block is placed in the layout by place_block, when its code starts.
+Block new_block(Func f) {
+  Block b = calloc(1, sizeof(struct block));
+  b->id = f->nblocks++;
+  return b;
+}
+
+void place_block(Func f, Block b) {
+  if (f->last)
+    f->last->next = b;
+  else
+    f->entry = b;
+  f->last = b;
+}
+
+Inst new_inst(Func f, int op, int size, int nargs) {
+  Inst v = calloc(1, sizeof(struct inst));
+  v->op = op;
+  v->size = size;
+  v->id = f->ninsts++;
+  v->nargs = nargs;
+  v->args = nargs ? calloc(nargs, sizeof(Inst)) : NULL;
+  return v;
+}
+
+void append_inst(Block b, Inst v) {
+  v->block = b;
+  v->prev = b->last;
+  if (b->last)
+    b->last->next = v;
+  else
+    b->first = v;
+  b->last = v;
+}
+
+void insert_before(Inst pos, Inst v) {
+  v->block = pos->block;
+  v->prev = pos->prev;
+  v->next = pos;
+  if (pos->prev)
+    pos->prev->next = v;
+  else
+    pos->block->first = v;
+  pos->prev = v;
+}
+
+void remove_inst(Inst v) {
+  Block b = v->block;
+  if (v->prev)
+    v->prev->next = v->next;
+  else
+    b->first = v->next;
+  if (v->next)
+    v->next->prev = v->prev;
+  else
+    b->last = v->prev;
+  v->block = NULL;
+  v->prev = v->next = NULL;
+}
+
+void add_edge(Block from, Block to) {
+  from->succ = realloc(from->succ, (from->nsucc + 1) * sizeof(Block));
+  from->succ[from->nsucc++] = to;
+  to->pred = realloc(to->pred, (to->npred + 1) * sizeof(Block));
+  to->pred[to->npred++] = from;
+}
+
+// first index of pred in the predecessors of b, -1 if it isn't one
+int pred_index(Block b, Block pred) {
+  for (int i = 0; i < b->npred; i++) {
+    if (b->pred[i] == pred)
+      return i;
+  }
+  return -1;
+}
+
+// Removes an edge, and the phi operands that flow along it. The caller
+// fixes the terminator of from.
+void remove_edge(Block from, Block to) {
+  int i = pred_index(to, from);
+  assert(i >= 0);
+  for (Inst v = to->first; v && v->op == IR_PHI; v = v->next) {
+    memmove(v->args + i, v->args + i + 1, (v->nargs - i - 1) * sizeof(Inst));
+    v->nargs--;
+  }
+  memmove(to->pred + i, to->pred + i + 1, (to->npred - i - 1) * sizeof(Block));
+  to->npred--;
+
+  for (i = 0; from->succ[i] != to; i++)
+    ;
+  memmove(from->succ + i, from->succ + i + 1,
+          (from->nsucc - i - 1) * sizeof(Block));
+  from->nsucc--;
+}
+
+int is_terminator(Inst v) {
+  return v->op == IR_BR || v->op == IR_SWITCH || v->op == IR_JMP ||
+         v->op == IR_IJMP || v->op == IR_RET;
+}
+
+// An indirect jump goes straight to the address, its edges can't be
+// redirected or given a block for phi moves.
+int has_indirect_pred(Block b) {
+  for (int i = 0; i < b->npred; i++) {
+    if (b->pred[i]->last && b->pred[i]->last->op == IR_IJMP)
+      return 1;
+  }
+  return 0;
+}
+
+/******************************
+ *       replace values       *
+ ******************************/
+
+static Inst resolve(Inst* map, Inst v) {
+  while (map[v->id])
+    v = map[v->id];
+  return v;
+}
+
+// Makes every use of a value v use map[v->id] instead, when it is set.
+// map has an entry for each instruction of f, replacements may chain.
+void replace_values(Func f, Inst* map) {
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      for (int i = 0; i < v->nargs; i++)
+        v->args[i] = resolve(map, v->args[i]);
+    }
+  }
+}
+
+// Removes the phis that merge a single value, apart from themselves.
+void simplify_phis(Func f) {
+  Inst* map = calloc(f->ninsts, sizeof(Inst));
+  int changed = 1;
+
+  while (changed) {
+    changed = 0;
+    for (Block b = f->entry; b; b = b->next) {
+      Inst next;
+      for (Inst v = b->first; v && v->op == IR_PHI; v = next) {
+        Inst same = NULL;
+        int i;
+        next = v->next;
+        for (i = 0; i < v->nargs; i++) {
+          Inst a = resolve(map, v->args[i]);
+          if (a == v || a == same)
+            continue;
+          if (same)
+            break;
+          same = a;
+        }
+        if (i < v->nargs || !same)
+          continue;
+        map[v->id] = same;
+        remove_inst(v);
+        changed = 1;
+      }
+    }
+  }
+
+  replace_values(f, map);
+  free(map);
+}
+
+/******************************
+ *          analysis          *
+ ******************************/
+
+void compute_rpo(Func f) {
+  Block* stack = malloc(f->nblocks * sizeof(Block));
+  int* next = calloc(f->nblocks, sizeof(int));  // successor to visit, by id
+  char* seen = calloc(f->nblocks, 1);
+  int n = 0;
+
+  f->rpo = realloc(f->rpo, f->nblocks * sizeof(Block));
+  f->nrpo = 0;
+  for (Block b = f->entry; b; b = b->next)
+    b->rpo = -1;
+
+  // depth first, blocks are added in postorder
+  stack[n++] = f->entry;
+  seen[f->entry->id] = 1;
+  while (n) {
+    Block b = stack[n - 1];
+    if (next[b->id] < b->nsucc) {
+      Block s = b->succ[next[b->id]++];
+      if (!seen[s->id]) {
+        seen[s->id] = 1;
+        stack[n++] = s;
+      }
+      continue;
+    }
+    f->rpo[f->nrpo++] = b;
+    n--;
+  }
+
+  for (int i = 0, j = f->nrpo - 1; i < j; i++, j--) {
+    Block t = f->rpo[i];
+    f->rpo[i] = f->rpo[j];
+    f->rpo[j] = t;
+  }
+  for (int i = 0; i < f->nrpo; i++)
+    f->rpo[i]->rpo = i;
+
+  free(stack);
+  free(next);
+  free(seen);
+}
+
+// The nearest common dominator of a and b, walking up from both. The
+// blocks passed while finding the idom of one block are stamped: they lie
+// below the idom found so far, so reaching one ends the walk at b. The
+// predecessors of the false target of a long && chain then take one step
+// each, not a walk back to the first operand.
+static Block intersect(Block a, Block b, int* stamp, int s) {
+  while (a != b) {
+    while (a->rpo > b->rpo) {
+      if (stamp[a->id] == s)
+        return b;
+      stamp[a->id] = s;
+      a = a->idom;
+    }
+    while (b->rpo > a->rpo) {
+      stamp[b->id] = s;
+      b = b->idom;
+    }
+  }
+  return a;
+}
+
+// Finds the immediate dominators of the reachable blocks, by iterating
+// over the blocks in reverse postorder until nothing changes (Cooper,
+// Harvey and Kennedy), then builds and numbers the dominator tree.
+void compute_dominators(Func f) {
+  compute_rpo(f);
+  for (Block b = f->entry; b; b = b->next) {
+    b->idom = b->dom_child = b->dom_sibling = NULL;
+    b->dom_pre = b->dom_post = -1;
+  }
+
+  Block entry = f->rpo[0];
+  int* stamp = calloc(f->nblocks, sizeof(int));
+  int changed = 1, s = 0;
+  entry->idom = entry;
+  while (changed) {
+    changed = 0;
+    for (int i = 1; i < f->nrpo; i++) {
+      Block b = f->rpo[i], idom = NULL;
+      s++;
+      for (int j = 0; j < b->npred; j++) {
+        Block p = b->pred[j];
+        if (!p->idom)  // not processed yet, or unreachable
+          continue;
+        idom = idom ? intersect(p, idom, stamp, s) : p;
+      }
+      if (b->idom != idom) {
+        b->idom = idom;
+        changed = 1;
+      }
+    }
+  }
+  entry->idom = NULL;
+  free(stamp);
+
+  // children in reverse postorder
+  for (int i = f->nrpo - 1; i > 0; i--) {
+    Block b = f->rpo[i];
+    b->dom_sibling = b->idom->dom_child;
+    b->idom->dom_child = b;
+  }
+
+  // a dominates b if b is visited during the visit of a
+  Block* stack = malloc(f->nrpo * sizeof(Block));
+  Block* child = malloc(f->nblocks * sizeof(Block));  // next to visit, by id
+  int n = 0, clock = 0;
+  entry->dom_pre = clock++;
+  child[entry->id] = entry->dom_child;
+  stack[n++] = entry;
+  while (n) {
+    Block b = stack[n - 1], c = child[b->id];
+    if (c) {
+      child[b->id] = c->dom_sibling;
+      c->dom_pre = clock++;
+      child[c->id] = c->dom_child;
+      stack[n++] = c;
+    } else {
+      b->dom_post = clock++;
+      n--;
+    }
+  }
+  free(stack);
+  free(child);
+}
+
+int dominates(Block a, Block b) {
+  return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+/******************************
+ *       transformations      *
+ ******************************/
+
+void remove_unreachable(Func f) {
+  compute_rpo(f);
+  for (Block b = f->entry; b; b = b->next) {
+    if (b->rpo < 0) {
+      while (b->nsucc)
+        remove_edge(b, b->succ[0]);
+    }
+  }
+
+  Block* link = &f->entry;
+  f->last = NULL;
+  for (Block b = f->entry; b; b = b->next) {
+    if (b->rpo < 0)
+      continue;
+    *link = f->last = b;
+    link = &b->next;
+  }
+  *link = NULL;
+}
+
+// Gives each edge into a block with phis, from a block with more than one
+// successor, a block of its own. The backend puts the moves for the phis
+// at the end of the predecessor, where they must not affect other paths.
+void split_critical_edges(Func f) {
+  for (Block b = f->entry; b; b = b->next) {
+    if (b->nsucc < 2)
+      continue;
+    Block after = b;
+    for (int i = 0; i < b->nsucc; i++) {
+      Block to = b->succ[i];
+      if (!to->first || to->first->op != IR_PHI)
+        continue;
+
+      Block mid = new_block(f);
+      append_inst(mid, new_inst(f, IR_JMP, 0, 0));
+      to->pred[pred_index(to, b)] = mid;
+      b->succ[i] = mid;
+      mid->pred = malloc(sizeof(Block));
+      mid->pred[mid->npred++] = b;
+      mid->succ = malloc(sizeof(Block));
+      mid->succ[mid->nsucc++] = to;
+
+      mid->next = after->next;
+      after->next = mid;
+      if (f->last == after)
+        f->last = mid;
+      after = mid;
+    }
+  }
+}
+
+/******************************
+ *            dump            *
+ ******************************/
+
+static const char* opname[] = {
+    [IR_IMM] = "imm",     [IR_ADDR] = "addr",   [IR_PARAM] = "param",
+    [IR_LOAD] = "load",   [IR_CALL] = "call",   [IR_PHI] = "phi",
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",     [IR_MUL] = "mul",     [IR_DIV] = "div",
+    [IR_UDIV] = "udiv",   [IR_MOD] = "mod",     [IR_UMOD] = "umod",
+    [IR_AND] = "and",     [IR_OR] = "or",       [IR_XOR] = "xor",
+    [IR_SHL] = "shl",     [IR_SAR] = "sar",     [IR_SHR] = "shr",
+    [IR_NEG] = "neg",     [IR_NOT] = "not",     [IR_EQ] = "eq",
+    [IR_NE] = "ne",       [IR_LT] = "lt",       [IR_LE] = "le",
+    [IR_GT] = "gt",       [IR_GE] = "ge",       [IR_ULT] = "ult",
+    [IR_ULE] = "ule",     [IR_UGT] = "ugt",     [IR_UGE] = "uge",
+    [IR_SEXT] = "sext",   [IR_ZEXT] = "zext",   [IR_TRUNC] = "trunc",
+    [IR_SELECT] = "select",
+    [IR_STORE] = "store", [IR_COPY] = "copy",   [IR_ZERO] = "zero",
+    [IR_BR] = "br",       [IR_SWITCH] = "switch", [IR_JMP] = "jmp",
+    [IR_IJMP] = "ijmp",   [IR_RET] = "ret",
+};
+
+static void dump_inst(Inst v) {
+  printf("  ");
+  if (v->size)
+    printf("%%%d = %s i%d", v->id, opname[v->op], v->size * 8);
+  else
+    printf("%s", opname[v->op]);
+
+  if (v->op == IR_IMM || v->op == IR_PARAM)
+    printf(" %lld", v->imm);
+  else if (v->op == IR_ADDR && v->var->kind == A_STRING_LITERAL)
+    printf(" \"%s\"", escape(v->var->string_value));
+  else if (v->op == IR_ADDR)
+    printf(" &%s", v->var->name);
+  else if (v->op == IR_CALL)
+    printf(" %s", v->name);
+
+  for (int i = 0; i < v->nargs; i++) {
+    if (v->op == IR_PHI)
+      printf("%s[%%%d, b%d]", i ? ", " : " ", v->args[i]->id,
+             v->block->pred[i]->id);
+    else
+      printf("%s%%%d", i ? ", " : " ", v->args[i]->id);
+  }
+
+  if (v->op == IR_COPY || v->op == IR_ZERO)
+    printf(", %lld", v->imm);
+  if (v->op == IR_SWITCH) {
+    for (unsigned long long k = 0; k < v->imm; k++)
+      printf(", b%d", v->block->succ[v->table[k]]->id);
+  } else if (is_terminator(v)) {
+    for (int i = 0; i < v->block->nsucc; i++)
+      printf("%sb%d", i || v->nargs ? ", " : " ", v->block->succ[i]->id);
+  }
+  printf("\n");
+}
+
+static void dump_func(Func f) {
+  printf("func %s\n", f->node->name);
+  for (Block b = f->entry; b; b = b->next) {
+    printf("b%d:", b->id);
+    for (int i = 0; i < b->npred; i++)
+      printf("%sb%d", i ? ", " : "  ; preds ", b->pred[i]->id);
+    printf("\n");
+    for (Inst v = b->first; v; v = v->next)
+      dump_inst(v);
+  }
+  printf("\n");
+}
+
+void dump_ir() {
+  for (Func f = funcs; f; f = f->next)
+    dump_func(f);
+}
+
+/******************************
+ *          verifier          *
+ ******************************/
+// Checks the invariants the passes and the backend rely on. A failure is a
+// bug in the compiler, not in the program.
+
+static void verify_error(Func f, Block b, const char* msg) {
+  error("invalid IR in %s, b%d: %s", f->node->name, b->id, msg);
+}
+
+static int has_block(Block* list, int n, Block b) {
+  for (int i = 0; i < n; i++) {
+    if (list[i] == b)
+      return 1;
+  }
+  return 0;
+}
+
+static int expected_succ(Inst v) {
+  if (v->op == IR_BR)
+    return 2;
+  if (v->op == IR_JMP)
+    return 1;
+  return 0;
+}
+
+// An operand must be defined before its use in the same block, or in a
+// block dominating it. The operands of a phi are used at the end of the
+// corresponding predecessors. Unreachable code is only checked locally.
+void verify_ir(Func f) {
+  // position of each instruction, to check that operands come first
+  int* order = calloc(f->ninsts, sizeof(int));
+  Block* placed = calloc(f->nblocks, sizeof(Block));
+  int n = 0;
+
+  compute_dominators(f);
+
+  for (Block b = f->entry; b; b = b->next) {
+    if (b->id >= f->nblocks || placed[b->id])
+      verify_error(f, b, "block placed twice");
+    placed[b->id] = b;
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->id >= f->ninsts || order[v->id])
+        verify_error(f, b, "instruction placed twice");
+      order[v->id] = ++n;
+    }
+  }
+
+  for (Block b = f->entry; b; b = b->next) {
+    if (!b->last || !is_terminator(b->last))
+      verify_error(f, b, "block without terminator");
+    if (b->last->op == IR_SWITCH) {
+      for (unsigned long long k = 0; k < b->last->imm; k++) {
+        if (b->last->table[k] < 0 || b->last->table[k] >= b->nsucc)
+          verify_error(f, b, "jump table entry without a successor");
+      }
+    } else if (b->last->op != IR_IJMP && b->nsucc != expected_succ(b->last))
+      verify_error(f, b, "successors don't match the terminator");
+
+    for (int i = 0; i < b->nsucc; i++) {
+      if (placed[b->succ[i]->id] != b->succ[i])
+        verify_error(f, b, "successor not in the function");
+      if (!has_block(b->succ[i]->pred, b->succ[i]->npred, b))
+        verify_error(f, b, "missing predecessor edge");
+    }
+    for (int i = 0; i < b->npred; i++) {
+      if (!has_block(b->pred[i]->succ, b->pred[i]->nsucc, b))
+        verify_error(f, b, "missing successor edge");
+    }
+
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->block != b)
+        verify_error(f, b, "instruction in the wrong block");
+      if (v != b->last && is_terminator(v))
+        verify_error(f, b, "terminator in the middle of a block");
+      if (v->op == IR_PHI && v->prev && v->prev->op != IR_PHI)
+        verify_error(f, b, "phi after other instructions");
+      if (v->op == IR_PHI && v->nargs != b->npred)
+        verify_error(f, b, "phi operands don't match the predecessors");
+      if (v->op == IR_PHI && has_indirect_pred(b))
+        verify_error(f, b, "phi in a block entered by an indirect jump");
+
+      for (int i = 0; i < v->nargs; i++) {
+        Inst a = v->args[i];
+        if (!a || !a->size)
+          verify_error(f, b, "operand without a value");
+        if (!a->block || a->block->id >= f->nblocks ||
+            placed[a->block->id] != a->block)
+          verify_error(f, b, "operand not in the function");
+
+        Block use = v->op == IR_PHI ? b->pred[i] : b;
+        if (v->op != IR_PHI && a->block == b) {
+          if (order[a->id] >= order[v->id])
+            verify_error(f, b, "operand used before it's defined");
+        } else if (use->rpo >= 0 && a->block != use &&
+                   !dominates(a->block, use))
+          verify_error(f, b, "operand doesn't dominate its use");
+      }
+    }
+  }
+
+  free(order);
+  free(placed);
+}
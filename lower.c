@@ -0,0 +1,1204 @@
+#include "inc.h"
+
+// Lowering turns the body of each function into IR. Variables stay in
+// memory: a read is a load from the variable's address and an assignment
+// is a store, so each virtual register is defined exactly once. The value
+// of a struct or union is its address.
+
+static Func fn;         // function being lowered
+static Block cur;       // block being filled
+static Inst ret_addr;   // where a struct returned in memory goes, or NULL
+
+/******************************
+ *         work stack         *
+ ******************************/
+// Expressions and statements are lowered from an explicit work stack
+// instead of recursion, so deeply nested or very long generated code can't
+// exhaust the C stack.
+//
+// A work item is a resumable generator. Each call runs one step: it emits
+// code, pushes the work for the subtrees it needs next and returns. It is
+// called again with the next step once that work is done, and finishes by
+// popping itself with done(). An expression leaves its value on the value
+// stack.
+typedef struct work* Work;
+struct work {
+  void (*gen)(Work w);
+  Node n;
+  int step;
+  Node cur;        // position in a statement list
+  Node temp;       // variable holding the value of a ternary
+  Inst dest;       // where a call returns a struct, NULL for a temporary
+  Block block[4];  // blocks kept across steps
+  int chained;     // operands of a condition jumping to its targets before
+  Work next;
+};
+static Work works;       // top of the work stack
+static Work free_works;  // finished work, reused by push()
+
+static Inst* values;  // value stack
+static int nvalues, values_cap;
+
+static void push(void (*gen)(Work), Node n) {
+  Work w = free_works;
+  if (w)
+    free_works = w->next;
+  else
+    w = malloc(sizeof(struct work));
+  w->gen = gen;
+  w->n = n;
+  w->step = 0;
+  w->cur = NULL;
+  w->temp = NULL;
+  w->dest = NULL;
+  w->chained = 0;
+  w->next = works;
+  works = w;
+}
+
+// continue as another generator, like a tail call
+static void become(Work w, void (*gen)(Work), Node n) {
+  w->gen = gen;
+  w->n = n;
+  w->step = 0;
+}
+
+static void done(Work w) {
+  assert(works == w);
+  works = w->next;
+  w->next = free_works;
+  free_works = w;
+}
+
+// lower n, and all the work it pushes
+static void run(void (*gen)(Work), Node n) {
+  Work base = works;
+  push(gen, n);
+  while (works != base)
+    works->gen(works);
+}
+
+static void push_value(Inst v) {
+  if (nvalues == values_cap) {
+    values_cap = values_cap ? values_cap * 2 : 64;
+    values = realloc(values, values_cap * sizeof(Inst));
+  }
+  values[nvalues++] = v;
+}
+
+static Inst pop_value() {
+  assert(nvalues > 0);
+  return values[--nvalues];
+}
+
+static void lower_expr(Work w);
+static void lower_cond(Work w);
+static void lower_stat(Work w);
+
+/******************************
+ *       emit instruction     *
+ ******************************/
+
+static int is_terminated(Block b) {
+  return b->last && is_terminator(b->last);
+}
+
+// start filling b, falling through from the current block
+static void start_block(Block b) {
+  if (cur && !is_terminated(cur)) {
+    append_inst(cur, new_inst(fn, IR_JMP, 0, 0));
+    add_edge(cur, b);
+  }
+  place_block(fn, b);
+  cur = b;
+}
+
+static Inst emit(int op, int size, int nargs) {
+  // code after a jump is unreachable, but still needs a block
+  if (is_terminated(cur))
+    start_block(new_block(fn));
+  Inst v = new_inst(fn, op, size, nargs);
+  append_inst(cur, v);
+  return v;
+}
+
+static Inst emit1(int op, int size, Inst a) {
+  Inst v = emit(op, size, 1);
+  v->args[0] = a;
+  return v;
+}
+
+static Inst emit2(int op, int size, Inst a, Inst b) {
+  Inst v = emit(op, size, 2);
+  v->args[0] = a;
+  v->args[1] = b;
+  return v;
+}
+
+static Inst emit_imm(int size, unsigned long long imm) {
+  Inst v = emit(IR_IMM, size, 0);
+  v->imm = imm;
+  return v;
+}
+
+static Inst emit_addr(Node var) {
+  Inst v = emit(IR_ADDR, 8, 0);
+  v->var = var;
+  return v;
+}
+
+static void emit_store(Inst addr, Inst value, Type ty) {
+  Inst v;
+  if (is_struct_or_union(ty)) {
+    v = emit2(IR_COPY, 0, addr, value);
+    v->imm = unqual(ty)->size;
+  } else
+    v = emit2(IR_STORE, 0, addr, value);
+  v->is_volatile = is_volatile(ty);
+}
+
+static void emit_jmp(Block to) {
+  emit(IR_JMP, 0, 0);
+  add_edge(cur, to);
+}
+
+static void emit_br(Inst cond, Block then, Block els) {
+  emit1(IR_BR, 0, cond);
+  add_edge(cur, then);
+  add_edge(cur, els);
+}
+
+// the value of an expression of type ty at address addr
+static Inst emit_load(Inst addr, Type ty) {
+  int volatile_access = is_volatile(ty);
+  ty = unqual(ty);
+
+  if (is_array(ty))  // for array, the address is it's value
+    return addr;
+  if (is_struct_or_union(ty))  // for struct, keep the address
+    return addr;
+  if (!is_scalar(ty))
+    error("load unknown type");
+  Inst v = emit1(IR_LOAD, ty->size, addr);
+  v->is_volatile = volatile_access;
+  return v;
+}
+
+static Node new_var(Type ty) {
+  char buf[32];
+  Node v = calloc(1, sizeof(struct node));
+  v->kind = A_VAR;
+  v->type = ty;
+  sprintf(buf, ".t%d", fn->ninsts);
+  v->name = string(buf);
+  v->next = fn->node->locals;
+  fn->node->locals = v;
+  return v;
+}
+
+// a variable holding a value across blocks
+static Node new_temp(int size) {
+  return new_var(size == 1   ? chartype
+                 : size == 2 ? shorttype
+                 : size == 4 ? inttype
+                             : longtype);
+}
+
+/******************************
+ *     lower expressions      *
+ ******************************/
+
+static void lower_addr(Work w) {
+  Node n = w->n;
+
+  if (n->kind == A_IDENT) {
+    w->n = n->ref;
+    return;
+  }
+
+  if (n->kind == A_VAR || n->kind == A_STRING_LITERAL) {
+    push_value(emit_addr(n));
+    done(w);
+    return;
+  }
+
+  if (n->kind == A_DEFERENCE) {
+    if (!is_ptr(n->left->type))
+      error("can only dereference pointer");
+
+    // the address is the pointer's value
+    become(w, lower_expr, n->left);
+    return;
+  }
+
+  if (n->kind == A_ARRAY_SUBSCRIPTING) {
+    if (w->step++ == 0) {
+      push(lower_expr, n->index);
+      if (is_array(n->array->type))
+        push(lower_addr, n->array);
+      else  // pointer
+        push(lower_expr, n->array);
+      return;
+    }
+
+    Inst index = pop_value();
+    Inst base = pop_value();
+    Inst size = emit_imm(8, n->array->type->base->size);
+    push_value(emit2(IR_ADD, 8, base, emit2(IR_MUL, 8, index, size)));
+    done(w);
+    return;
+  }
+
+  if (n->kind == A_MEMBER_SELECTION) {
+    if (w->step++ == 0) {
+      push(lower_addr, n->structure);
+      return;
+    }
+
+    Inst offset = emit_imm(8, n->member->offset);
+    push_value(emit2(IR_ADD, 8, pop_value(), offset));
+    done(w);
+    return;
+  }
+
+  // a struct returned by a call, assigned or chosen is its value
+  if (is_struct_or_union(n->type)) {
+    become(w, lower_expr, n);
+    return;
+  }
+
+  assert(0);  // lower address for unknown kind
+}
+
+static void lower_funccall(Work w) {
+  Node n = w->n;
+  Node node;
+
+  if (w->step++ == 0) {
+    // pushed first to last, so they are evaluated last to first
+    list_for_each(n->args, node) push(lower_expr, node->body);
+    return;
+  }
+
+  // a struct returned goes to a temporary unless told where, its address
+  // comes first
+  Type ty = unqual(n->type);
+  int is_struct = is_struct_or_union(ty);
+  Inst dest = NULL;
+  if (is_struct)
+    dest = w->dest ? w->dest : emit_addr(new_var(ty));
+  Inst v = emit(IR_CALL, ty == voidtype || is_struct ? 0 : ty->size,
+                list_length(n->args) + is_struct);
+  v->name = n->name;
+  if (is_struct) {
+    v->args[0] = dest;
+    v->imm = ty->size;
+  }
+  int i = is_struct;
+  list_for_each(n->args, node) {
+    Type arg_ty = unqual(node->body->type);
+    if (is_struct_or_union(arg_ty)) {
+      if (!v->arg_sizes)
+        v->arg_sizes = calloc(v->nargs, sizeof(int));
+      v->arg_sizes[i] = arg_ty->size;
+    }
+    v->args[i++] = pop_value();
+  }
+  push_value(is_struct ? dest : v->size ? v : NULL);
+  done(w);
+}
+
+// a call returning a struct
+static int is_struct_call(Node n) {
+  return n->kind == A_FUNC_CALL && is_struct_or_union(n->type);
+}
+
+static void lower_conversion(Work w) {
+  Node n = w->n;
+
+  if (w->step++ == 0) {
+    push(lower_expr, n->body);
+    return;
+  }
+
+  Inst v = pop_value();
+  int src_size = is_array(n->body->type) ? 8 : unqual(n->body->type)->size;
+  int dst_size = unqual(n->type)->size;
+  if (!dst_size)  // to void
+    v = NULL;
+  else if (src_size < dst_size)
+    v = emit1(is_signed(n->body->type) ? IR_SEXT : IR_ZEXT, dst_size, v);
+  else if (src_size > dst_size)
+    v = emit1(IR_TRUNC, dst_size, v);
+  push_value(v);
+  done(w);
+}
+
+// The budget left after the nodes evaluated by n, or -1 if they are more
+// or n may fault or have an effect. The walk stops once the budget runs
+// out, so it takes the same time however large n is.
+static int eval_budget(Node n, int budget) {
+  if (n->kind == A_IDENT)
+    n = n->ref;
+  if (--budget < 0)
+    return -1;
+  switch (n->kind) {
+    case A_NUM:
+    case A_ENUM_CONST:
+      return budget;
+    case A_VAR:
+      return is_volatile(n->type) ? -1 : budget;
+    case A_CONVERSION:
+      return eval_budget(n->body, budget);
+    case A_MINUS:
+    case A_PLUS:
+    case A_L_NOT:
+    case A_B_NOT:
+      return eval_budget(n->left, budget);
+    case A_ADD:
+    case A_SUB:
+    case A_MUL:
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+    case A_B_AND:
+    case A_B_INCLUSIVEOR:
+    case A_B_EXCLUSIVEOR:
+    case A_LEFT_SHIFT:
+    case A_RIGHT_SHIFT:
+    case A_L_AND:
+    case A_L_OR:
+      budget = eval_budget(n->left, budget);
+      return budget < 0 ? -1 : eval_budget(n->right, budget);
+  }
+  return -1;
+}
+
+// An expression of at most 4 nodes that can't fault or have an effect.
+// Such an expression may be evaluated when it isn't needed.
+static int is_cheap(Node n) {
+  return eval_budget(n, 4) >= 0;
+}
+
+#define MAX_FAN_IN 32  // operands of a chain jumping to the same target
+
+// Lowers n as a jump to t if it isn't zero, else to f. && and || jump to
+// the second operand or straight to a target, ! swaps the targets, so a
+// condition only evaluates what it needs and is never made a 0 or 1,
+// unless both operands are cheap enough to combine with a single branch.
+static void push_cond(Node n, Block t, Block f) {
+  push(lower_cond, n);
+  works->block[0] = t;
+  works->block[1] = f;
+}
+
+static void lower_cond(Work w) {
+  Node n = w->n;
+  Block t = w->block[0], f = w->block[1];
+
+  switch (n->kind) {
+    case A_IDENT:
+      w->n = n->ref;
+      return;
+    case A_L_AND:
+    case A_L_OR:
+      if (is_cheap(n->left) && is_cheap(n->right))
+        break;
+      // Every operand of a chain jumps to the same target. Past MAX_FAN_IN
+      // of them the rest is taken as a value, which starts a new chain, so
+      // no block gets more predecessors than that.
+      if (w->step++ == 0) {
+        w->block[2] = new_block(fn);
+        if (w->chained >= MAX_FAN_IN) {
+          push(lower_expr, n->left);
+          return;
+        }
+        if (n->kind == A_L_AND)
+          push_cond(n->left, w->block[2], f);
+        else
+          push_cond(n->left, t, w->block[2]);
+        works->chained = w->chained + 1;
+        return;
+      }
+      if (w->chained >= MAX_FAN_IN) {
+        if (n->kind == A_L_AND)
+          emit_br(pop_value(), w->block[2], f);
+        else
+          emit_br(pop_value(), t, w->block[2]);
+      }
+      start_block(w->block[2]);
+      become(w, lower_cond, n->right);
+      return;
+    case A_L_NOT:
+      w->block[0] = f;
+      w->block[1] = t;
+      become(w, lower_cond, n->left);
+      return;
+  }
+
+  if (w->step++ == 0) {
+    push(lower_expr, n);
+    return;
+  }
+  emit_br(pop_value(), t, f);
+  done(w);
+}
+
+// compares and their combinations are already 0 or 1
+static int is_bool(Inst v) {
+  if (v->op == IR_AND || v->op == IR_OR)
+    return is_bool(v->args[0]) && is_bool(v->args[1]);
+  return v->op >= IR_EQ && v->op <= IR_UGE;
+}
+
+static Inst emit_bool(Inst v) {
+  if (is_bool(v))
+    return v;
+  return emit2(IR_NE, 4, v, emit_imm(v->size, 0));
+}
+
+// && and || as a value, 1 from the true target and 0 from the false one.
+// When the right operand is cheap and safe to evaluate anyway, both are
+// set as 0 or 1 and combined, without a branch to mispredict.
+static void lower_logical(Work w) {
+  Node n = w->n;
+  Block* then = &w->block[0];
+  Block* els = &w->block[1];
+  Block* end = &w->block[2];
+
+  if (is_cheap(n->right)) {
+    if (w->step++ == 0) {
+      push(lower_expr, n->right);
+      push(lower_expr, n->left);
+      return;
+    }
+    Inst right = emit_bool(pop_value());
+    Inst left = emit_bool(pop_value());
+    push_value(emit2(n->kind == A_L_AND ? IR_AND : IR_OR, 4, left, right));
+    done(w);
+    return;
+  }
+
+  if (w->step++ == 0) {
+    *then = new_block(fn);
+    *els = new_block(fn);
+    *end = new_block(fn);
+    w->temp = new_temp(4);
+    push_cond(n, *then, *els);
+    return;
+  }
+
+  start_block(*then);
+  emit_store(emit_addr(w->temp), emit_imm(4, 1), w->temp->type);
+  emit_jmp(*end);
+  start_block(*els);
+  emit_store(emit_addr(w->temp), emit_imm(4, 0), w->temp->type);
+  start_block(*end);
+  push_value(emit_load(emit_addr(w->temp), w->temp->type));
+  done(w);
+}
+
+// The arms are lowered into their own blocks and meet in a third one. The
+// value is passed through a temporary variable.
+static void lower_ternary(Work w) {
+  Node n = w->n;
+  Block* then = &w->block[0];
+  Block* els = &w->block[1];
+  Block* end = &w->block[2];
+  Inst v;
+
+  switch (w->step++) {
+    case 0:
+      *then = new_block(fn);
+      *els = new_block(fn);
+      *end = new_block(fn);
+      push_cond(n->cond, *then, *els);
+      return;
+    case 1:
+      start_block(*then);
+      push(lower_expr, n->left);
+      return;
+    case 2:
+      // the arms have the same type, the left one decides the temporary
+      if ((v = pop_value())) {
+        w->temp = new_temp(v->size);
+        emit_store(emit_addr(w->temp), v, w->temp->type);
+      }
+      emit_jmp(*end);
+      start_block(*els);
+      push(lower_expr, n->right);
+      return;
+  }
+
+  v = pop_value();
+  if (v)
+    emit_store(emit_addr(w->temp), v, w->temp->type);
+  start_block(*end);
+  push_value(v ? emit_load(emit_addr(w->temp), w->temp->type) : NULL);
+  done(w);
+}
+
+static void lower_unary_arithmetic(Work w) {
+  Node n = w->n;
+
+  if (w->step++ == 0) {
+    push(lower_expr, n->left);
+    return;
+  }
+
+  Inst v = pop_value();
+  if (n->kind == A_B_NOT)
+    v = emit1(IR_NOT, n->type->size, v);
+  else if (n->kind == A_MINUS)
+    v = emit1(IR_NEG, n->type->size, v);
+  else if (n->kind == A_L_NOT)
+    v = emit2(IR_EQ, 4, v, emit_imm(v->size, 0));
+
+  push_value(v);
+  done(w);
+}
+
+static void lower_postfix_incdec(Work w) {
+  Node n = w->n;
+
+  if (w->step++ == 0) {
+    push(lower_addr, n->left);
+    return;
+  }
+
+  Inst addr = pop_value();
+  Inst old = emit_load(addr, n->left->type);
+  Inst step = emit_imm(n->type->size,
+                       is_arithmetic(n->type) ? 1 : n->type->base->size);
+  int op = n->kind == A_POSTFIX_INC ? IR_ADD : IR_SUB;
+  emit_store(addr, emit2(op, n->type->size, old, step), n->left->type);
+  push_value(old);
+  done(w);
+}
+
+// binary expr
+// The order of evaluation is unspecified
+// https://en.cppreference.com/w/cpp/language/eval_order
+static int binary_op(Node n) {
+  int is_unsigned = !is_signed(n->left->type);
+  switch (n->kind) {
+    case A_ADD:
+      return IR_ADD;
+    case A_SUB:
+      return IR_SUB;
+    case A_MUL:
+      return IR_MUL;
+    case A_DIV:
+      return is_signed(n->type) ? IR_DIV : IR_UDIV;
+    case A_MOD:
+      return is_signed(n->type) ? IR_MOD : IR_UMOD;
+    case A_EQ:
+      return IR_EQ;
+    case A_NE:
+      return IR_NE;
+    case A_LT:
+      return is_unsigned ? IR_ULT : IR_LT;
+    case A_LE:
+      return is_unsigned ? IR_ULE : IR_LE;
+    case A_GT:
+      return is_unsigned ? IR_UGT : IR_GT;
+    case A_GE:
+      return is_unsigned ? IR_UGE : IR_GE;
+    case A_B_AND:
+      return IR_AND;
+    case A_B_INCLUSIVEOR:
+      return IR_OR;
+    case A_B_EXCLUSIVEOR:
+      return IR_XOR;
+    case A_LEFT_SHIFT:
+      return IR_SHL;
+    case A_RIGHT_SHIFT:
+      return is_unsigned ? IR_SHR : IR_SAR;
+  }
+  assert(0);  // unknown ast node
+}
+
+static void lower_binary(Work w) {
+  Node n = w->n;
+
+  if (w->step++ == 0) {
+    push(lower_expr, n->right);
+    push(lower_expr, n->left);
+    return;
+  }
+
+  Inst right = pop_value();
+  Inst left = pop_value();
+  int op = binary_op(n);
+  int is_compare = op >= IR_EQ && op <= IR_UGE;
+  // a null pointer constant is an int compared with a pointer
+  if (is_compare && left->size < right->size)
+    left = emit1(IR_SEXT, right->size, left);
+  if (is_compare && right->size < left->size)
+    right = emit1(IR_SEXT, left->size, right);
+  push_value(emit2(op, is_compare ? 4 : n->type->size, left, right));
+  done(w);
+}
+
+static void lower_expr(Work w) {
+  Node n = w->n;
+  Inst v;
+
+  switch (n->kind) {
+    case A_NOOP:
+      push_value(NULL);
+      break;
+    case A_IDENT:
+      w->n = n->ref;
+      return;
+    case A_NUM:
+    case A_ENUM_CONST:
+      // TODO: to hold a unsigned int , maybe use long type for n->intvalue?
+      assert(is_integer(n->type));
+      push_value(emit_imm(n->type->size, n->intvalue));
+      break;
+    case A_STRING_LITERAL:
+      become(w, lower_addr, n);
+      return;
+    case A_LABEL_ADDRESS:
+      push_value(emit_addr(n->ref));
+      break;
+    case A_VAR:
+    case A_ARRAY_SUBSCRIPTING:
+    case A_MEMBER_SELECTION:
+      if (w->step++ == 0) {
+        push(lower_addr, n);
+        return;
+      }
+      push_value(emit_load(pop_value(), n->type));
+      break;
+    case A_DEFERENCE:
+      if (w->step++ == 0) {
+        push(lower_expr, n->left);
+        return;
+      }
+      push_value(emit_load(pop_value(), deref_type(n->left->type)));
+      break;
+    case A_ADDRESS_OF:
+      become(w, lower_addr, n->left);
+      return;
+    case A_INIT:
+      // the struct a call returns is returned right into a new variable,
+      // which nothing can refer to before
+      if (is_struct_call(n->right)) {
+        Inst dest = emit_addr(n->left);
+        become(w, lower_funccall, n->right);
+        w->dest = dest;
+        return;
+      }
+      // fallthrough
+    case A_ASSIGN:
+      if (w->step++ == 0) {
+        push(lower_expr, n->right);
+        push(lower_addr, n->left);
+        return;
+      }
+      if (is_array(unqual(n->left->type)))
+        error("assignment to expression with array type");
+      v = pop_value();
+      emit_store(pop_value(), v, n->left->type);
+      push_value(v);
+      break;
+    case A_FUNC_CALL:
+      become(w, lower_funccall, n);
+      return;
+    case A_CONVERSION:
+      become(w, lower_conversion, n);
+      return;
+    case A_TERNARY:
+      become(w, lower_ternary, n);
+      return;
+    case A_L_AND:
+    case A_L_OR:
+      become(w, lower_logical, n);
+      return;
+    case A_COMMA:
+      if (w->step++ == 0) {
+        push(lower_expr, n->left);
+        return;
+      }
+      pop_value();
+      become(w, lower_expr, n->right);
+      return;
+    case A_MINUS:
+    case A_PLUS:
+    case A_L_NOT:
+    case A_B_NOT:
+      become(w, lower_unary_arithmetic, n);
+      return;
+    case A_POSTFIX_INC:
+    case A_POSTFIX_DEC:
+      become(w, lower_postfix_incdec, n);
+      return;
+    default:
+      become(w, lower_binary, n);
+      return;
+  }
+  done(w);
+}
+
+/******************************
+ *      lower statements      *
+ ******************************/
+// jump targets for iteration statements (for, while, do-while)
+typedef struct jumploc* JumpLoc;
+struct jumploc {
+  Block lcontinue;
+  Block lbreak;
+  JumpLoc next;
+};
+static JumpLoc iterjumploc;
+
+static void iter_enter(Block lcontinue, Block lbreak) {
+  JumpLoc j = malloc(sizeof(struct jumploc));
+  j->lbreak = lbreak;
+  j->lcontinue = lcontinue;
+  j->next = iterjumploc;
+  iterjumploc = j;
+}
+
+static void iter_exit() {
+  JumpLoc j = iterjumploc;
+  iterjumploc = j->next;
+  free(j);
+}
+
+static void lower_if(Work w) {
+  Node n = w->n;
+  Block* then = &w->block[0];
+  Block* els = &w->block[1];
+  Block* end = &w->block[2];
+
+  switch (w->step++) {
+    case 0:
+      *then = new_block(fn);
+      *end = new_block(fn);
+      *els = n->els ? new_block(fn) : *end;
+
+      // condition
+      push_cond(n->cond, *then, *els);
+      return;
+    case 1:
+      // true statement
+      start_block(*then);
+      push(lower_stat, n->then);
+      return;
+    case 2:
+      // false statement
+      if (n->els) {
+        emit_jmp(*end);
+        start_block(*els);
+        push(lower_stat, n->els);
+        return;
+      }
+  }
+
+  start_block(*end);
+  done(w);
+}
+
+// A switch compares its value with the sorted case values. A run of them
+// is split in halves by a compare, until it's short enough to test each
+// case in turn, or dense enough for a table of labels indexed by the
+// value, which takes a single bounds check.
+#define MAX_CHAIN 3     // cases tested one by one
+#define MIN_DENSITY 40  // percentage of a jump table's entries that are cases
+
+static int signed_cases;  // order of the case values being sorted
+
+static int by_case_value(const void* a, const void* b) {
+  Node m = *(Node*)a, n = *(Node*)b;
+  unsigned long long x = m->intvalue, y = n->intvalue;
+  if (x != y && signed_cases)
+    return (long long)x < (long long)y ? -1 : 1;
+  if (x != y)
+    return x < y ? -1 : 1;
+  // a duplicate is reported after the first one
+  if (m->token->line_no != n->token->line_no)
+    return m->token->line_no - n->token->line_no;
+  return m->token->char_no - n->token->char_no;
+}
+
+static void emit_table(Inst x, Node* cases, int n, Block deflt) {
+  unsigned long long lo = cases[0]->intvalue, hi = cases[n - 1]->intvalue;
+  Block in = new_block(fn);
+  Inst index = lo ? emit2(IR_SUB, x->size, x, emit_imm(x->size, lo)) : x;
+  emit_br(emit2(IR_ULE, 4, index, emit_imm(x->size, hi - lo)), in, deflt);
+  start_block(in);
+  if (index->size < 8)
+    index = emit1(IR_ZEXT, 8, index);
+
+  // the labels are distinct blocks, the default comes first if the values
+  // have holes
+  Inst v = emit1(IR_SWITCH, 0, index);
+  v->imm = hi - lo + 1;
+  v->table = malloc(v->imm * sizeof(int));
+  int holes = v->imm != (unsigned long long)n;
+  if (holes)
+    add_edge(cur, deflt);
+  for (int i = 0; i < n; i++)
+    add_edge(cur, cases[i]->block);
+  int i = 0;
+  for (unsigned long long k = 0; k < v->imm; k++) {
+    if (cases[i]->intvalue - lo == k)
+      v->table[k] = holes + i++;
+    else
+      v->table[k] = 0;
+  }
+}
+
+// jumps to the label of the case x matches in cases[0..n), or to deflt
+static void emit_dispatch(Inst x, Node* cases, int n, Block deflt) {
+  unsigned long long lo = cases[0]->intvalue, hi = cases[n - 1]->intvalue;
+
+  if (n <= MAX_CHAIN) {
+    for (int i = 0; i < n; i++) {
+      Block next = new_block(fn);
+      Inst eq = emit2(IR_EQ, 4, x, emit_imm(x->size, cases[i]->intvalue));
+      emit_br(eq, cases[i]->block, next);
+      start_block(next);
+    }
+    emit_jmp(deflt);
+    return;
+  }
+  if (hi - lo < n * 100ULL / MIN_DENSITY) {
+    emit_table(x, cases, n, deflt);
+    return;
+  }
+
+  int mid = n / 2;
+  Block left = new_block(fn);
+  Block right = new_block(fn);
+  Inst pivot = emit_imm(x->size, cases[mid]->intvalue);
+  emit_br(emit2(signed_cases ? IR_LT : IR_ULT, 4, x, pivot), left, right);
+  start_block(left);
+  emit_dispatch(x, cases, mid, deflt);
+  start_block(right);
+  emit_dispatch(x, cases + mid, n - mid, deflt);
+}
+
+// gives each label of the switch its block, and jumps to one of them
+static void emit_switch(Node n, Inst x, Block end) {
+  Block deflt = end;
+  int ncases = 0;
+  for (Node c = n->cases; c; c = c->cases) {
+    c->block = new_block(fn);
+    if (c->kind == A_DEFAULT)
+      deflt = c->block;
+    else
+      ncases++;
+  }
+  if (!ncases) {
+    emit_jmp(deflt);
+    return;
+  }
+
+  Node* cases = malloc(ncases * sizeof(Node));
+  int k = 0;
+  for (Node c = n->cases; c; c = c->cases) {
+    if (c->kind == A_CASE)
+      cases[k++] = c;
+  }
+  signed_cases = is_signed(n->cond->type);
+  qsort(cases, ncases, sizeof(Node), by_case_value);
+  for (int i = 1; i < ncases; i++) {
+    if (cases[i]->intvalue == cases[i - 1]->intvalue) {
+      infoat(cases[i - 1]->token, "previous:");
+      errorat(cases[i]->token, "duplicate case value");
+    }
+  }
+  emit_dispatch(x, cases, ncases, deflt);
+  free(cases);
+}
+
+static void lower_switch(Work w) {
+  Node n = w->n;
+  Block* end = &w->block[0];
+
+  switch (w->step++) {
+    case 0:
+      push(lower_expr, n->cond);
+      return;
+    case 1:
+      *end = new_block(fn);
+      emit_switch(n, pop_value(), *end);
+
+      // break leaves the switch, continue the loop around it
+      iter_enter(iterjumploc ? iterjumploc->lcontinue : NULL, *end);
+      if (n->body)
+        push(lower_stat, n->body);
+      return;
+  }
+
+  iter_exit();
+  start_block(*end);
+  done(w);
+}
+
+static void lower_dowhile(Work w) {
+  Node n = w->n;
+  Block* body = &w->block[0];
+  Block* cond = &w->block[1];
+  Block* end = &w->block[2];
+
+  switch (w->step++) {
+    case 0:
+      *body = new_block(fn);
+      *cond = new_block(fn);
+      *end = new_block(fn);
+
+      // statement
+      iter_enter(*cond, *end);
+      start_block(*body);
+      push(lower_stat, n->body);
+      return;
+    case 1:
+      // condition
+      start_block(*cond);
+      push_cond(n->cond, *body, *end);
+      return;
+  }
+
+  iter_exit();
+  start_block(*end);
+  done(w);
+}
+
+static void lower_for(Work w) {
+  Node n = w->n;
+  Block* cond = &w->block[0];
+  Block* body = &w->block[1];
+  Block* post = &w->block[2];
+  Block* end = &w->block[3];
+
+  switch (w->step++) {
+    case 0:
+      *cond = new_block(fn);
+      *body = new_block(fn);
+      *post = n->post ? new_block(fn) : *cond;
+      *end = new_block(fn);
+
+      // init
+      if (n->init) {
+        push(lower_stat, n->init);
+      }
+      return;
+    case 1:
+      // condition
+      start_block(*cond);
+      if (n->cond) {
+        push_cond(n->cond, *body, *end);
+      }
+      return;
+    case 2:
+      // stat
+      iter_enter(*post, *end);
+      start_block(*body);
+      push(lower_stat, n->body);
+      return;
+    case 3:
+      iter_exit();
+
+      // post_expr
+      if (n->post) {
+        start_block(*post);
+        push(lower_stat, n->post);
+        return;
+      }
+  }
+
+  emit_jmp(*cond);
+  start_block(*end);
+  done(w);
+}
+
+// a label's block is made by the first goto or label reaching it
+static Block label_block(Node label) {
+  if (!label->block)
+    label->block = new_block(fn);
+  return label->block;
+}
+
+// A computed goto may go to any label whose address is taken.
+static void lower_goto(Work w) {
+  Node n = w->n;
+
+  if (!n->body) {
+    emit_jmp(label_block(n->ref));
+    done(w);
+    return;
+  }
+  if (w->step++ == 0) {
+    push(lower_expr, n->body);
+    return;
+  }
+  emit1(IR_IJMP, 0, pop_value());
+  for (Node l = fn->node->labels; l; l = l->label_next) {
+    if (l->address_taken)
+      add_edge(cur, label_block(l));
+  }
+  done(w);
+}
+
+static void lower_return(Work w) {
+  Node n = w->n;
+
+  if (w->step++ == 0 && n->body) {
+    if (fn->node->type->base == voidtype)
+      warn("return with a value, in function returning void");
+    push(lower_expr, n->body);
+    // our caller's place for the struct is passed on
+    if (ret_addr && is_struct_call(n->body))
+      works->dest = ret_addr;
+    return;
+  }
+
+  Inst v = n->body ? pop_value() : NULL;
+  if (v && ret_addr) {
+    if (v != ret_addr)
+      emit_store(ret_addr, v, fn->node->type->base);
+    emit1(IR_RET, 0, ret_addr);
+  } else if (v)
+    emit1(IR_RET, 0, v);
+  else
+    emit(IR_RET, 0, 0);
+  done(w);
+}
+
+static void lower_stat(Work w) {
+  Node n = w->n;
+  Inst v;
+
+  switch (n->kind) {
+    case A_BLOCK:
+      // one statement per step
+      w->cur = w->step++ ? w->cur->next : n->body;
+      if (w->cur) {
+        push(lower_stat, w->cur);
+        return;
+      }
+      break;
+    case A_IF:
+      become(w, lower_if, n);
+      return;
+    case A_SWITCH:
+      become(w, lower_switch, n);
+      return;
+    case A_CASE:
+    case A_DEFAULT:
+    case A_LABEL:
+      if (w->step++ == 0) {
+        start_block(n->kind == A_LABEL ? label_block(n) : n->block);
+        if (n->body) {
+          push(lower_stat, n->body);
+          return;
+        }
+      }
+      break;
+    case A_FOR:
+      become(w, lower_for, n);
+      return;
+    case A_DOWHILE:
+      become(w, lower_dowhile, n);
+      return;
+    case A_GOTO:
+      become(w, lower_goto, n);
+      return;
+    case A_BREAK:
+      emit_jmp(iterjumploc->lbreak);
+      break;
+    case A_CONTINUE:
+      emit_jmp(iterjumploc->lcontinue);
+      break;
+    case A_RETURN:
+      become(w, lower_return, n);
+      return;
+    case A_ZERO_INIT:
+      v = emit1(IR_ZERO, 0, emit_addr(n->body));
+      v->imm = unqual(n->body->type)->size;
+      v->is_volatile = is_volatile(n->body->type);
+      break;
+    case A_EXPR_STAT:
+      if (w->step++ == 0) {
+        push(lower_expr, n->body);
+        return;
+      }
+      pop_value();
+      break;
+    default:
+      if (w->step++ == 0) {
+        push(lower_expr, n);
+        return;
+      }
+      pop_value();
+      break;
+  }
+  done(w);
+}
+
+/******************************
+ *       lower function       *
+ ******************************/
+
+static Func lower_func(Node n) {
+  fn = new_func(n);
+  cur = NULL;
+  start_block(new_block(fn));
+
+  // The first argument of a function returning a struct is where it's
+  // returned to, passed only for one returned in memory. The backend stores
+  // a struct passed by value to its variable, as it's passed in registers
+  // or on the stack.
+  ret_addr = NULL;
+  if (is_memory_class(n->type->base)) {
+    ret_addr = emit(IR_PARAM, 8, 0);
+    ret_addr->imm = 0;
+  }
+  int i = is_struct_or_union(n->type->base);
+  Node node;
+  list_for_each(n->params, node) {
+    Node v = node->body;
+    if (is_struct_or_union(v->type)) {
+      Inst arg = emit(IR_PARAM, 0, 0);
+      arg->imm = i++;
+      arg->var = v;
+      continue;
+    }
+    Inst arg = emit(IR_PARAM, unqual(v->type)->size, 0);
+    arg->imm = i++;
+    emit2(IR_STORE, 0, emit_addr(v), arg);
+  }
+
+  // Function body
+  run(lower_stat, n->body);
+  assert(nvalues == 0);
+
+  // reaching the end of main returns 0
+  if (!is_terminated(cur)) {
+    if (n->name == string("main"))
+      emit1(IR_RET, 0, emit_imm(4, 0));
+    else
+      emit(IR_RET, 0, 0);
+  }
+
+  verify_ir(fn);
+  return fn;
+}
+
+void lower() {
+  Func* last = &funcs;
+  for (Node n = globals; n; n = n->next) {
+    if (n->kind != A_FUNCTION || !n->body)
+      continue;
+    *last = lower_func(n);
+    last = &(*last)->next;
+  }
+}
@@ -4,6 +4,10 @@ int main(int argc, char* argv[]) {
   parse_arguments(argc, argv);
   tokenize();
   parse();
+  lower();
+  optimize();
+  if (options.dump_ir)
+    dump_ir();
   codegen();
   return 0;
 }
\ No newline at end of file
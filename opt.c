@@ -0,0 +1,2024 @@
+#include "inc.h"
+
+// instructions using each value: uses[use_start[id]] to
+// uses[use_start[id + 1]]
+static Inst* uses;
+static int* use_start;
+
+static void compute_uses(Func f) {
+  use_start = realloc(use_start, (f->ninsts + 1) * sizeof(int));
+  memset(use_start, 0, (f->ninsts + 1) * sizeof(int));
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      for (int i = 0; i < v->nargs; i++)
+        use_start[v->args[i]->id + 1]++;
+    }
+  }
+  for (int i = 0; i < f->ninsts; i++)
+    use_start[i + 1] += use_start[i];
+
+  int* fill = malloc(f->ninsts * sizeof(int));
+  memcpy(fill, use_start, f->ninsts * sizeof(int));
+  uses = realloc(uses, use_start[f->ninsts] * sizeof(Inst));
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      for (int i = 0; i < v->nargs; i++)
+        uses[fill[v->args[i]->id]++] = v;
+    }
+  }
+  free(fill);
+}
+
+/******************************
+ *    constant propagation    *
+ ******************************/
+// Sparse conditional constant propagation (Wegman and Zadeck). Each value
+// starts unknown and may only go down to a constant, then to varying. A
+// block is only looked at once an edge into it is found executable, so
+// the values on a path never taken don't spoil the phis, and a branch on
+// a constant only makes one of its edges executable.
+
+enum { UNKNOWN, CONSTANT, VARYING };
+
+static char* state;              // by id
+static unsigned long long* val;  // by id, the constant
+static char* reached;            // by block id
+static char** edge_reached;      // by block id and predecessor index
+
+static Inst* ssa_work;
+static int nssa_work, ssa_work_cap;
+static Block* edge_work;  // pairs of block and predecessor index
+static int* edge_work_index;
+static int nedge_work, edge_work_cap;
+
+static unsigned long long truncate_to(unsigned long long x, int size) {
+  return size == 8 ? x : x & ((1ULL << (size * 8)) - 1);
+}
+
+static long long sign_extend(unsigned long long x, int size) {
+  unsigned long long sign = 1ULL << (size * 8 - 1);
+  return (truncate_to(x, size) ^ sign) - sign;
+}
+
+// Evaluates v on constant operands. Division by zero or overflowing is
+// left for run time.
+static int fold(Inst v, unsigned long long* res) {
+  int size = v->nargs ? v->args[0]->size : v->size;
+  unsigned long long a = val[v->args[0]->id];
+  unsigned long long b = v->nargs > 1 ? val[v->args[1]->id] : 0;
+  long long sa = sign_extend(a, size), sb = sign_extend(b, size);
+  int shift = b & (size == 8 ? 63 : 31);
+  unsigned long long r;
+
+  switch (v->op) {
+    case IR_ADD:
+      r = a + b;
+      break;
+    case IR_SUB:
+      r = a - b;
+      break;
+    case IR_MUL:
+      r = a * b;
+      break;
+    case IR_DIV:
+    case IR_MOD:
+      if (sb == 0 || (sb == -1 && sa == sign_extend(1ULL << (size * 8 - 1),
+                                                    size)))
+        return 0;
+      r = v->op == IR_DIV ? sa / sb : sa % sb;
+      break;
+    case IR_UDIV:
+    case IR_UMOD:
+      if (b == 0)
+        return 0;
+      r = v->op == IR_UDIV ? a / b : a % b;
+      break;
+    case IR_AND:
+      r = a & b;
+      break;
+    case IR_OR:
+      r = a | b;
+      break;
+    case IR_XOR:
+      r = a ^ b;
+      break;
+    case IR_SHL:
+      r = a << shift;
+      break;
+    case IR_SAR:
+      r = sa >> shift;
+      break;
+    case IR_SHR:
+      r = a >> shift;
+      break;
+    case IR_NEG:
+      r = -a;
+      break;
+    case IR_NOT:
+      r = ~a;
+      break;
+    case IR_EQ:
+      r = a == b;
+      break;
+    case IR_NE:
+      r = a != b;
+      break;
+    case IR_LT:
+      r = sa < sb;
+      break;
+    case IR_LE:
+      r = sa <= sb;
+      break;
+    case IR_GT:
+      r = sa > sb;
+      break;
+    case IR_GE:
+      r = sa >= sb;
+      break;
+    case IR_ULT:
+      r = a < b;
+      break;
+    case IR_ULE:
+      r = a <= b;
+      break;
+    case IR_UGT:
+      r = a > b;
+      break;
+    case IR_UGE:
+      r = a >= b;
+      break;
+    case IR_SEXT:
+      r = sa;
+      break;
+    case IR_ZEXT:
+    case IR_TRUNC:
+      r = a;
+      break;
+    default:
+      return 0;
+  }
+  *res = truncate_to(r, v->size);
+  return 1;
+}
+
+static void reach_edge(Block b, int i) {
+  Block s = b->succ[i];
+  for (int j = 0; j < s->npred; j++) {
+    if (s->pred[j] != b || edge_reached[s->id][j])
+      continue;
+    if (nedge_work == edge_work_cap) {
+      edge_work_cap = edge_work_cap ? edge_work_cap * 2 : 64;
+      edge_work = realloc(edge_work, edge_work_cap * sizeof(Block));
+      edge_work_index =
+          realloc(edge_work_index, edge_work_cap * sizeof(int));
+    }
+    edge_work[nedge_work] = s;
+    edge_work_index[nedge_work++] = j;
+  }
+}
+
+static void set_state(Inst v, int s, unsigned long long c) {
+  if (state[v->id] == s && (s != CONSTANT || val[v->id] == c))
+    return;
+  state[v->id] = s;
+  val[v->id] = c;
+  if (nssa_work == ssa_work_cap) {
+    ssa_work_cap = ssa_work_cap ? ssa_work_cap * 2 : 64;
+    ssa_work = realloc(ssa_work, ssa_work_cap * sizeof(Inst));
+  }
+  ssa_work[nssa_work++] = v;
+}
+
+static void visit_phi(Inst v) {
+  int s = UNKNOWN;
+  unsigned long long c = 0;
+  for (int i = 0; i < v->nargs && s != VARYING; i++) {
+    Inst a = v->args[i];
+    if (!edge_reached[v->block->id][i] || state[a->id] == UNKNOWN)
+      continue;
+    if (state[a->id] == VARYING || (s == CONSTANT && val[a->id] != c))
+      s = VARYING;
+    else {
+      s = CONSTANT;
+      c = val[a->id];
+    }
+  }
+  set_state(v, s, c);
+}
+
+static void visit(Inst v) {
+  Block b = v->block;
+
+  if (v->op == IR_BR) {
+    Inst cond = v->args[0];
+    if (state[cond->id] == VARYING) {
+      reach_edge(b, 0);
+      reach_edge(b, 1);
+    } else if (state[cond->id] == CONSTANT)
+      reach_edge(b, val[cond->id] ? 0 : 1);
+    return;
+  }
+  if (v->op == IR_JMP) {
+    reach_edge(b, 0);
+    return;
+  }
+  // the bounds check before a switch is folded instead
+  if (v->op == IR_SWITCH || v->op == IR_IJMP) {
+    for (int i = 0; i < b->nsucc; i++)
+      reach_edge(b, i);
+    return;
+  }
+  if (!v->size)
+    return;
+
+  if (v->op == IR_IMM) {
+    set_state(v, CONSTANT, truncate_to(v->imm, v->size));
+    return;
+  }
+  if (v->op == IR_PHI) {
+    visit_phi(v);
+    return;
+  }
+  if (v->op < IR_ADD || v->op > IR_TRUNC) {  // loads, calls and the like
+    set_state(v, VARYING, 0);
+    return;
+  }
+
+  unsigned long long c;
+  for (int i = 0; i < v->nargs; i++) {
+    if (state[v->args[i]->id] == VARYING) {
+      set_state(v, VARYING, 0);
+      return;
+    }
+    if (state[v->args[i]->id] == UNKNOWN)
+      return;
+  }
+  if (fold(v, &c))
+    set_state(v, CONSTANT, c);
+  else
+    set_state(v, VARYING, 0);
+}
+
+static void propagate(Func f) {
+  state = calloc(f->ninsts, 1);
+  val = calloc(f->ninsts, sizeof(unsigned long long));
+  reached = calloc(f->nblocks, 1);
+  edge_reached = calloc(f->nblocks, sizeof(char*));
+  for (Block b = f->entry; b; b = b->next)
+    edge_reached[b->id] = calloc(b->npred, 1);
+
+  reached[f->entry->id] = 1;
+  for (Inst v = f->entry->first; v; v = v->next)
+    visit(v);
+
+  while (nedge_work || nssa_work) {
+    if (nedge_work) {
+      Block b = edge_work[--nedge_work];
+      int i = edge_work_index[nedge_work];
+      if (edge_reached[b->id][i])
+        continue;
+      edge_reached[b->id][i] = 1;
+      if (reached[b->id]) {  // only the phis see the new edge
+        for (Inst v = b->first; v->op == IR_PHI; v = v->next)
+          visit_phi(v);
+        continue;
+      }
+      reached[b->id] = 1;
+      for (Inst v = b->first; v; v = v->next)
+        visit(v);
+      continue;
+    }
+
+    Inst v = ssa_work[--nssa_work];
+    for (int i = use_start[v->id]; i < use_start[v->id + 1]; i++) {
+      if (reached[uses[i]->block->id])
+        visit(uses[i]);
+    }
+  }
+}
+
+// Branches with a single executable edge become jumps, blocks never
+// reached are removed, and constant values become immediates.
+static void rewrite(Func f) {
+  // decide first, removing edges shifts the predecessor indices
+  Block* dead_edge = calloc(f->nblocks, sizeof(Block));
+  for (Block b = f->entry; b; b = b->next) {
+    if (!reached[b->id] || b->last->op != IR_BR)
+      continue;
+    int n = 0;
+    for (int i = 0; i < 2; i++) {
+      Block s = b->succ[i];
+      if (edge_reached[s->id][pred_index(s, b)])
+        n++;
+      else
+        dead_edge[b->id] = s;
+    }
+    if (n != 1)
+      dead_edge[b->id] = NULL;
+  }
+  for (Block b = f->entry; b; b = b->next) {
+    if (!dead_edge[b->id])
+      continue;
+    remove_edge(b, dead_edge[b->id]);
+    b->last->op = IR_JMP;
+    b->last->nargs = 0;
+  }
+  free(dead_edge);
+
+  for (Block b = f->entry; b; b = b->next) {
+    if (!reached[b->id]) {
+      while (b->nsucc)
+        remove_edge(b, b->succ[0]);
+    }
+  }
+  Block* link = &f->entry;
+  f->last = NULL;
+  for (Block b = f->entry; b; b = b->next) {
+    if (!reached[b->id])
+      continue;
+    *link = f->last = b;
+    link = &b->next;
+  }
+  *link = NULL;
+
+  // a constant phi is replaced by an immediate after the phis
+  int ninsts = f->ninsts;
+  Inst* consts = calloc(ninsts, sizeof(Inst));
+  for (Block b = f->entry; b; b = b->next) {
+    Inst next;
+    for (Inst v = b->first; v; v = next) {
+      next = v->next;
+      if (v->op == IR_IMM || state[v->id] != CONSTANT)  // or made here
+        continue;
+      if (v->op != IR_PHI) {
+        v->op = IR_IMM;
+        v->imm = val[v->id];
+        v->nargs = 0;
+        continue;
+      }
+      Inst pos = v;
+      while (pos->op == IR_PHI)
+        pos = pos->next;
+      consts[v->id] = new_inst(f, IR_IMM, v->size, 0);
+      consts[v->id]->imm = val[v->id];
+      insert_before(pos, consts[v->id]);
+      remove_inst(v);
+    }
+  }
+  Inst* map = calloc(f->ninsts, sizeof(Inst));
+  memcpy(map, consts, ninsts * sizeof(Inst));
+  replace_values(f, map);
+  free(map);
+  free(consts);
+}
+
+static void sccp(Func f) {
+  compute_uses(f);
+  propagate(f);
+  rewrite(f);
+  simplify_phis(f);
+
+  for (int i = 0; i < f->nblocks; i++)
+    free(edge_reached[i]);
+  free(edge_reached);
+  free(state);
+  free(val);
+  free(reached);
+}
+
+/******************************
+ *   control flow cleanup     *
+ ******************************/
+// Folds branches on constants, threads jumps through empty blocks and
+// merges a block into its only predecessor, until nothing changes. Blocks
+// no longer reached are dropped, so code after a return or in the body of
+// an if (0) disappears.
+
+// whether the phis of s get the same value from its predecessors i and j
+static int same_phi_args(Block s, int i, int j) {
+  for (Inst v = s->first; v->op == IR_PHI; v = v->next) {
+    if (v->args[i] != v->args[j])
+      return 0;
+  }
+  return 1;
+}
+
+static int fold_branch(Block b) {
+  Inst br = b->last;
+  if (br->op != IR_BR)
+    return 0;
+
+  Block drop;
+  if (br->args[0]->op == IR_IMM)
+    drop = b->succ[br->args[0]->imm ? 1 : 0];
+  else if (b->succ[0] == b->succ[1]) {
+    Block s = b->succ[0];
+    int i = pred_index(s, b), j = i + 1;
+    while (s->pred[j] != b)
+      j++;
+    if (!same_phi_args(s, i, j))
+      return 0;
+    drop = s;
+  } else
+    return 0;
+
+  remove_edge(b, drop);
+  br->op = IR_JMP;
+  br->nargs = 0;
+  return 1;
+}
+
+// the edge from b to its successor i skips the block there, if it only
+// jumps elsewhere
+static int thread_jump(Block b, int i) {
+  Block e = b->succ[i];
+  if (b->last->op == IR_IJMP || e->first != e->last || e->last->op != IR_JMP)
+    return 0;
+  Block t = e->succ[0];
+  if (t == e || (t->first->op == IR_PHI && pred_index(t, b) >= 0))
+    return 0;
+
+  int k = pred_index(e, b);
+  memmove(e->pred + k, e->pred + k + 1, (e->npred - k - 1) * sizeof(Block));
+  e->npred--;
+  b->succ[i] = t;
+
+  // b takes the operands that came through e
+  k = pred_index(t, e);
+  t->pred = realloc(t->pred, (t->npred + 1) * sizeof(Block));
+  t->pred[t->npred++] = b;
+  for (Inst v = t->first; v->op == IR_PHI; v = v->next) {
+    v->args = realloc(v->args, (v->nargs + 1) * sizeof(Inst));
+    v->args[v->nargs++] = v->args[k];
+  }
+  return 1;
+}
+
+// appends s to b, when b jumps to s and nothing else does
+static int merge_block(Func f, Block b) {
+  if (b->last->op != IR_JMP)
+    return 0;
+  Block s = b->succ[0];
+  if (s == b || s == f->entry || s->npred != 1 || s->first->op == IR_PHI)
+    return 0;
+
+  remove_inst(b->last);
+  for (Inst v = s->first; v; v = v->next)
+    v->block = b;
+  if (b->last) {
+    b->last->next = s->first;
+    s->first->prev = b->last;
+  } else
+    b->first = s->first;
+  b->last = s->last;
+  s->first = s->last = NULL;
+
+  free(b->succ);
+  b->succ = s->succ;
+  b->nsucc = s->nsucc;
+  for (int i = 0; i < b->nsucc; i++) {
+    Block t = b->succ[i];
+    for (int j = 0; j < t->npred; j++) {
+      if (t->pred[j] == s)
+        t->pred[j] = b;
+    }
+  }
+  s->succ = NULL;
+  s->nsucc = 0;
+  s->npred = 0;
+  return 1;
+}
+
+static void simplify_cfg(Func f) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    simplify_phis(f);
+    for (Block b = f->entry; b; b = b->next) {
+      if (!b->last)  // merged into its predecessor
+        continue;
+      changed |= fold_branch(b);
+      for (int i = 0; i < b->nsucc; i++)
+        changed |= thread_jump(b, i);
+      while (merge_block(f, b))
+        changed = 1;
+    }
+    remove_unreachable(f);
+  }
+}
+
+/******************************
+ *     dead store removal     *
+ ******************************/
+// The variables left in memory are arrays, structs and the ones whose
+// address is taken. A store into such a variable is dead if no path from
+// it reads the variable before it is overwritten or the function returns.
+// The liveness of the variables is solved backwards over the blocks.
+//
+// Only the variables whose address is used for nothing else than their
+// own loads, stores and copies are considered, any other use might let
+// the address escape to code that reads it.
+
+static int* base;  // variable an address points into, by id, or -1
+static int nwords;  // of a set of variables
+static unsigned long* live_in;  // by block id
+static unsigned long* live_out;
+
+#define WORD_BITS (8 * (int)sizeof(unsigned long))
+#define set_has(set, k) ((set)[(k) / WORD_BITS] >> ((k) % WORD_BITS) & 1)
+#define set_add(set, k) ((set)[(k) / WORD_BITS] |= 1UL << ((k) % WORD_BITS))
+#define set_del(set, k) ((set)[(k) / WORD_BITS] &= ~(1UL << ((k) % WORD_BITS)))
+
+// number the variables still in memory, and find the addresses into them
+static int find_bases(Func f) {
+  int nvars = 0;
+  for (Node v = f->node->locals; v; v = v->next) {
+    if (v->kind == A_VAR)
+      v->var_index = nvars++;
+  }
+
+  base = realloc(base, f->ninsts * sizeof(int));
+  for (int i = 0; i < f->nrpo; i++) {
+    for (Inst v = f->rpo[i]->first; v; v = v->next) {
+      base[v->id] = -1;
+      if (v->op == IR_ADDR && v->var->kind == A_VAR && !v->var->is_global)
+        base[v->id] = v->var->var_index;
+      if (v->op != IR_ADD && v->op != IR_SUB)
+        continue;
+      int b0 = base[v->args[0]->id], b1 = base[v->args[1]->id];
+      if (b1 < 0)
+        base[v->id] = b0;
+      else if (v->op == IR_ADD && b0 < 0)
+        base[v->id] = b1;
+    }
+  }
+  return nvars;
+}
+
+// whether v uses its operand i as an address into a variable, and how
+static int address_use(Inst v, int i) {
+  Inst a = v->args[i];
+  switch (v->op) {
+    case IR_LOAD:
+      return 1;
+    case IR_STORE:
+    case IR_COPY:
+    case IR_ZERO:
+      return i == 0 || v->op == IR_COPY;
+    case IR_ADD:
+    case IR_SUB:
+      return base[v->id] == base[a->id];
+  }
+  return 0;
+}
+
+static char* find_escaped(Func f, int nvars) {
+  char* escaped = calloc(nvars ? nvars : 1, 1);
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->op == IR_PHI) {  // phi operands may come later
+        for (int i = 0; i < v->nargs; i++) {
+          if (base[v->args[i]->id] >= 0)
+            escaped[base[v->args[i]->id]] = 1;
+        }
+        continue;
+      }
+      for (int i = 0; i < v->nargs; i++) {
+        int k = base[v->args[i]->id];
+        if (k >= 0 && !address_use(v, i))
+          escaped[k] = 1;
+      }
+    }
+  }
+  return escaped;
+}
+
+static int stored_var(Inst v) {
+  if ((v->op != IR_STORE && v->op != IR_COPY && v->op != IR_ZERO) ||
+      v->is_volatile)
+    return -1;
+  return base[v->args[0]->id];
+}
+
+// whether the store v overwrites all of the variable
+static int kills(Inst v) {
+  Inst addr = v->args[0];
+  int size = v->op == IR_STORE ? v->args[1]->size : v->imm;
+  return addr->op == IR_ADDR && size == unqual(addr->var->type)->size;
+}
+
+// variable read by v, or -1
+static int read_var(Inst v) {
+  if (v->op == IR_LOAD)
+    return base[v->args[0]->id];
+  if (v->op == IR_COPY)
+    return base[v->args[1]->id];
+  return -1;
+}
+
+// steps backwards over v, removing it if it's a dead store
+static void step_back(Inst v, unsigned long* live, char* escaped, int remove) {
+  int k = stored_var(v);
+  if (k >= 0 && !escaped[k]) {
+    if (!set_has(live, k)) {
+      if (remove)
+        remove_inst(v);
+      return;
+    }
+    if (kills(v))
+      set_del(live, k);
+  }
+  if ((k = read_var(v)) >= 0)
+    set_add(live, k);
+}
+
+static void remove_dead_stores(Func f) {
+  compute_rpo(f);
+  int nvars = find_bases(f);
+  char* escaped = find_escaped(f, nvars);
+
+  nwords = (nvars + WORD_BITS - 1) / WORD_BITS;
+  live_in = calloc(f->nblocks * nwords + 1, sizeof(unsigned long));
+  live_out = calloc(f->nblocks * nwords + 1, sizeof(unsigned long));
+
+  // postorder visits the successors first, except for loops
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = f->nrpo - 1; i >= 0; i--) {
+      Block b = f->rpo[i];
+      unsigned long* out = live_out + b->id * nwords;
+      unsigned long* in = live_in + b->id * nwords;
+      for (int j = 0; j < b->nsucc; j++) {
+        for (int w = 0; w < nwords; w++)
+          out[w] |= live_in[b->succ[j]->id * nwords + w];
+      }
+      unsigned long* live = malloc((nwords + 1) * sizeof(unsigned long));
+      memcpy(live, out, nwords * sizeof(unsigned long));
+      for (Inst v = b->last; v; v = v->prev)
+        step_back(v, live, escaped, 0);
+      if (memcmp(live, in, nwords * sizeof(unsigned long))) {
+        memcpy(in, live, nwords * sizeof(unsigned long));
+        changed = 1;
+      }
+      free(live);
+    }
+  }
+
+  unsigned long* live = malloc((nwords + 1) * sizeof(unsigned long));
+  for (Block b = f->entry; b; b = b->next) {
+    memcpy(live, live_out + b->id * nwords, nwords * sizeof(unsigned long));
+    Inst prev;
+    for (Inst v = b->last; v; v = prev) {
+      prev = v->prev;
+      step_back(v, live, escaped, 1);
+    }
+  }
+
+  free(live);
+  free(live_in);
+  free(live_out);
+  free(escaped);
+}
+
+/******************************
+ *     dead code removal      *
+ ******************************/
+// An instruction is kept if it has an effect: it's a store, a call, a
+// volatile load or a terminator, or if a kept instruction uses its value.
+// So the value of an expression statement is computed only for its side
+// effects. Variables no longer referred to leave the frame.
+
+static int has_effect(Inst v) {
+  return v->size == 0 || v->op == IR_CALL || v->is_volatile;
+}
+
+static void remove_dead_code(Func f) {
+  char* live = calloc(f->ninsts, 1);
+  Inst* work = malloc(f->ninsts * sizeof(Inst));
+  int n = 0;
+
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (has_effect(v)) {
+        live[v->id] = 1;
+        work[n++] = v;
+      }
+    }
+  }
+  while (n) {
+    Inst v = work[--n];
+    for (int i = 0; i < v->nargs; i++) {
+      Inst a = v->args[i];
+      if (!live[a->id]) {
+        live[a->id] = 1;
+        work[n++] = a;
+      }
+    }
+  }
+
+  for (Node v = f->node->locals; v; v = v->next)
+    v->var_index = 0;  // set if the variable is referred to
+  for (Block b = f->entry; b; b = b->next) {
+    Inst next;
+    for (Inst v = b->first; v; v = next) {
+      next = v->next;
+      if (!live[v->id])
+        remove_inst(v);
+      else if (v->op == IR_ADDR)
+        v->var->var_index = 1;
+    }
+  }
+  // nothing reads a struct parameter that isn't referred to
+  Inst next;
+  for (Inst v = f->entry->first; v; v = next) {
+    next = v->next;
+    if (v->op == IR_PARAM && v->var && !v->var->var_index)
+      remove_inst(v);
+  }
+
+  Node* link = &f->node->locals;
+  for (Node v = f->node->locals; v; v = v->next) {
+    if (v->kind == A_VAR && !v->var_index)
+      continue;
+    *link = v;
+    link = &v->next;
+  }
+  *link = NULL;
+
+  free(live);
+  free(work);
+}
+
+/******************************
+ *       value numbering      *
+ ******************************/
+// Finds the instructions computing the same value as one dominating them,
+// and makes their uses use that one instead. The available values are
+// kept in a hash table, scoped by a walk over the dominator tree.
+//
+// A load is the same as an earlier one from the same address only if no
+// store or call may have changed memory in between. Each such change
+// starts a new memory epoch, the key of a load includes the epoch. A block
+// whose only predecessor is its dominator continues the epoch the
+// dominator ended with. A store makes its value available to the loads
+// that follow, of the same address and size.
+
+// an operation on operands, the key in the table of available values
+struct key {
+  int op;
+  int size;
+  Inst arg[2];
+  unsigned long long imm;
+  Node var;
+  int epoch;  // for loads
+};
+
+typedef struct value* Value;
+struct value {
+  struct key key;
+  unsigned hash;
+  Inst v;      // computes the value
+  Value next;  // in the bucket
+};
+
+static Value* value_table;  // by hash, sized for the function
+static unsigned value_mask;
+static Value* value_log;  // insertions, to undo when leaving a block
+static int nvalue_log, value_log_cap;
+static int epoch, nepochs;
+
+static int is_commutative(int op) {
+  return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR ||
+         op == IR_XOR || op == IR_EQ || op == IR_NE;
+}
+
+static unsigned key_hash(struct key* k) {
+  unsigned long h = k->op * 31 + k->size;
+  h = h * 31 + (k->arg[0] ? k->arg[0]->id : 0);
+  h = h * 31 + (k->arg[1] ? k->arg[1]->id : 0);
+  h = h * 31 + k->imm;
+  h = h * 31 + ((unsigned long)k->var >> 3);
+  return (h * 31 + k->epoch) * 2654435761u;
+}
+
+static int same_key(struct key* a, struct key* b) {
+  return a->op == b->op && a->size == b->size && a->arg[0] == b->arg[0] &&
+         a->arg[1] == b->arg[1] && a->imm == b->imm && a->var == b->var &&
+         a->epoch == b->epoch;
+}
+
+static Inst find_value(struct key* k) {
+  unsigned h = key_hash(k);
+  for (Value e = value_table[h & value_mask]; e; e = e->next) {
+    if (e->hash == h && same_key(&e->key, k))
+      return e->v;
+  }
+  return NULL;
+}
+
+static void add_value(struct key* k, Inst v) {
+  Value e = malloc(sizeof(struct value));
+  e->key = *k;
+  e->hash = key_hash(k);
+  e->v = v;
+  e->next = value_table[e->hash & value_mask];
+  value_table[e->hash & value_mask] = e;
+
+  if (nvalue_log == value_log_cap) {
+    value_log_cap = value_log_cap ? value_log_cap * 2 : 64;
+    value_log = realloc(value_log, value_log_cap * sizeof(Value));
+  }
+  value_log[nvalue_log++] = e;
+}
+
+static void load_key(struct key* k, Inst addr, int size) {
+  memset(k, 0, sizeof(struct key));
+  k->op = IR_LOAD;
+  k->size = size;
+  k->arg[0] = addr;
+  k->epoch = epoch;
+}
+
+static void number_block(Block b, Inst* map) {
+  Inst next;
+  for (Inst v = b->first; v; v = next) {
+    struct key k;
+    next = v->next;
+    for (int i = 0; i < v->nargs; i++) {
+      if (map[v->args[i]->id])
+        v->args[i] = map[v->args[i]->id];
+    }
+
+    if (v->op == IR_STORE || v->op == IR_COPY || v->op == IR_ZERO ||
+        v->op == IR_CALL || v->is_volatile) {
+      epoch = ++nepochs;
+      if (v->op == IR_STORE && !v->is_volatile) {
+        load_key(&k, v->args[0], v->args[1]->size);
+        add_value(&k, v->args[1]);
+      }
+      continue;
+    }
+
+    if (v->op == IR_LOAD)
+      load_key(&k, v->args[0], v->size);
+    else if (v->op == IR_IMM || v->op == IR_ADDR ||
+             (v->op >= IR_ADD && v->op <= IR_TRUNC)) {
+      if (is_commutative(v->op) && v->args[0]->id > v->args[1]->id) {
+        Inst t = v->args[0];
+        v->args[0] = v->args[1];
+        v->args[1] = t;
+      }
+      memset(&k, 0, sizeof(struct key));
+      k.op = v->op;
+      k.size = v->size;
+      for (int i = 0; i < v->nargs; i++)
+        k.arg[i] = v->args[i];
+      k.imm = v->op == IR_IMM ? v->imm : 0;
+      k.var = v->var;
+    } else
+      continue;
+
+    Inst same = find_value(&k);
+    if (same) {
+      map[v->id] = same;
+      remove_inst(v);
+    } else
+      add_value(&k, v);
+  }
+}
+
+static void number_values(Func f) {
+  compute_dominators(f);
+
+  Inst* map = calloc(f->ninsts, sizeof(Inst));
+  Block* stack = malloc(f->nrpo * sizeof(Block));
+  int* mark = malloc(f->nrpo * sizeof(int));  // log size at entry, or -1
+  int* end_epoch = malloc(f->nblocks * sizeof(int));
+  int n = 0;
+
+  unsigned size = 64;
+  while (size < (unsigned)f->ninsts)
+    size *= 2;
+  value_table = calloc(size, sizeof(Value));
+  value_mask = size - 1;
+
+  nepochs = 0;
+  stack[n] = f->entry;
+  mark[n++] = -1;
+  while (n) {
+    Block b = stack[n - 1];
+    if (mark[n - 1] < 0) {
+      mark[n - 1] = nvalue_log;
+      if (b->npred == 1 && b->pred[0] == b->idom)
+        epoch = end_epoch[b->idom->id];
+      else
+        epoch = ++nepochs;
+      number_block(b, map);
+      end_epoch[b->id] = epoch;
+      for (Block c = b->dom_child; c; c = c->dom_sibling) {
+        stack[n] = c;
+        mark[n++] = -1;
+      }
+      continue;
+    }
+    for (; nvalue_log > mark[n - 1]; nvalue_log--) {
+      Value e = value_log[nvalue_log - 1];
+      value_table[e->hash & value_mask] = e->next;
+      free(e);
+    }
+    n--;
+  }
+
+  replace_values(f, map);  // in phis, reached by back edges
+  free(value_table);
+  free(map);
+  free(stack);
+  free(mark);
+  free(end_epoch);
+}
+
+/******************************
+ *  loop invariant code motion *
+ ******************************/
+// A natural loop is found from its back edges, the edges to a block (the
+// header) that dominates their source. The computations that give the same
+// value on every iteration are moved to the preheader, a block that only
+// jumps to the header from outside the loop. Inner loops are handled
+// first, so an invariant can move out of several loops.
+//
+// Moved code runs even when the loop body wouldn't have, so it must not
+// trap: a division needs a constant divisor that can't fault, and a load
+// either reads a variable or sits in the header, which always runs. A load
+// also needs that nothing in the loop may write the object it reads.
+
+static int* loop_mark;  // by block id, loop_stamp if in the loop
+static int loop_stamp;
+static Block* loop_blocks;
+static int nloop_blocks;
+
+#define in_loop(b) (loop_mark[(b)->id] == loop_stamp)
+
+static int by_rpo(const void* a, const void* b) {
+  return (*(Block*)a)->rpo - (*(Block*)b)->rpo;
+}
+
+// the blocks reaching a back edge into h without going through h
+static void find_loop(Func f, Block h) {
+  loop_blocks = realloc(loop_blocks, f->nblocks * sizeof(Block));
+  nloop_blocks = 0;
+  loop_stamp++;
+  loop_mark[h->id] = loop_stamp;
+  loop_blocks[nloop_blocks++] = h;
+
+  for (int i = 0; i < h->npred; i++) {
+    Block p = h->pred[i];
+    if (!dominates(h, p) || in_loop(p))
+      continue;
+    int n = nloop_blocks;
+    loop_mark[p->id] = loop_stamp;
+    loop_blocks[nloop_blocks++] = p;
+    while (n < nloop_blocks) {
+      Block b = loop_blocks[n++];
+      for (int j = 0; j < b->npred; j++) {
+        if (!in_loop(b->pred[j]) && b->pred[j]->rpo >= 0) {
+          loop_mark[b->pred[j]->id] = loop_stamp;
+          loop_blocks[nloop_blocks++] = b->pred[j];
+        }
+      }
+    }
+  }
+  qsort(loop_blocks, nloop_blocks, sizeof(Block), by_rpo);
+}
+
+static Block make_preheader(Func f, Block h) {
+  Block out = NULL;
+  int nout = 0;
+  for (int i = 0; i < h->npred; i++) {
+    if (!in_loop(h->pred[i])) {
+      out = h->pred[i];
+      nout++;
+    }
+  }
+  if (nout == 1 && out->nsucc == 1)
+    return out;
+
+  // the edges from outside go to the preheader, which merges their phi
+  // operands
+  Block pre = new_block(f);
+  pre->pred = malloc(nout * sizeof(Block));
+  for (Inst v = h->first; v->op == IR_PHI; v = v->next) {
+    Inst merged = NULL;
+    if (nout > 1) {
+      merged = new_inst(f, IR_PHI, v->size, nout);
+      append_inst(pre, merged);
+    }
+    int k = 0, n = 0;
+    for (int i = 0; i < h->npred; i++) {
+      if (in_loop(h->pred[i]))
+        v->args[n++] = v->args[i];
+      else if (merged)
+        merged->args[k++] = v->args[i];
+      else
+        merged = v->args[i];
+    }
+    v->args[n++] = merged;
+    v->nargs = n;
+  }
+  int n = 0;
+  for (int i = 0; i < h->npred; i++) {
+    Block p = h->pred[i];
+    if (in_loop(p)) {
+      h->pred[n++] = p;
+      continue;
+    }
+    pre->pred[pre->npred++] = p;
+    int j = 0;
+    while (p->succ[j] != h)
+      j++;
+    p->succ[j] = pre;
+  }
+  h->pred[n++] = pre;
+  h->npred = n;
+
+  append_inst(pre, new_inst(f, IR_JMP, 0, 0));
+  pre->succ = malloc(sizeof(Block));
+  pre->succ[pre->nsucc++] = h;
+
+  Block* link = &f->entry;
+  while (*link != h)
+    link = &(*link)->next;
+  pre->next = h;
+  *link = pre;
+  return pre;
+}
+
+// the variable an address points into, if known, and whether the address
+// is the variable's plus constant offsets
+static Node address_root(Inst a, int* fixed) {
+  *fixed = 1;
+  while (a->op == IR_ADD || a->op == IR_SUB) {
+    if (a->args[1]->op != IR_IMM)
+      *fixed = 0;
+    a = a->args[0];
+  }
+  return a->op == IR_ADDR ? a->var : NULL;
+}
+
+// what the loop may write to memory
+static int writes_unknown;  // through an address of unknown origin
+static Node* written;       // variables stored into
+static int nwritten;
+
+static void find_writes() {
+  writes_unknown = 0;
+  nwritten = 0;
+  for (int i = 0; i < nloop_blocks; i++) {
+    for (Inst v = loop_blocks[i]->first; v; v = v->next) {
+      int fixed;
+      if (v->op == IR_CALL || v->is_volatile)
+        writes_unknown = 1;
+      if (v->op != IR_STORE && v->op != IR_COPY && v->op != IR_ZERO)
+        continue;
+      Node root = address_root(v->args[0], &fixed);
+      if (!root) {
+        writes_unknown = 1;
+        continue;
+      }
+      written = realloc(written, (nwritten + 1) * sizeof(Node));
+      written[nwritten++] = root;
+    }
+  }
+}
+
+static int may_hoist(Inst v, Block h) {
+  if (v->op == IR_IMM || v->op == IR_ADDR)
+    return 1;
+
+  if (v->op == IR_DIV || v->op == IR_MOD || v->op == IR_UDIV ||
+      v->op == IR_UMOD) {
+    Inst d = v->args[1];
+    unsigned long long ones = ~0ULL >> (64 - v->size * 8);
+    if (d->op != IR_IMM || (d->imm & ones) == 0)
+      return 0;
+    // INT_MIN / -1 faults too
+    return v->op == IR_UDIV || v->op == IR_UMOD || (d->imm & ones) != ones;
+  }
+  if (v->op >= IR_ADD && v->op <= IR_TRUNC)
+    return 1;
+
+  if (v->op != IR_LOAD || v->is_volatile || writes_unknown)
+    return 0;
+  int fixed;
+  Node root = address_root(v->args[0], &fixed);
+  if (!(root && fixed) && v->block != h)
+    return 0;
+  if (!root)  // might read anything written
+    return nwritten == 0;
+  for (int i = 0; i < nwritten; i++) {
+    if (written[i] == root)
+      return 0;
+  }
+  return 1;
+}
+
+static void hoist_loop(Func f, Block h) {
+  find_loop(f, h);
+  find_writes();
+  Block pre = make_preheader(f, h);  // made already
+
+  // blocks in reverse postorder see the definitions of operands first
+  for (int i = 0; i < nloop_blocks; i++) {
+    Inst next;
+    for (Inst v = loop_blocks[i]->first; v; v = next) {
+      next = v->next;
+      if (v->op == IR_PHI || !may_hoist(v, h))
+        continue;
+      int j = 0;
+      while (j < v->nargs && !in_loop(v->args[j]->block))
+        j++;
+      if (j < v->nargs)
+        continue;
+      remove_inst(v);
+      insert_before(pre->last, v);
+    }
+  }
+}
+
+// the loop headers, inner loops after their outer ones in reverse
+// postorder
+static Block* find_headers(Func f, int* n) {
+  compute_dominators(f);
+  Block* headers = malloc(f->nrpo * sizeof(Block));
+  *n = 0;
+  for (int i = 0; i < f->nrpo; i++) {
+    Block h = f->rpo[i];
+    for (int j = 0; j < h->npred; j++) {
+      if (dominates(h, h->pred[j])) {
+        headers[(*n)++] = h;
+        break;
+      }
+    }
+  }
+  return headers;
+}
+
+static void hoist_invariants(Func f) {
+  int nheaders;
+  Block* headers = find_headers(f, &nheaders);
+
+  // a preheader can't take the edges of an indirect jump
+  int n = 0;
+  for (int i = 0; i < nheaders; i++) {
+    if (!has_indirect_pred(headers[i]))
+      headers[n++] = headers[i];
+  }
+  nheaders = n;
+
+  // the preheaders don't change the loops, the loops are found again once
+  // they are all made
+  loop_mark = realloc(loop_mark, (f->nblocks + nheaders) * sizeof(int));
+  memset(loop_mark, 0, (f->nblocks + nheaders) * sizeof(int));
+  loop_stamp = 0;
+  for (int i = 0; i < nheaders; i++) {
+    find_loop(f, headers[i]);
+    make_preheader(f, headers[i]);
+  }
+  compute_dominators(f);
+  for (int i = nheaders - 1; i >= 0; i--)
+    hoist_loop(f, headers[i]);
+  free(headers);
+}
+
+/******************************
+ *    induction variables     *
+ ******************************/
+// An induction variable is a header phi stepped by a constant on each
+// iteration. A value derived from one, like the address base + i * size
+// of a[i], is affine in it: base + scale * i + offset. Instead of being
+// computed from i on every iteration, each (i, scale, base) gets its own
+// phi, starting at base + scale * init and stepped by scale * step, and
+// the derived values become that phi plus their offset. A compare of i
+// with an invariant bound then compares the new phi with the end value
+// computed in the preheader, which leaves i dead if nothing else reads
+// it.
+//
+// A 32-bit variable is followed through its sign extension to an index,
+// as signed overflow doesn't happen in a correct program.
+
+struct affine {
+  Inst iv;  // header phi
+  long long step;
+  long long scale;
+  Inst base;  // invariant, or NULL
+  long long offset;
+  int stamp;  // loop_stamp of the loop it was found in
+};
+static struct affine* forms;  // by id
+static int nforms;
+
+struct family {
+  Inst iv;
+  long long scale;
+  Inst base;
+  Inst phi;  // base + scale * iv
+};
+static struct family* families;
+static int nfamilies, families_cap;
+
+static struct affine* form_of(Inst v) {
+  if (v->id >= nforms || forms[v->id].stamp != loop_stamp)
+    return NULL;
+  return &forms[v->id];
+}
+
+static void set_form(Inst v, struct affine* a) {
+  forms[v->id] = *a;
+  forms[v->id].stamp = loop_stamp;
+}
+
+// a header phi that becomes phi + step on the back edge from the latch
+static void find_basic_iv(Inst phi, int latch) {
+  Inst next = phi->args[latch];
+  if ((phi->size != 4 && phi->size != 8) || next->nargs != 2)
+    return;
+  Inst a = next->args[0], b = next->args[1];
+  if (next->op == IR_ADD && a->op == IR_IMM) {
+    a = b;
+    b = next->args[0];
+  }
+  if ((next->op != IR_ADD && next->op != IR_SUB) || a != phi ||
+      b->op != IR_IMM)
+    return;
+  struct affine f = {phi, sign_extend(b->imm, b->size), 1, NULL, 0, 0};
+  if (next->op == IR_SUB)
+    f.step = -f.step;
+  set_form(phi, &f);
+}
+
+static void find_form(Inst v) {
+  if (v->nargs == 0 || v->nargs > 2 || v->op == IR_PHI)
+    return;
+  struct affine* a = form_of(v->args[0]);
+  Inst x = v->nargs == 2 ? v->args[1] : NULL;  // the other operand
+  if (!a && x && form_of(x) && (v->op == IR_ADD || v->op == IR_MUL)) {
+    a = form_of(x);
+    x = v->args[0];
+  }
+  if (!a)
+    return;
+
+  struct affine f = *a;
+  if ((v->op == IR_ADD || v->op == IR_SUB) && x->op == IR_IMM) {
+    long long k = sign_extend(x->imm, x->size);
+    f.offset += v->op == IR_ADD ? k : -k;
+  } else if (v->op == IR_ADD && v->size == 8 && !a->base &&
+             !in_loop(x->block)) {
+    f.base = x;
+  } else if ((v->op == IR_MUL || v->op == IR_SHL) && v->size == 8 &&
+             !a->base && x->op == IR_IMM) {
+    long long k = sign_extend(x->imm, x->size);
+    if (v->op == IR_SHL)
+      k = 1LL << (k & 63);
+    f.scale *= k;
+    f.offset *= k;
+  } else if (v->op != IR_SEXT || v->size != 8) {
+    return;
+  }
+  set_form(v, &f);
+}
+
+static Inst new_imm(Func f, Block pre, long long k) {
+  Inst v = new_inst(f, IR_IMM, 8, 0);
+  v->imm = k;
+  insert_before(pre->last, v);
+  return v;
+}
+
+static Inst new_op(Func f, Inst pos, int op, Inst a, Inst b) {
+  Inst v = new_inst(f, op, 8, 2);
+  v->args[0] = a;
+  v->args[1] = b;
+  insert_before(pos, v);
+  return v;
+}
+
+// base + scale * x, computed in the preheader
+static Inst scaled(Func f, Block pre, struct family* fam, Inst x) {
+  if (x->op == IR_IMM) {
+    long long k = sign_extend(x->imm, x->size) * fam->scale;
+    return k ? new_op(f, pre->last, IR_ADD, fam->base, new_imm(f, pre, k))
+             : fam->base;
+  }
+  if (x->size == 4) {
+    Inst w = new_inst(f, IR_SEXT, 8, 1);
+    w->args[0] = x;
+    insert_before(pre->last, w);
+    x = w;
+  }
+  if (fam->scale != 1)
+    x = new_op(f, pre->last, IR_MUL, x, new_imm(f, pre, fam->scale));
+  return new_op(f, pre->last, IR_ADD, fam->base, x);
+}
+
+static struct family* find_family(Func f, struct affine* a, Block pre,
+                                  int latch) {
+  for (int i = 0; i < nfamilies; i++) {
+    struct family* fam = &families[i];
+    if (fam->iv == a->iv && fam->scale == a->scale && fam->base == a->base)
+      return fam;
+  }
+  if (nfamilies == families_cap) {
+    families_cap = families_cap ? families_cap * 2 : 8;
+    families = realloc(families, families_cap * sizeof(struct family));
+  }
+  struct family* fam = &families[nfamilies++];
+  fam->iv = a->iv;
+  fam->scale = a->scale;
+  fam->base = a->base;
+
+  Block h = a->iv->block;
+  Block l = h->pred[latch];
+  fam->phi = new_inst(f, IR_PHI, 8, 2);
+  fam->phi->args[!latch] = scaled(f, pre, fam, a->iv->args[!latch]);
+  fam->phi->args[latch] = new_op(f, l->last, IR_ADD, fam->phi,
+                                 new_imm(f, pre, a->scale * a->step));
+  insert_before(h->first, fam->phi);
+  return fam;
+}
+
+static int swap_compare(int op) {
+  switch (op) {
+    case IR_LT:
+      return IR_GT;
+    case IR_LE:
+      return IR_GE;
+    case IR_GT:
+      return IR_LT;
+    case IR_GE:
+      return IR_LE;
+  }
+  return op;
+}
+
+// iv + offset against an invariant bound, as the family's phi against the
+// bound's image
+static void replace_test(Func f, Inst v, Block pre) {
+  if (v->op < IR_EQ || v->op > IR_GE)  // signed, the image keeps the order
+    return;
+  int op = v->op;
+  Inst x = v->args[0], n = v->args[1];
+  if (!form_of(x)) {
+    x = v->args[1];
+    n = v->args[0];
+    op = swap_compare(op);
+  }
+  struct affine* a = form_of(x);
+  if (!a || a->scale != 1 || a->base || in_loop(n->block) ||
+      n->size != x->size)
+    return;
+  struct family* fam = NULL;
+  for (int i = 0; i < nfamilies && !fam; i++) {
+    if (families[i].iv == a->iv)
+      fam = &families[i];
+  }
+  if (!fam)
+    return;
+
+  Inst p = fam->phi;
+  if (a->offset)
+    p = new_op(f, v, IR_ADD, p, new_imm(f, pre, fam->scale * a->offset));
+  v->op = fam->scale < 0 ? swap_compare(op) : op;
+  v->args[0] = p;
+  v->args[1] = scaled(f, pre, fam, n);
+}
+
+static void reduce_loop(Func f, Block h, Inst* map) {
+  find_loop(f, h);
+  if (h->npred != 2 || has_indirect_pred(h))
+    return;
+  int latch = in_loop(h->pred[1]);
+  Block pre = h->pred[!latch];
+  if (in_loop(h->pred[!latch]) || pre->nsucc != 1)
+    return;
+
+  int ninsts = f->ninsts;  // made here after
+  if (nforms < ninsts) {
+    forms = realloc(forms, ninsts * sizeof(struct affine));
+    memset(forms + nforms, 0, (ninsts - nforms) * sizeof(struct affine));
+    nforms = ninsts;
+  }
+  for (Inst v = h->first; v->op == IR_PHI; v = v->next)
+    find_basic_iv(v, latch);
+  for (int i = 0; i < nloop_blocks; i++) {
+    for (Inst v = loop_blocks[i]->first; v; v = v->next)
+      find_form(v);
+  }
+
+  // the values from which their offsets are added, base + scale * iv
+  nfamilies = 0;
+  for (int i = 0; i < nloop_blocks; i++) {
+    for (Inst v = loop_blocks[i]->first; v; v = v->next) {
+      struct affine* a = v->id < ninsts ? form_of(v) : NULL;
+      if (!a || !a->base || !a->scale || v->op == IR_PHI)
+        continue;
+      Inst x = form_of(v->args[0]) ? v->args[0] : v->args[1];
+      if (form_of(x)->base)  // an offset of a value that is reduced
+        continue;
+      struct family* fam = find_family(f, a, pre, latch);
+      if (a->offset == 0) {
+        map[v->id] = fam->phi;
+        continue;
+      }
+      v->args[0] = fam->phi;
+      v->args[1] = new_imm(f, pre, a->offset);
+    }
+  }
+
+  for (int i = 0; i < nloop_blocks; i++) {
+    for (Inst v = loop_blocks[i]->first; v; v = v->next) {
+      if (v->id < ninsts)
+        replace_test(f, v, pre);
+    }
+  }
+}
+
+static void reduce_induction_vars(Func f) {
+  int nheaders;
+  Block* headers = find_headers(f, &nheaders);
+  loop_mark = realloc(loop_mark, f->nblocks * sizeof(int));
+  memset(loop_mark, 0, f->nblocks * sizeof(int));
+  loop_stamp = 0;
+  memset(forms, 0, nforms * sizeof(struct affine));
+
+  Inst* map = calloc(f->ninsts, sizeof(Inst));
+  int nmap = f->ninsts;
+  for (int i = nheaders - 1; i >= 0; i--) {
+    reduce_loop(f, headers[i], map);
+    map = realloc(map, f->ninsts * sizeof(Inst));
+    memset(map + nmap, 0, (f->ninsts - nmap) * sizeof(Inst));
+    nmap = f->ninsts;
+  }
+  replace_values(f, map);
+  free(map);
+  free(headers);
+}
+
+/******************************
+ *       if-conversion        *
+ ******************************/
+// A branch that only chooses the values of the phis where its sides meet
+// becomes selects, when each side is a few operations that can't fault or
+// have an effect. Both sides are then computed and the backend picks the
+// values with cmovs, a branch on unpredictable data can't mispredict. A
+// longer side stays a branch, it would cost more than the average
+// misprediction. A choice between 1 and 0 is the condition itself.
+
+#define MAX_SIDE 3    // operations computed on a side
+#define MAX_SELECTS 4
+
+static int negate_compare(int op) {
+  static const int negation[] = {
+      [IR_EQ] = IR_NE,   [IR_NE] = IR_EQ,   [IR_LT] = IR_GE,
+      [IR_LE] = IR_GT,   [IR_GT] = IR_LE,   [IR_GE] = IR_LT,
+      [IR_ULT] = IR_UGE, [IR_ULE] = IR_UGT, [IR_UGT] = IR_ULE,
+      [IR_UGE] = IR_ULT,
+  };
+  return negation[op];
+}
+
+// the block where the successor i of b leads, through the block *side
+// that only b jumps to, or directly with *side set to NULL
+static Block join_of(Block b, int i, Block* side) {
+  Block s = b->succ[i];
+  *side = NULL;
+  if (s->npred != 1 || s->last->op != IR_JMP)
+    return s;
+  *side = s;
+  return s->succ[0];
+}
+
+// operations in a side, more than MAX_SIDE if one may fault
+static int side_cost(Block s) {
+  int n = 0;
+  if (!s)
+    return 0;
+  for (Inst v = s->first; v != s->last; v = v->next) {
+    if (v->op == IR_IMM || v->op == IR_ADDR)
+      continue;
+    if (v->op == IR_DIV || v->op == IR_UDIV || v->op == IR_MOD ||
+        v->op == IR_UMOD)
+      return MAX_SIDE + 1;
+    if (v->op < IR_ADD || v->op > IR_SELECT)
+      return MAX_SIDE + 1;
+    n++;
+  }
+  return n;
+}
+
+static int is_imm(Inst v, long long k) {
+  return v->op == IR_IMM && v->imm == (unsigned long long)k;
+}
+
+// v becomes cond ? x : y, in place so its uses don't change
+static void select_phi(Inst v, Inst cond, Inst x, Inst y) {
+  int is_compare = cond->op >= IR_EQ && cond->op <= IR_UGE;
+  if (is_compare && v->size == 4 &&
+      ((is_imm(x, 1) && is_imm(y, 0)) || (is_imm(x, 0) && is_imm(y, 1)))) {
+    v->op = is_imm(x, 1) ? cond->op : negate_compare(cond->op);
+    v->nargs = 2;
+    v->args[0] = cond->args[0];
+    v->args[1] = cond->args[1];
+    return;
+  }
+  v->op = IR_SELECT;
+  v->args = realloc(v->args, 3 * sizeof(Inst));
+  v->nargs = 3;
+  v->args[0] = cond;
+  v->args[1] = x;
+  v->args[2] = y;
+}
+
+static int convert_branch(Func f, Block b) {
+  Inst br = b->last;
+  if (br->op != IR_BR)
+    return 0;
+  Block t, e;
+  Block j = join_of(b, 0, &t);
+  if (join_of(b, 1, &e) != j || j->npred != 2 || j == b || (!t && !e))
+    return 0;
+  if (side_cost(t) > MAX_SIDE || side_cost(e) > MAX_SIDE)
+    return 0;
+  int nphis = 0;
+  for (Inst v = j->first; v->op == IR_PHI; v = v->next)
+    nphis++;
+  if (nphis > MAX_SELECTS)
+    return 0;
+
+  // both sides are computed
+  Block sides[] = {t, e};
+  for (int i = 0; i < 2; i++) {
+    Block s = sides[i];
+    while (s && s->first != s->last) {
+      Inst v = s->first;
+      remove_inst(v);
+      insert_before(br, v);
+    }
+  }
+
+  // the phis are chosen at the end of b, which becomes the only
+  // predecessor of j
+  int it = pred_index(j, t ? t : b), ie = pred_index(j, e ? e : b);
+  while (j->first->op == IR_PHI) {
+    Inst v = j->first;
+    remove_inst(v);
+    insert_before(br, v);
+    select_phi(v, br->args[0], v->args[it], v->args[ie]);
+  }
+
+  if (t) {
+    remove_edge(b, t);
+    remove_edge(t, j);
+  }
+  if (e) {
+    remove_edge(b, e);
+    remove_edge(e, j);
+  }
+  if (!b->nsucc)
+    add_edge(b, j);
+  br->op = IR_JMP;
+  br->nargs = 0;
+  return 1;
+}
+
+// inner branches first, the blocks they leave are merged before the
+// outer ones are looked at
+static void convert_branches(Func f) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    compute_rpo(f);
+    for (int i = f->nrpo - 1; i >= 0; i--)
+      changed |= convert_branch(f, f->rpo[i]);
+    if (changed)
+      simplify_cfg(f);
+  }
+}
+
+/******************************
+ *       tail recursion       *
+ ******************************/
+// A function returning what a call to itself returns jumps back to its
+// start instead, with the arguments as the new parameters: the entry
+// becomes a loop header with a phi for each parameter, and a new entry
+// block holds the incoming ones. Variables left in memory may be pointed
+// to by the arguments, their function keeps its calls.
+//
+// A block only returning the phi of the values of calls, as the join of a
+// ternary does, is first repeated at the end of each call, so the calls
+// are followed by their return here and in the backend.
+
+static void split_returns(Func f) {
+  for (Block r = f->entry; r; r = r->next) {
+    Inst ret = r->last, phi = ret->nargs ? ret->args[0] : NULL;
+    if (ret->op != IR_RET || r->first != (phi ? phi : ret) ||
+        (phi && (phi->op != IR_PHI || phi->next != ret)))
+      continue;
+    for (int i = r->npred - 1; i >= 0; i--) {
+      Block p = r->pred[i];
+      Inst call = p->last->prev;
+      if (p->last->op != IR_JMP || !call || call->op != IR_CALL ||
+          (phi ? phi->args[i] != call : call->size != 0))
+        continue;
+      Inst v = new_inst(f, IR_RET, 0, phi != NULL);
+      if (phi)
+        v->args[0] = call;
+      remove_inst(p->last);
+      remove_edge(p, r);
+      append_inst(p, v);
+    }
+  }
+  remove_unreachable(f);
+}
+
+// the call to f that b returns the value of, if any
+static Inst tail_call(Func f, Block b) {
+  Inst ret = b->last, call = ret->prev;
+  if (ret->op != IR_RET || !call || call->op != IR_CALL ||
+      call->name != f->node->name ||
+      call->nargs != list_length(f->node->params))
+    return NULL;
+  if (ret->nargs ? ret->args[0] != call : call->size != 0)
+    return NULL;
+  return call;
+}
+
+static void remove_tail_recursion(Func f) {
+  split_returns(f);
+  for (Node v = f->node->locals; v; v = v->next) {
+    if (v->kind == A_VAR)
+      return;
+  }
+  int n = 0;
+  for (Block b = f->entry; b; b = b->next)
+    n += tail_call(f, b) != NULL;
+  if (!n)
+    return;
+
+  // the parameters, by index
+  int nparams = list_length(f->node->params);
+  Inst* params = calloc(nparams, sizeof(Inst));
+  for (Inst v = f->entry->first; v; v = v->next) {
+    if (v->op == IR_PARAM)
+      params[v->imm] = v;
+  }
+  for (Block b = f->entry; b; b = b->next) {
+    Inst call = tail_call(f, b);
+    for (int i = 0; call && i < nparams; i++) {
+      if (!params[i] || call->args[i]->size != params[i]->size) {
+        free(params);
+        return;
+      }
+    }
+  }
+
+  Block h = f->entry, entry = new_block(f);
+  entry->next = h;
+  f->entry = entry;
+  for (int i = 0; i < nparams; i++) {
+    remove_inst(params[i]);
+    append_inst(entry, params[i]);
+  }
+  append_inst(entry, new_inst(f, IR_JMP, 0, 0));
+  add_edge(entry, h);
+
+  Inst* phis = malloc(nparams * sizeof(Inst));
+  for (int i = nparams - 1; i >= 0; i--) {
+    phis[i] = new_inst(f, IR_PHI, params[i]->size, 0);
+    insert_before(h->first, phis[i]);
+  }
+  Inst* map = calloc(f->ninsts, sizeof(Inst));
+  for (int i = 0; i < nparams; i++)
+    map[params[i]->id] = phis[i];
+  replace_values(f, map);
+
+  // the arguments of the calls, by predecessor of the header
+  Inst** args = calloc(f->nblocks, sizeof(Inst*));
+  for (Block b = entry->next; b; b = b->next) {
+    Inst call = tail_call(f, b);
+    if (!call)
+      continue;
+    args[b->id] = call->args;
+    remove_inst(b->last);
+    remove_inst(call);
+    append_inst(b, new_inst(f, IR_JMP, 0, 0));
+    add_edge(b, h);
+  }
+  for (int i = 0; i < nparams; i++) {
+    Inst phi = phis[i];
+    phi->nargs = h->npred;
+    phi->args = malloc(h->npred * sizeof(Inst));
+    for (int j = 0; j < h->npred; j++) {
+      Block p = h->pred[j];
+      if (p == entry)
+        phi->args[j] = params[i];
+      else
+        phi->args[j] = args[p->id] ? args[p->id][i] : phi;
+    }
+  }
+
+  free(params);
+  free(phis);
+  free(map);
+  free(args);
+}
+
+/******************************
+ *          inlining          *
+ ******************************/
+// A call to a small function defined in the file is replaced by a copy of
+// its optimized body: the parameters are the arguments, and the returns
+// jump to the rest of the caller, where a phi merges the value returned.
+// A struct passed by value is copied to the parameter, and one returned
+// to where the call returns it, unless the callee wrote it there.
+// Callees are optimized before their callers, so a function calling
+// itself, directly or not, isn't finished when its calls are looked at
+// and isn't inlined there. --inline-limit sets the size of the largest
+// body inlined, --no-inline keeps the calls to a function.
+
+#define MAX_CALLER_SIZE 5000  // instructions a caller may grow to
+
+enum { NOT_OPTIMIZED, OPTIMIZING, OPTIMIZED };
+
+// functions defined in the file, open addressing keyed by the interned name
+static Func* func_index;
+static unsigned func_mask;
+
+static unsigned func_hash(const char* name) {
+  return ((unsigned long)name >> 3) * 2654435761u;
+}
+
+static Func find_func(const char* name) {
+  for (unsigned h = func_hash(name) & func_mask; func_index[h];
+       h = (h + 1) & func_mask) {
+    if (func_index[h]->node->name == name)
+      return func_index[h];
+  }
+  return NULL;
+}
+
+// keep the table at most half full
+static void index_funcs() {
+  unsigned size = 8, n = 0;
+  for (Func f = funcs; f; f = f->next)
+    n++;
+  while (size < 2 * n)
+    size <<= 1;
+
+  func_index = calloc(size, sizeof(Func));
+  func_mask = size - 1;
+  for (Func f = funcs; f; f = f->next) {
+    unsigned h = func_hash(f->node->name) & func_mask;
+    while (func_index[h])
+      h = (h + 1) & func_mask;
+    func_index[h] = f;
+  }
+}
+
+// instructions generating code
+static int func_size(Func f) {
+  int n = 0;
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next)
+      n += v->op != IR_IMM && v->op != IR_PARAM && v->op != IR_PHI;
+  }
+  return n;
+}
+
+static int may_inline(Func g, Inst call) {
+  if (!g || g->state != OPTIMIZED || g->entry->npred ||
+      list_length(g->node->params) + !!call->imm != call->nargs)
+    return 0;
+  for (int i = 0; i < options.nno_inline; i++) {
+    if (options.no_inline[i] == g->node->name)
+      return 0;
+  }
+  if (func_size(g) > options.inline_limit)
+    return 0;
+  // its label addresses are the blocks of the callee
+  for (Node l = g->node->labels; l; l = l->label_next) {
+    if (l->address_taken)
+      return 0;
+  }
+
+  // the values passed must be the ones the callee reads
+  for (Block b = g->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->op == IR_PARAM && !v->var &&
+          v->size != call->args[v->imm]->size)
+        return 0;
+      if (v->op == IR_RET && v->nargs && call->size &&
+          v->args[0]->size != call->size)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// the copy of a local variable of the callee, made on first use
+static Node copy_var(Func f, Node var, Node* from, Node* to, int* n) {
+  for (int i = 0; i < *n; i++) {
+    if (from[i] == var)
+      return to[i];
+  }
+  Node c = calloc(1, sizeof(struct node));
+  *c = *var;
+  c->next = f->node->locals;
+  f->node->locals = c;
+  from[*n] = var;
+  to[(*n)++] = c;
+  return c;
+}
+
+// Moves what follows the call to a new block, then copies the blocks of
+// g in between. The call becomes the phi of the values returned.
+static void inline_call(Func f, Inst call, Func g) {
+  Block b = call->block, after = new_block(f);
+  while (call->next) {
+    Inst v = call->next;
+    remove_inst(v);
+    append_inst(after, v);
+  }
+  remove_inst(call);
+  after->succ = b->succ;
+  after->nsucc = b->nsucc;
+  b->succ = NULL;
+  b->nsucc = 0;
+  for (int i = 0; i < after->nsucc; i++) {
+    Block s = after->succ[i];
+    for (int j = 0; j < s->npred; j++) {
+      if (s->pred[j] == b)
+        s->pred[j] = after;
+    }
+  }
+
+  Block* blocks = malloc(g->nblocks * sizeof(Block));
+  Inst* values = calloc(g->ninsts, sizeof(Inst));
+  int nvars = 0;
+  for (Node v = g->node->locals; v; v = v->next)
+    nvars++;
+  Node* from = malloc(nvars * sizeof(Node));
+  Node* to = malloc(nvars * sizeof(Node));
+  nvars = 0;
+
+  Block last = b;
+  for (Block gb = g->entry; gb; gb = gb->next) {
+    Block c = blocks[gb->id] = new_block(f);
+    c->next = last->next;
+    last->next = c;
+    last = c;
+  }
+  after->next = last->next;
+  last->next = after;
+  if (f->last == b)
+    f->last = after;
+
+  // the instructions first, the operands may be defined later
+  for (Block gb = g->entry; gb; gb = gb->next) {
+    for (Inst v = gb->first; v; v = v->next) {
+      if (v->op == IR_PARAM && v->var) {
+        Inst addr = new_inst(f, IR_ADDR, 8, 0);
+        addr->var = copy_var(f, v->var, from, to, &nvars);
+        append_inst(blocks[gb->id], addr);
+        Inst c = new_inst(f, IR_COPY, 0, 2);
+        c->args[0] = addr;
+        c->args[1] = call->args[v->imm];
+        c->imm = unqual(v->var->type)->size;
+        append_inst(blocks[gb->id], c);
+        continue;
+      }
+      if (v->op == IR_PARAM) {
+        values[v->id] = call->args[v->imm];
+        continue;
+      }
+      Inst c = new_inst(f, v->op, v->size, v->nargs);
+      c->imm = v->imm;
+      c->name = v->name;
+      c->is_volatile = v->is_volatile;
+      c->table = v->table;
+      c->arg_sizes = v->arg_sizes;
+      if (v->op == IR_ADDR && v->var->kind == A_VAR && !v->var->is_global)
+        c->var = copy_var(f, v->var, from, to, &nvars);
+      else if (v->op == IR_ADDR)
+        c->var = v->var;
+      append_inst(blocks[gb->id], c);
+      values[v->id] = c;
+    }
+  }
+
+  call->op = IR_PHI;
+  call->nargs = 0;
+  for (Block gb = g->entry; gb; gb = gb->next) {
+    Block c = blocks[gb->id];
+    for (Inst v = gb->first; v; v = v->next) {
+      for (int i = 0; v->op != IR_PARAM && i < v->nargs; i++)
+        values[v->id]->args[i] = values[v->args[i]->id];
+    }
+    c->npred = gb->npred;
+    c->pred = malloc(c->npred * sizeof(Block));
+    for (int i = 0; i < c->npred; i++)
+      c->pred[i] = blocks[gb->pred[i]->id];
+    c->nsucc = gb->nsucc;
+    c->succ = malloc(c->nsucc * sizeof(Block));
+    for (int i = 0; i < c->nsucc; i++)
+      c->succ[i] = blocks[gb->succ[i]->id];
+
+    // a return jumps to the rest of the caller with its value
+    Inst ret = c->last;
+    if (ret->op != IR_RET)
+      continue;
+    if (call->imm && ret->nargs && ret->args[0] != call->args[0]) {
+      Inst copy = new_inst(f, IR_COPY, 0, 2);
+      copy->args[0] = call->args[0];
+      copy->args[1] = ret->args[0];
+      copy->imm = call->imm;
+      insert_before(ret, copy);
+    }
+    if (call->size) {
+      Inst x = ret->nargs ? ret->args[0] : NULL;
+      if (!x) {  // falling off the end of a function returning a value
+        x = new_inst(f, IR_IMM, call->size, 0);
+        insert_before(ret, x);
+      }
+      call->args = realloc(call->args, (call->nargs + 1) * sizeof(Inst));
+      call->args[call->nargs++] = x;
+    }
+    ret->op = IR_JMP;
+    ret->nargs = 0;
+    add_edge(c, after);
+  }
+  if (call->size)
+    insert_before(after->first, call);
+
+  append_inst(b, new_inst(f, IR_JMP, 0, 0));
+  add_edge(b, blocks[g->entry->id]);
+
+  free(blocks);
+  free(values);
+  free(from);
+  free(to);
+}
+
+static void inline_calls(Func f) {
+  int n = 0;
+  Inst* calls = NULL;
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->op != IR_CALL || !may_inline(find_func(v->name), v))
+        continue;
+      calls = realloc(calls, (n + 1) * sizeof(Inst));
+      calls[n++] = v;
+    }
+  }
+  for (int i = 0; i < n && func_size(f) < MAX_CALLER_SIZE; i++)
+    inline_call(f, calls[i], find_func(calls[i]->name));
+  free(calls);
+}
+
+/******************************
+ *         pipeline           *
+ ******************************/
+
+static void optimize_func(Func f) {
+  f->state = OPTIMIZING;
+  for (Block b = f->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      Func g = v->op == IR_CALL ? find_func(v->name) : NULL;
+      if (g && g->state == NOT_OPTIMIZED)
+        optimize_func(g);
+    }
+  }
+
+  build_ssa(f);
+  inline_calls(f);
+  remove_tail_recursion(f);
+  sccp(f);
+  number_values(f);
+  hoist_invariants(f);
+  reduce_induction_vars(f);
+  remove_dead_stores(f);
+  remove_dead_code(f);
+  simplify_cfg(f);
+  convert_branches(f);
+  remove_dead_code(f);
+  verify_ir(f);
+  f->state = OPTIMIZED;
+}
+
+void optimize() {
+  index_funcs();
+  for (Func f = funcs; f; f = f->next) {
+    if (f->state == NOT_OPTIMIZED)
+      optimize_func(f);
+  }
+}
@@ -182,7 +182,7 @@ static Node mkunary(int kind, Node left, Token token) {
       return n;
     }
     errorat(n->token, "invalid operand of unary '*' (have '%s')",
-            left->type->str);
+            type_str(left->type));
   }
 
   // http://port70.net/~nsz/c/c99/n1256.html#6.5.3.3
@@ -193,7 +193,7 @@ static Node mkunary(int kind, Node left, Token token) {
       return n;
     }
     errorat(n->token, "invalid operand of unary +/- (have '%s')",
-            n->left->type->str);
+            type_str(n->left->type));
   }
   if (kind == A_B_NOT) {
     if (is_integer(n->left->type)) {
@@ -202,7 +202,7 @@ static Node mkunary(int kind, Node left, Token token) {
       return n;
     }
     errorat(n->token, "invalid operand of unary '~' (have '%s')",
-            n->left->type->str);
+            type_str(n->left->type));
   }
   if (kind == A_L_NOT) {
     if (is_scalar(n->left->type)) {
@@ -210,7 +210,7 @@ static Node mkunary(int kind, Node left, Token token) {
       return n;
     }
     errorat(n->token, "invalid operand of unary '!' (have '%s')",
-            n->left->type->str);
+            type_str(n->left->type));
   }
 
   // http://port70.net/~nsz/c/c99/n1256.html#6.5.2.4
@@ -219,7 +219,7 @@ static Node mkunary(int kind, Node left, Token token) {
       errorat(n->token, "invalid operand of postfix ++/-- (lvalue required)");
     if (!(is_arithmetic(n->left->type) || is_ptr(n->left->type)))
       errorat(n->token, "invalid operand of postfix ++/-- (have '%s')",
-              n->left->type->str);
+              type_str(n->left->type));
     n->left = mkcvs(unqual(n->left->type), left);
     n->type = n->left->type;
     return mkcvs(integral_promote(n->type), n);
@@ -234,6 +234,12 @@ static Node mkunary(int kind, Node left, Token token) {
   assert(0);
 }
 
+// void * has no pointed to type
+static int points_to_const(Type ptr) {
+  Type base = unqual(ptr)->base;
+  return base && is_const(base);
+}
+
 static Node mkbinary(int kind, Node left, Node right, Token token) {
   Node n = mknode(kind, token);
   n->left =
@@ -251,8 +257,8 @@ static Node mkbinary(int kind, Node left, Node right, Token token) {
       // http://port70.net/~nsz/c/c99/n1256.html#6.3.2.3p3
     } else if (is_ptr(n->left->type) && is_ptr(n->right->type)) {
       if (kind == A_ASSIGN) {
-        if (!is_const(deref_type(n->left->type)) &&
-            is_const(deref_type(n->right->type)))
+        if (!points_to_const(n->left->type) &&
+            points_to_const(n->right->type))
           errorat(n->token, "assign discards const");
       }
       if (!is_compatible_type(unqual(n->left->type), n->right->type))
@@ -267,10 +273,8 @@ static Node mkbinary(int kind, Node left, Node right, Token token) {
     n->type = unqual(n->left->type);
     n->right = mkcvs(n->type, n->right);
 
-    if (kind == A_INIT) {
-      n->kind = A_ASSIGN;
+    if (kind == A_INIT)
       n = mkaux(A_EXPR_STAT, n);
-    }
     return n;
   }
 
@@ -420,6 +424,14 @@ static Node mkternary(Node cond, Node left, Node right, Token token) {
     return n;
   }
 
+  if (is_struct_or_union(n->left->type) &&
+      is_struct_or_union(n->right->type)) {
+    if (!is_compatible_type(unqual(n->left->type), n->right->type))
+      errorat(n->token, "type mismatch in ternary");
+    n->type = unqual(n->left->type);
+    return n;
+  }
+
   assert(0);
 }
 
@@ -576,7 +588,8 @@ int list_length(Node head) {
 // enumerator_list:         enumerator { ','  enumerator }*
 // enumerator:              enumeration-constant { '=' expression }?
 // enumeration-constant:    identifier
-// init_declarator:         declarator { '=' expression }? -> func_def
+// init_declarator:         declarator { '=' initializer }? -> func_def
+// initializer:             expression | '{' { '0' { ',' }? }? '}'
 // declarator:              pointer? direct_declarator suffix_declarator*
 // pointer:                 { '*' { type_qualifier }* }*
 // direct_declarator:       '(' declarator ')' |  identifier | Empty
@@ -587,35 +600,35 @@ int list_length(Node head) {
 // parameter_declaration:   declaration_specifiers declarator
 // type_name:               declaration_specifiers declarator
 // =======================   Statement   =======================
-// statement:      expr_stat | comp_stat
+// statement:      expr_stat | comp_stat | labeled_stat
 //                 selection-stat | iteration-stat | jump_stat
-// selection-stat: if_stat
+// selection-stat: if_stat | switch_stat
 // if_stat:        'if' '('  expr_stat ')' statement { 'else' statement }
+// switch_stat:    'switch' '(' expression ')' statement
+// labeled_stat:   'case' conditional_expr ':' statement |
+//                 'default' ':' statement | identifier ':' statement
 // iteration-stat: while_stat | dowhile_stat | for_stat
 // while_stat:     'while' '(' expr_stat ')' statement
 // dowhile_stat:   'do' statement 'while' '(' expression ')' ';'
 // for_stat:       'for' '(' {expression}; {expression}; {expression}')'
 //                 statement
-// jump_stat:      break ';' | continue ';' | 'return' expression? ';'
+// jump_stat:      'goto' identifier ';' | 'goto' '*' expression ';' |
+//                 break ';' | continue ';' | 'return' expression? ';'
 // comp_stat:      '{' {declaration}* {stat}* '}'
 // expr_stat:      {expression}? ';'
 // =======================   Expression   =======================
 // expression:         comma_expr
 // comma_expr:         assign_expr { ', ' assign_expr }*
 // assign_expr:        conditional_expr { '=' assign_expr }
-// conditional_expr:   logical_or_expr { '?' expression : conditional_expr }?
-// logical_or_expr:    logical_and_expr { '||' logical_and_expr }*
-// logical_and_expr:   equality_expr { '&&' inclusive_or_expr }*
-// inclusive_or_expr:  exclusive_or_expr { '|' exclusive_or_expr }*
-// exclusive_or_expr:  bitwise_and_expr { '^' bitwise_and_expr }*
-// bitwise_and_expr:   equality_expr { '&' equality_expr}*
-// equality_expr:      relational_expr { '==' | '!='  relational_expr }*
-// relational_expr:    sum_expr { '>' | '<' | '>=' | '<=' shift_expr}*
-// shift_expr:         sum_expr { '<<' | '>>' sum_expr }*
-// sum_expr:           mul_expr { '+'|'-' mul_expr }*
-// mul_expr:           cast_expr { '*'|'/' | '%' cast_expr }*
+// conditional_expr:   binary_expr { '?' expression : conditional_expr }?
+// binary_expr:        cast_expr { binary_operator cast_expr }*
+//                     (by precedence climbing, see binary_precedence)
+// binary_operator:    '||' | '&&' | '|' | '^' | '&' | '==' | '!=' |
+//                     '>' | '<' | '>=' | '<=' | '<<' | '>>' |
+//                     '+' | '-' | '*' | '/' | '%'
 // cast_expr:          {'(' type-name ')'}* unary_expr
 // unary_expr:         { {'*'|'&'|'+'|'-'|'~'|'!'|'} cast_expr |
+//                       '&&' identifier |
 //                       {'++' |  '--' } * postfix_expr |
 //                       sizeof '(' type_name ')' |
 //                       sizeof unary_expr }
@@ -641,6 +654,8 @@ static Node function(Node f);
 static Node statement(int reuse_scope);
 static Node comp_stat(int reuse_scope);
 static Node if_stat();
+static Node switch_stat();
+static Node labeled_stat();
 static Node while_stat();
 static Node dowhile_stat();
 static Node for_stat();
@@ -649,16 +664,7 @@ static Node expression();
 static Node comma_expr();
 static Node assign_expr();
 static Node conditional_expr();
-static Node logical_or_expr();
-static Node logical_and_expr();
-static Node inclusive_or_expr();
-static Node exclusive_or_expr();
-static Node bitwise_and_expr();
-static Node eq_expr();
-static Node rel_expr();
-static Node shift_expr();
-static Node sum_expr();
-static Node mul_expr();
+static Node binary_expr(int prec);
 static Node cast_expr();
 static Node unary_expr();
 static Node postfix_expr();
@@ -877,7 +883,8 @@ static Type declaration_specifiers(int* is_typedef) {
   if (!ty)
     errorat(token(), "no data type in declaration specifiers");
 
-  // cache nothing in register, so all variable is VOLATILE?
+  if (get_specifier(specifiers, SPEC_VOLATILE))
+    ty = volatile_type(ty);
   if (get_specifier(specifiers, SPEC_CONST))
     ty = const_type(ty);
   if (get_specifier(specifiers, SPEC_RESTRICT))
@@ -893,18 +900,10 @@ static Member mkmember(Type type, Token tok) {
   return p;
 }
 
-static void link_member(Member head, Member m) {
-  while (head->next) {
-    if (m->name && head->next->name == m->name)
-      errorat(token(), "redefinition of member %s", m->name);
-    head = head->next;
-  }
-  head->next = m;
-}
-
 static Member struct_declaration_list() {
   Token tok;
   struct member head = {0};
+  Member last = &head;
   if (consume(TK_OPENING_BRACES)) {
     while (!(tok = consume(TK_CLOSING_BRACES))) {
       Type ty = declaration_specifiers(NULL);
@@ -912,14 +911,14 @@ static Member struct_declaration_list() {
       Type mem_ty = declarator(ty, &mem_name);
       if (!mem_name)
         errorat(token(), "empty member name");
-      link_member(&head, mkmember(mem_ty, mem_name));
+      last = last->next = mkmember(mem_ty, mem_name);
       while (!consume(TK_SIMI)) {
         expect(TK_COMMA);
         mem_name = NULL;
         mem_ty = declarator(ty, &mem_name);
         if (!mem_name)
           errorat(token(), "empty member name");
-        link_member(&head, mkmember(mem_ty, mem_name));
+        last = last->next = mkmember(mem_ty, mem_name);
       }
     }
 
@@ -986,6 +985,32 @@ static Type enum_specifier() {
   return find_tag(tok, TY_ENUM)->type;
 }
 
+// '{' { '0' { ',' }? }? '}' zeroes an array, struct or union, a global
+// one is zero already
+static Node zero_initializer(Node var) {
+  Token tok = expect(TK_OPENING_BRACES);
+  if (!is_array(var->type) && !is_struct_or_union(var->type))
+    errorat(tok, "not implemented: initializer list for scalar");
+  if (!match(TK_CLOSING_BRACES)) {
+    Node e = assign_expr();
+    if (e->kind != A_NUM || e->intvalue != 0)
+      errorat(e->token, "not implemented: initializer list other than {0}");
+    if (consume(TK_COMMA) && !match(TK_CLOSING_BRACES))
+      errorat(token(), "not implemented: initializer list other than {0}");
+    // an array of unknown size gets the one element initialized
+    if (is_array(var->type) && !unqual(var->type)->size)
+      var->type = array_type(unqual(var->type)->base, 1);
+  }
+  expect(TK_CLOSING_BRACES);
+  if (is_array(var->type) && !unqual(var->type)->size)
+    errorat(tok, "zero size array");
+  if (!current_func)
+    return NULL;
+  Node n = mkaux(A_ZERO_INIT, var);
+  n->token = tok;
+  return n;
+}
+
 // returned value for different kind of declarotor
 //    function:        function node in global
 //    local variable:  nodes for init assign
@@ -1006,6 +1031,8 @@ static Node init_declarator(Type ty, int is_typedef) {
 
   Node n = mkvar(tok, ty);
   if ((tok = consume(TK_EQUAL))) {
+    if (match(TK_OPENING_BRACES))
+      return zero_initializer(n);
     Node e = assign_expr();
     if (is_array(ty))
       errorat(n->token, "not implemented: initialize array");
@@ -1020,7 +1047,7 @@ static Node init_declarator(Type ty, int is_typedef) {
 }
 
 static Type placeholdertype =
-    &(struct type){TY_PLACEHOLDER, -1, NULL, "placeholder"};
+    &(struct type){TY_PLACEHOLDER, -1, 1, NULL, "placeholder"};
 
 // replace placeholder type by real base type
 static Type construct_type(Type base, Type ty) {
@@ -1063,17 +1090,19 @@ static Type pointer(Type ty) {
   Token tok;
   while (consume(TK_STAR)) {
     ty = ptr_type(ty);
-    int q_const = 0, q_restrict = 0;
+    int q_const = 0, q_volatile = 0, q_restrict = 0;
     for (;;) {
       if ((tok = consume(TK_CONST)))
         q_const = 1;
       else if ((tok = consume(TK_VOLATILE)))
-        ;
+        q_volatile = 1;
       else if ((tok = consume(TK_RESTRICT)))
         q_restrict = 1;
       else {
         if (q_restrict)
           errorat(tok, "not implemented: restrict pointer");
+        if (q_volatile)
+          ty = volatile_type(ty);
         if (q_const)
           ty = const_type(ty);
         break;
@@ -1173,6 +1202,30 @@ static Type type_name() {
   return ty;
 }
 
+// the gotos and label addresses of the function being parsed, they may
+// refer to labels further down
+static Node label_refs;
+
+static void refer_label(Node n) {
+  if (!current_func)
+    errorat(n->token, "label address outside a function");
+  n->label_next = label_refs;
+  label_refs = n;
+}
+
+static void resolve_labels(Node f) {
+  for (Node n = label_refs; n; n = n->label_next) {
+    n->ref = f->labels;
+    while (n->ref && n->ref->name != n->name)
+      n->ref = n->ref->label_next;
+    if (!n->ref)
+      errorat(n->token, "label %s used but not defined", n->name);
+    if (n->kind == A_LABEL_ADDRESS)
+      n->ref->address_taken = 1;
+  }
+  label_refs = NULL;
+}
+
 static Node function(Node f) {
   // TODO: how can we get previous definition
   if (f->body)
@@ -1193,12 +1246,17 @@ static Node function(Node f) {
     }
 
   f->body = comp_stat(1);
+  resolve_labels(f);
 
   exit_func(f);
   exit_scope();
   return NULL;
 }
 
+// innermost switch statement, the case labels are linked to it
+static Node current_switch;
+static int loops;  // enclosing the statement parsed
+
 static Node statement(int reuse_scope) {
   Token tok;
 
@@ -1212,6 +1270,17 @@ static Node statement(int reuse_scope) {
     return if_stat();
   }
 
+  // switch statement
+  if (match(TK_SWITCH)) {
+    return switch_stat();
+  }
+
+  // labeled statement
+  if (match(TK_CASE) || match(TK_DEFAULT) ||
+      (match(TK_IDENT) && token()->next && token()->next->kind == TK_COLON)) {
+    return labeled_stat();
+  }
+
   // while statement
   if (match(TK_WHILE)) {
     return while_stat();
@@ -1228,11 +1297,28 @@ static Node statement(int reuse_scope) {
   }
 
   // jump_stat
+  if ((tok = consume(TK_GOTO))) {
+    Node n = mknode(A_GOTO, tok);
+    if (consume(TK_STAR)) {
+      n->body = unqual_array_to_ptr(expression());
+      if (!is_ptr(n->body->type))
+        errorat(tok, "computed goto needs a pointer");
+    } else {
+      n->name = expect(TK_IDENT)->name;
+      refer_label(n);
+    }
+    expect(TK_SIMI);
+    return n;
+  }
   if ((tok = consume(TK_BREAK))) {
+    if (!loops && !current_switch)
+      errorat(tok, "break statement not within loop or switch");
     expect(TK_SIMI);
     return mknode(A_BREAK, tok);
   }
   if ((tok = consume(TK_CONTINUE))) {
+    if (!loops)
+      errorat(tok, "continue statement not within a loop");
     expect(TK_SIMI);
     return mknode(A_CONTINUE, tok);
   }
@@ -1281,18 +1367,196 @@ static Node if_stat() {
   return n;
 }
 
+static Node switch_stat() {
+  Node n = mknode(A_SWITCH, expect(TK_SWITCH));
+  expect(TK_OPENING_PARENTHESES);
+  n->cond = expression();
+  expect(TK_CLOSING_PARENTHESES);
+  if (!is_integer(n->cond->type))
+    errorat(n->token, "switch quantity not an integer");
+  n->cond = mkcvs(integral_promote(n->cond->type), n->cond);
+
+  Node outer = current_switch;
+  current_switch = n;
+  n->body = statement(0);
+  current_switch = outer;
+  return n;
+}
+
+// v converted to the integer type ty
+static unsigned long long convert_value(unsigned long long v, Type ty) {
+  int bits = unqual(ty)->size * 8;
+  if (bits == 64)
+    return v;
+  v &= (1ULL << bits) - 1;
+  if (is_signed(ty) && v >> (bits - 1))
+    v |= ~0ULL << bits;
+  return v;
+}
+
+// http://port70.net/~nsz/c/c99/n1256.html#6.6p6
+static unsigned long long case_value(Node n, Token label) {
+  unsigned long long l, r;
+  switch (n->kind) {
+    case A_NUM:
+      return n->intvalue;
+    case A_IDENT:
+      if (n->ref->kind == A_ENUM_CONST)
+        return n->ref->intvalue;
+      break;
+    case A_CONVERSION:
+      return convert_value(case_value(n->body, label), n->type);
+    case A_PLUS:
+      return case_value(n->left, label);
+    case A_MINUS:
+      return convert_value(-case_value(n->left, label), n->type);
+    case A_B_NOT:
+      return convert_value(~case_value(n->left, label), n->type);
+    case A_L_NOT:
+      return !case_value(n->left, label);
+    case A_L_AND:
+      return case_value(n->left, label) && case_value(n->right, label);
+    case A_L_OR:
+      return case_value(n->left, label) || case_value(n->right, label);
+    case A_TERNARY:
+      return convert_value(case_value(n->cond, label)
+                               ? case_value(n->left, label)
+                               : case_value(n->right, label),
+                           n->type);
+    case A_DIV:
+    case A_MOD:
+      l = case_value(n->left, label);
+      r = case_value(n->right, label);
+      if (!r)
+        errorat(n->token, "division by zero in case label");
+      // the quotient of the most negative value by -1 wraps
+      if (is_signed(n->type) && r == ~0ULL)
+        l = n->kind == A_DIV ? -l : 0;
+      else if (is_signed(n->type) && n->kind == A_DIV)
+        l = (long long)l / (long long)r;
+      else if (is_signed(n->type))
+        l = (long long)l % (long long)r;
+      else if (n->kind == A_DIV)
+        l /= r;
+      else
+        l %= r;
+      return convert_value(l, n->type);
+    case A_EQ:
+    case A_NE:
+    case A_LT:
+    case A_GT:
+    case A_LE:
+    case A_GE:
+      l = case_value(n->left, label);
+      r = case_value(n->right, label);
+      if (n->kind == A_EQ)
+        return l == r;
+      if (n->kind == A_NE)
+        return l != r;
+      // the operands have their common type
+      if (is_signed(n->left->type)) {
+        l ^= 1ULL << 63;
+        r ^= 1ULL << 63;
+      }
+      if (n->kind == A_LT)
+        return l < r;
+      if (n->kind == A_GT)
+        return l > r;
+      if (n->kind == A_LE)
+        return l <= r;
+      return l >= r;
+    case A_ADD:
+    case A_SUB:
+    case A_MUL:
+    case A_LEFT_SHIFT:
+    case A_RIGHT_SHIFT:
+    case A_B_AND:
+    case A_B_EXCLUSIVEOR:
+    case A_B_INCLUSIVEOR:
+      l = case_value(n->left, label);
+      r = case_value(n->right, label);
+      if (n->kind == A_ADD)
+        l += r;
+      else if (n->kind == A_SUB)
+        l -= r;
+      else if (n->kind == A_MUL)
+        l *= r;
+      else if (n->kind == A_LEFT_SHIFT)
+        l <<= r & 63;
+      else if (n->kind == A_RIGHT_SHIFT && is_signed(n->type))
+        l = (long long)l >> (r & 63);
+      else if (n->kind == A_RIGHT_SHIFT)
+        l >>= r & 63;
+      else if (n->kind == A_B_AND)
+        l &= r;
+      else if (n->kind == A_B_EXCLUSIVEOR)
+        l ^= r;
+      else
+        l |= r;
+      return convert_value(l, n->type);
+  }
+  errorat(label, "case label is not an integer constant");
+  assert(0);
+}
+
+static Node labeled_stat() {
+  Token tok = consume(TK_IDENT);
+  if (tok) {
+    for (Node l = current_func->labels; l; l = l->label_next) {
+      if (l->name == tok->name) {
+        infoat(l->token, "previous:");
+        errorat(tok, "duplicate label %s", tok->name);
+      }
+    }
+    Node n = mknode(A_LABEL, tok);
+    n->name = tok->name;
+    n->label_next = current_func->labels;
+    current_func->labels = n;
+    expect(TK_COLON);
+    n->body = statement(0);
+    return n;
+  }
+
+  tok = consume(TK_CASE);
+  Node n = mknode(tok ? A_CASE : A_DEFAULT, tok ? tok : expect(TK_DEFAULT));
+  if (!current_switch)
+    errorat(n->token, "label not within a switch statement");
+  if (tok) {
+    Node value = conditional_expr();
+    n->intvalue =
+        convert_value(case_value(value, tok), current_switch->cond->type);
+  }
+  expect(TK_COLON);
+
+  for (Node c = current_switch->cases; n->kind == A_DEFAULT && c;
+       c = c->cases) {
+    if (c->kind == A_DEFAULT) {
+      infoat(c->token, "previous:");
+      errorat(n->token, "multiple default labels in one switch");
+    }
+  }
+  n->cases = current_switch->cases;
+  current_switch->cases = n;
+  n->body = statement(0);
+  return n;
+}
+
 static Node while_stat() {
   Node n = mknode(A_FOR, expect(TK_WHILE));
   expect(TK_OPENING_PARENTHESES);
   n->cond = expression();
   expect(TK_CLOSING_PARENTHESES);
+  loops++;
   n->body = statement(0);
+  loops--;
   return n;
 }
 
 static Node dowhile_stat() {
   Node n = mknode(A_DOWHILE, expect(TK_DO));
+  loops++;
   n->body = statement(0);
+  loops--;
   expect(TK_WHILE);
   expect(TK_OPENING_PARENTHESES);
   n->cond = expression();
@@ -1317,7 +1581,9 @@ static Node for_stat() {
     n->post = mkaux(A_EXPR_STAT, expression());
     expect(TK_CLOSING_PARENTHESES);
   }
+  loops++;
   n->body = statement(1);
+  loops--;
   exit_scope();
   return n;
 }
@@ -1381,9 +1647,54 @@ static Node assign_expr() {
   }
 }
 
+// ast kind of binary operator tokens
+static const int binary_operator[TK_STRING + 1] = {
+    [TK_BAR_BAR] = A_L_OR,
+    [TK_AND_AND] = A_L_AND,
+    [TK_BAR] = A_B_INCLUSIVEOR,
+    [TK_CARET] = A_B_EXCLUSIVEOR,
+    [TK_AND] = A_B_AND,
+    [TK_EQUAL_EQUAL] = A_EQ,
+    [TK_NOT_EQUAL] = A_NE,
+    [TK_LESS] = A_LT,
+    [TK_GREATER] = A_GT,
+    [TK_LESS_EQUAL] = A_LE,
+    [TK_GREATER_EQUAL] = A_GE,
+    [TK_LEFT_SHIFT] = A_LEFT_SHIFT,
+    [TK_RIGHT_SHIFT] = A_RIGHT_SHIFT,
+    [TK_PLUS] = A_ADD,
+    [TK_MINUS] = A_SUB,
+    [TK_STAR] = A_MUL,
+    [TK_SLASH] = A_DIV,
+    [TK_PERCENT] = A_MOD,
+};
+
+// precedence of binary operators, smaller binds tighter. all of them are left
+// associative. the numbers follow the grouping of the A_* kinds.
+static const int binary_precedence[] = {
+    [A_L_OR] = 15,
+    [A_L_AND] = 14,
+    [A_B_INCLUSIVEOR] = 13,
+    [A_B_EXCLUSIVEOR] = 12,
+    [A_B_AND] = 11,
+    [A_EQ] = 10,
+    [A_NE] = 10,
+    [A_LT] = 9,
+    [A_GT] = 9,
+    [A_LE] = 9,
+    [A_GE] = 9,
+    [A_LEFT_SHIFT] = 7,
+    [A_RIGHT_SHIFT] = 7,
+    [A_ADD] = 6,
+    [A_SUB] = 6,
+    [A_MUL] = 5,
+    [A_DIV] = 5,
+    [A_MOD] = 5,
+};
+
 static Node conditional_expr() {
   Token tok;
-  Node n = logical_or_expr();
+  Node n = binary_expr(binary_precedence[A_L_OR]);
   if ((tok = consume(TK_QUESTIONMARK))) {
     Node e = expression();
     expect(TK_COLON);
@@ -1392,129 +1703,19 @@ static Node conditional_expr() {
   return n;
 }
 
-static Node logical_or_expr() {
-  Token tok;
-  Node n = logical_and_expr();
-  for (;;) {
-    if ((tok = consume(TK_BAR_BAR)))
-      n = mkbinary(A_L_OR, n, logical_and_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node logical_and_expr() {
-  Token tok;
-  Node n = inclusive_or_expr();
-  for (;;) {
-    if ((tok = consume(TK_AND_AND)))
-      n = mkbinary(A_L_AND, n, inclusive_or_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node inclusive_or_expr() {
-  Token tok;
-  Node n = exclusive_or_expr();
-  for (;;) {
-    if ((tok = consume(TK_BAR)))
-      n = mkbinary(A_B_INCLUSIVEOR, n, exclusive_or_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node exclusive_or_expr() {
-  Token tok;
-  Node n = bitwise_and_expr();
-  for (;;) {
-    if ((tok = consume(TK_CARET)))
-      n = mkbinary(A_B_EXCLUSIVEOR, n, bitwise_and_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node bitwise_and_expr() {
-  Token tok;
-  Node n = eq_expr();
-  for (;;) {
-    if ((tok = consume(TK_AND)))
-      n = mkbinary(A_B_AND, n, eq_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node eq_expr() {
-  Token tok;
-  Node n = rel_expr();
-  for (;;) {
-    if ((tok = consume(TK_EQUAL_EQUAL)))
-      n = mkbinary(A_EQ, n, rel_expr(), tok);
-    else if ((tok = consume(TK_NOT_EQUAL)))
-      n = mkbinary(A_NE, n, rel_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node rel_expr() {
-  Token tok;
-  Node n = shift_expr();
-  for (;;) {
-    if ((tok = consume(TK_GREATER)))
-      n = mkbinary(A_GT, n, shift_expr(), tok);
-    else if ((tok = consume(TK_LESS)))
-      n = mkbinary(A_LT, n, shift_expr(), tok);
-    else if ((tok = consume(TK_GREATER_EQUAL)))
-      n = mkbinary(A_GE, n, shift_expr(), tok);
-    else if ((tok = consume(TK_LESS_EQUAL)))
-      n = mkbinary(A_LE, n, shift_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node shift_expr() {
-  Token tok;
-  Node n = sum_expr();
-  for (;;) {
-    if ((tok = consume(TK_LEFT_SHIFT)))
-      n = mkbinary(A_LEFT_SHIFT, n, sum_expr(), tok);
-    else if ((tok = consume(TK_RIGHT_SHIFT)))
-      n = mkbinary(A_RIGHT_SHIFT, n, sum_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node sum_expr() {
-  Token tok;
-  Node n = mul_expr();
-  for (;;) {
-    if ((tok = consume(TK_PLUS)))
-      n = mkbinary(A_ADD, n, mul_expr(), tok);
-    else if ((tok = consume(TK_MINUS)))
-      n = mkbinary(A_SUB, n, mul_expr(), tok);
-    else
-      return n;
-  }
-}
-
-static Node mul_expr() {
-  Token tok;
+// parse operands joined by binary operators with precedence not looser than
+// prec. the right operand only takes operators binding tighter than its
+// operator, so a chain of the same level is built by the loop from left to
+// right.
+static Node binary_expr(int prec) {
   Node n = cast_expr();
   for (;;) {
-    if ((tok = consume(TK_STAR)))
-      n = mkbinary(A_MUL, n, cast_expr(), tok);
-    else if ((tok = consume(TK_SLASH)))
-      n = mkbinary(A_DIV, n, cast_expr(), tok);
-    else if ((tok = consume(TK_PERCENT)))
-      n = mkbinary(A_MOD, n, cast_expr(), tok);
-    else
+    Token tok = token();
+    int kind = binary_operator[tok->kind];
+    if (!kind || binary_precedence[kind] > prec)
       return n;
+    expect(tok->kind);
+    n = mkbinary(kind, n, binary_expr(binary_precedence[kind] - 1), tok);
   }
 }
 
@@ -1554,6 +1755,13 @@ static Node unary_expr() {
     Node u = unary_expr();
     return mkbinary(A_ASSIGN, u, mkbinary(A_SUB, u, mkicons(1), NULL), tok);
   }
+  if ((tok = consume(TK_AND_AND))) {
+    Node n = mknode(A_LABEL_ADDRESS, tok);
+    n->name = expect(TK_IDENT)->name;
+    n->type = ptr_type(voidtype);
+    refer_label(n);
+    return n;
+  }
   if ((tok = consume(TK_SIZEOF))) {
     Token back = token();
     if (consume(TK_OPENING_PARENTHESES) && match_specifier_typedef()) {
@@ -1652,8 +1860,7 @@ static Node func_call(Node n) {
       } else if (is_ptr(param->type) && arg->kind == A_NUM &&
                  arg->intvalue == 0) {
       } else if (is_ptr(param->type) && is_ptr(arg->type)) {
-        if (!is_const(deref_type(param->type)) &&
-            is_const(deref_type(arg->type))) {
+        if (!points_to_const(param->type) && points_to_const(arg->type)) {
           infoat(param->token, "paramenter declared:");
           errorat(arg->token, "function call discards const");
         }
@@ -1731,7 +1938,11 @@ static Node member_selection(Node n) {
   s->member = get_struct_or_union_member(n->type, tok->name);
   if (!s->member)
     errorat(tok, "struct/union has no wanted member");
-  s->type = is_const(n->type) ? const_type(s->member->type) : s->member->type;
+  s->type = s->member->type;
+  if (is_volatile(n->type))
+    s->type = volatile_type(s->type);
+  if (is_const(n->type))
+    s->type = const_type(s->type);
 
   return s;
 }
@@ -0,0 +1,363 @@
+#include "inc.h"
+
+// SSA construction promotes the local variables whose address doesn't
+// escape, it's only used to load and store them, to virtual registers.
+// Phis are placed at the iterated dominance frontiers of the blocks that
+// store to a variable (Cytron et al.), a variable that would need one
+// where an indirect jump enters stays in memory. Then a walk over the
+// dominator tree replaces each load with the value the variable has at
+// that point, and drops the stores.
+
+static Func fn;
+
+static Node* vars;     // local variables, by index
+static int* promoted;  // whether a variable is promoted, by index
+static int* var_of;    // index of the variable an IR_ADDR refers to, by id
+
+static int collect_vars() {
+  int nvars = 0;
+  for (Node v = fn->node->locals; v; v = v->next)
+    nvars += v->kind == A_VAR;
+  vars = realloc(vars, nvars * sizeof(Node));
+  promoted = realloc(promoted, nvars * sizeof(int));
+
+  int k = 0;
+  for (Node v = fn->node->locals; v; v = v->next) {
+    if (v->kind != A_VAR)
+      continue;
+    Type ty = unqual(v->type);
+    v->var_index = k;
+    vars[k] = v;
+    promoted[k++] = is_scalar(ty) && !is_array(ty) && !is_volatile(v->type);
+  }
+  return nvars;
+}
+
+// the variable whose address is v, if it may be promoted
+static int promoted_var(Inst v) {
+  if (v->op != IR_ADDR)  // phis and undefs come after var_of is built
+    return -1;
+  int k = var_of[v->id];
+  return k >= 0 && promoted[k] ? k : -1;
+}
+
+// A variable stays in memory if its address is used for anything else
+// than loading or storing the whole variable.
+static void find_promoted() {
+  var_of = realloc(var_of, fn->ninsts * sizeof(int));
+  for (Block b = fn->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      var_of[v->id] = -1;
+      if (v->op == IR_ADDR && v->var->kind == A_VAR && !v->var->is_global)
+        var_of[v->id] = v->var->var_index;
+    }
+  }
+
+  for (Block b = fn->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      for (int i = 0; i < v->nargs; i++) {
+        int k = var_of[v->args[i]->id];
+        if (k < 0)
+          continue;
+        int size = unqual(vars[k]->type)->size;
+        if (v->op == IR_LOAD && v->size == size)
+          continue;
+        if (v->op == IR_STORE && i == 0 && v->args[1]->size == size)
+          continue;
+        promoted[k] = 0;
+      }
+    }
+  }
+}
+
+/******************************
+ *       phi placement        *
+ ******************************/
+
+static Block** df;  // dominance frontier, by block id
+static int* ndf;
+
+// b is in the frontier of the blocks that dominate one of its
+// predecessors, but not b itself.
+static void compute_frontiers() {
+  df = calloc(fn->nblocks, sizeof(Block*));
+  ndf = calloc(fn->nblocks, sizeof(int));
+  for (int i = 0; i < fn->nrpo; i++) {
+    Block b = fn->rpo[i];
+    if (b->npred < 2)
+      continue;
+    for (int j = 0; j < b->npred; j++) {
+      for (Block r = b->pred[j]; r != b->idom; r = r->idom) {
+        int n = ndf[r->id];
+        if (n && df[r->id][n - 1] == b)  // added for another predecessor
+          continue;
+        df[r->id] = realloc(df[r->id], (n + 1) * sizeof(Block));
+        df[r->id][ndf[r->id]++] = b;
+      }
+    }
+  }
+}
+
+static void place_phis(int nvars) {
+  // blocks storing to each variable
+  int* start = calloc(nvars + 1, sizeof(int));
+  for (Block b = fn->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      int k;
+      if (v->op == IR_STORE && (k = promoted_var(v->args[0])) >= 0)
+        start[k + 1]++;
+    }
+  }
+  for (int k = 0; k < nvars; k++)
+    start[k + 1] += start[k];
+  Block* defs = malloc(start[nvars] * sizeof(Block));
+  int* fill = malloc(nvars * sizeof(int));
+  memcpy(fill, start, nvars * sizeof(int));
+  for (Block b = fn->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      int k;
+      if (v->op == IR_STORE && (k = promoted_var(v->args[0])) >= 0)
+        defs[fill[k]++] = b;
+    }
+  }
+
+  // stamps of the last variable that placed a phi in or queued a block
+  int* has_phi = calloc(fn->nblocks, sizeof(int));
+  int* queued = calloc(fn->nblocks, sizeof(int));
+  Block* work = malloc(fn->nblocks * sizeof(Block));
+  for (int k = 0; k < nvars; k++) {
+    int n = 0;
+    for (int i = start[k]; i < start[k + 1]; i++) {
+      if (queued[defs[i]->id] != k + 1) {
+        queued[defs[i]->id] = k + 1;
+        work[n++] = defs[i];
+      }
+    }
+    while (n) {
+      Block x = work[--n];
+      for (int i = 0; i < ndf[x->id]; i++) {
+        Block y = df[x->id][i];
+        if (has_phi[y->id] == k + 1)
+          continue;
+        has_phi[y->id] = k + 1;
+        if (has_indirect_pred(y))
+          promoted[k] = 0;
+        Inst phi = new_inst(fn, IR_PHI, unqual(vars[k]->type)->size, y->npred);
+        phi->var = vars[k];
+        insert_before(y->first, phi);
+        if (queued[y->id] != k + 1) {
+          queued[y->id] = k + 1;
+          work[n++] = y;
+        }
+      }
+    }
+  }
+
+  for (Block b = fn->entry; b; b = b->next) {
+    Inst next;
+    for (Inst v = b->first; v && v->op == IR_PHI; v = next) {
+      next = v->next;
+      if (!promoted[v->var->var_index])
+        remove_inst(v);
+    }
+  }
+
+  free(start);
+  free(defs);
+  free(fill);
+  free(has_phi);
+  free(queued);
+  free(work);
+  for (int i = 0; i < fn->nblocks; i++)
+    free(df[i]);
+  free(df);
+  free(ndf);
+}
+
+/******************************
+ *          renaming          *
+ ******************************/
+
+static Inst* current;  // value of each variable, by index
+static Inst* undef;    // value of a variable read before it's set
+static Inst* map;      // value replacing a load, by id
+
+static Inst value_of(int k) {
+  if (current[k])
+    return current[k];
+  if (!undef[k]) {
+    undef[k] = new_inst(fn, IR_IMM, unqual(vars[k]->type)->size, 0);
+    insert_before(fn->entry->first, undef[k]);
+  }
+  return undef[k];
+}
+
+// values replaced in the block, to restore them once the walk leaves it
+static int* log_var;
+static Inst* log_value;
+static int nlog, log_cap;
+
+static void set_value(int k, Inst v) {
+  if (nlog == log_cap) {
+    log_cap = log_cap ? log_cap * 2 : 64;
+    log_var = realloc(log_var, log_cap * sizeof(int));
+    log_value = realloc(log_value, log_cap * sizeof(Inst));
+  }
+  log_var[nlog] = k;
+  log_value[nlog++] = current[k];
+  current[k] = v;
+}
+
+static void rename_block(Block b) {
+  Inst next;
+  for (Inst v = b->first; v; v = next) {
+    int k;
+    next = v->next;
+    if (v->op == IR_PHI) {
+      set_value(v->var->var_index, v);
+      continue;
+    }
+
+    for (int i = 0; i < v->nargs; i++) {
+      if (map[v->args[i]->id])
+        v->args[i] = map[v->args[i]->id];
+    }
+    if (v->op == IR_LOAD && (k = promoted_var(v->args[0])) >= 0) {
+      map[v->id] = value_of(k);
+      remove_inst(v);
+    } else if (v->op == IR_STORE && (k = promoted_var(v->args[0])) >= 0) {
+      set_value(k, v->args[1]);
+      remove_inst(v);
+    }
+  }
+
+  for (int i = 0; i < b->nsucc; i++) {
+    Block s = b->succ[i];
+    for (int j = 0; j < s->npred; j++) {
+      if (s->pred[j] != b)
+        continue;
+      for (Inst phi = s->first; phi->op == IR_PHI; phi = phi->next)
+        phi->args[j] = value_of(phi->var->var_index);
+    }
+  }
+}
+
+// walk the dominator tree, with an explicit stack
+static void rename_vars(int nvars) {
+  Block* stack = malloc(fn->nrpo * sizeof(Block));
+  int* mark = malloc(fn->nrpo * sizeof(int));  // log size at entry, or -1
+  int n = 0;
+
+  current = calloc(nvars, sizeof(Inst));
+  undef = calloc(nvars, sizeof(Inst));
+  map = calloc(fn->ninsts + nvars, sizeof(Inst));  // undefs come later
+  nlog = 0;
+
+  stack[n] = fn->entry;
+  mark[n++] = -1;
+  while (n) {
+    Block b = stack[n - 1];
+    if (mark[n - 1] < 0) {
+      mark[n - 1] = nlog;
+      rename_block(b);
+      for (Block c = b->dom_child; c; c = c->dom_sibling) {
+        stack[n] = c;
+        mark[n++] = -1;
+      }
+      continue;
+    }
+    for (; nlog > mark[n - 1]; nlog--)
+      current[log_var[nlog - 1]] = log_value[nlog - 1];
+    n--;
+  }
+
+  free(stack);
+  free(mark);
+  free(current);
+  free(undef);
+  free(map);
+}
+
+/******************************
+ *          cleanup           *
+ ******************************/
+
+// The phis placed at the frontier may merge a variable that isn't read
+// afterwards. A phi is kept only if a non-phi instruction uses it, maybe
+// through other phis.
+static void remove_dead_phis() {
+  char* live = calloc(fn->ninsts, 1);
+  Inst* work = malloc(fn->ninsts * sizeof(Inst));
+  int n = 0;
+
+  for (Block b = fn->entry; b; b = b->next) {
+    for (Inst v = b->first; v; v = v->next) {
+      if (v->op == IR_PHI)
+        continue;
+      for (int i = 0; i < v->nargs; i++) {
+        Inst a = v->args[i];
+        if (a->op == IR_PHI && !live[a->id]) {
+          live[a->id] = 1;
+          work[n++] = a;
+        }
+      }
+    }
+  }
+  while (n) {
+    Inst v = work[--n];
+    for (int i = 0; i < v->nargs; i++) {
+      Inst a = v->args[i];
+      if (a->op == IR_PHI && !live[a->id]) {
+        live[a->id] = 1;
+        work[n++] = a;
+      }
+    }
+  }
+
+  for (Block b = fn->entry; b; b = b->next) {
+    Inst next;
+    for (Inst v = b->first; v && v->op == IR_PHI; v = next) {
+      next = v->next;
+      if (!live[v->id])
+        remove_inst(v);
+    }
+  }
+  free(live);
+  free(work);
+}
+
+// the addresses of promoted variables are left unused, and the variables
+// don't need a place in the frame any more
+static void remove_promoted() {
+  for (Block b = fn->entry; b; b = b->next) {
+    Inst next;
+    for (Inst v = b->first; v; v = next) {
+      next = v->next;
+      if (promoted_var(v) >= 0)
+        remove_inst(v);
+    }
+  }
+
+  Node* link = &fn->node->locals;
+  for (Node v = fn->node->locals; v; v = v->next) {
+    if (v->kind == A_VAR && promoted[v->var_index])
+      continue;
+    *link = v;
+    link = &v->next;
+  }
+  *link = NULL;
+}
+
+void build_ssa(Func f) {
+  fn = f;
+  remove_unreachable(f);
+  compute_dominators(f);
+
+  int nvars = collect_vars();
+  find_promoted();
+  compute_frontiers();
+  place_phis(nvars);
+  rename_vars(nvars);
+  remove_dead_phis();
+  remove_promoted();
+}
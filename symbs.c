@@ -61,7 +61,7 @@ static Node find_file_scope(Token tok, int kind) {
   for (Node n = globals; n; n = n->next) {
     if (tok->name == n->name) {
       if (kind && n->kind != kind) {
-        infoat(n->token, "previous (%s):", n->type->str);
+        infoat(n->token, "previous (%s):", type_str(n->type));
         errorat(tok, "conflict type for %s", tok->name);
       }
       return n;
@@ -15,8 +15,12 @@ function test {
     file=$1
     prog="$(cat $file)"
 
-    # expected output
-    gcc -std=c99 -pedantic -Werror -Wno-implicit-function-declaration -Wno-builtin-declaration-mismatch -o temp.out $file 2>/dev/null
+    # expected output, a test of a GNU extension says so on its first line
+    std="-std=c99 -pedantic"
+    if head -n 1 $file | grep -q "GNU extension"; then
+        std="-std=gnu99"
+    fi
+    gcc $std -Werror -Wno-implicit-function-declaration -Wno-builtin-declaration-mismatch -o temp.out $file 2>/dev/null
     if [[ $? -ne 0 ]]; then
         failed "$file" "can't compile(gcc)"
         return
@@ -56,8 +60,46 @@ function test {
     ((passed++))
 }
 
+# A chain of 100000 && and || must compile in linear time, a pass that is
+# quadratic in it takes minutes. Too long for gcc or to print, the output
+# is known.
+function long_chain_failed {
+    ((failed++))
+    echo -ne "\r\033[K=== long && and || chains FAILED ===\n"
+    echo "    $1"
+}
+
+function test_long_chain {
+    awk 'BEGIN {
+        printf "int main() {\n  int a[16];\n"
+        printf "  for (int i = 0; i < 16; i++)\n    a[i] = i;\n"
+        printf "  printf(\"%%d %%d\\n\", a[1]"
+        for (i = 1; i < 100000; i++)
+            printf " && a[%d]", i % 15 + 1
+        printf " && a[0], a[0]"
+        for (i = 1; i < 100000; i++)
+            printf " || a[0]"
+        printf " || a[3]);\n  return 0;\n}\n"
+    }' > temp.c
+
+    timeout 10 ./mycc temp.c -o temp.s 2>/dev/null
+    if [[ $? -ne 0 ]]; then
+        long_chain_failed "can't compile in 10s"
+        return
+    fi
+    gcc temp.s -o temp.out 2>/dev/null
+    if [[ "$(./temp.out)" != "0 1" ]]; then
+        long_chain_failed "bad output"
+        return
+    fi
+
+    ((passed++))
+}
+
 for file in $(ls test/*.c | sort -n); do
     test $file
     echo -ne "\r\033[KTest Summary: ${passed} PASSED, ${failed} FAILED"
 done
+test_long_chain
+echo -ne "\r\033[KTest Summary: ${passed} PASSED, ${failed} FAILED"
 echo -ne "\n"
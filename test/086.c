@@ -0,0 +1,15 @@
+int main() {
+  int a = 5, b = 3, c = 9;
+
+  printf("%d\n", a + b * c - a / b % c);
+  printf("%d\n", a - b - c - 1);
+  printf("%d\n", a << 2 + b >> 1);
+  printf("%d\n", a < b == c > a);
+  printf("%d\n", a & b | c ^ a & c);
+  printf("%d\n", a | b ^ c & a == 5);
+  printf("%d\n", a || b && !c || 0 && a);
+  printf("%d\n", a * b + c * a < c << 2 && a != b | c);
+  printf("%d\n", a > b ? c - a * b : a + b * c);
+  printf("%d\n", 100 / a / b - 1000 % c % a);
+  return 0;
+}
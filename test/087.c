@@ -0,0 +1,118 @@
+struct wide;
+struct wide *forward;
+
+struct wide {
+  char f0;
+  short f1;
+  int f2;
+  long f3;
+  char f4;
+  short f5;
+  int f6;
+  long f7;
+  char f8;
+  short f9;
+  int f10;
+  long f11;
+  char f12;
+  short f13;
+  int f14;
+  long f15;
+  char f16;
+  short f17;
+  int f18;
+  long f19;
+  char f20;
+  short f21;
+  int f22;
+  long f23;
+  char f24;
+  short f25;
+  int f26;
+  long f27;
+  char f28;
+  short f29;
+  int f30;
+  long f31;
+  char f32;
+  short f33;
+  int f34;
+  long f35;
+  char f36;
+  short f37;
+  int f38;
+  long f39;
+};
+
+union pick {
+  char c;
+  int i;
+  long l;
+  struct wide* w;
+};
+
+int main() {
+  struct wide w;
+  union pick u;
+  long sum = 0;
+  w.f0 = 1;
+  w.f1 = 2;
+  w.f2 = 3;
+  w.f3 = 4;
+  w.f4 = 5;
+  w.f5 = 6;
+  w.f6 = 7;
+  w.f7 = 8;
+  w.f8 = 9;
+  w.f9 = 10;
+  w.f10 = 11;
+  w.f11 = 12;
+  w.f12 = 13;
+  w.f13 = 14;
+  w.f14 = 15;
+  w.f15 = 16;
+  w.f16 = 17;
+  w.f17 = 18;
+  w.f18 = 19;
+  w.f19 = 20;
+  w.f20 = 21;
+  w.f21 = 22;
+  w.f22 = 23;
+  w.f23 = 24;
+  w.f24 = 25;
+  w.f25 = 26;
+  w.f26 = 27;
+  w.f27 = 28;
+  w.f28 = 29;
+  w.f29 = 30;
+  w.f30 = 31;
+  w.f31 = 32;
+  w.f32 = 33;
+  w.f33 = 34;
+  w.f34 = 35;
+  w.f35 = 36;
+  w.f36 = 37;
+  w.f37 = 38;
+  w.f38 = 39;
+  w.f39 = 40;
+  forward = &w;
+  sum += forward->f0;
+  sum += forward->f3;
+  sum += forward->f6;
+  sum += forward->f9;
+  sum += forward->f12;
+  sum += forward->f15;
+  sum += forward->f18;
+  sum += forward->f21;
+  sum += forward->f24;
+  sum += forward->f27;
+  sum += forward->f30;
+  sum += forward->f33;
+  sum += forward->f36;
+  sum += forward->f39;
+  u.l = 0;
+  u.i = 7;
+  u.w = forward;
+  printf("%ld,%d,%d,%ld", sum, w.f0, w.f39, u.w->f20);
+  return 0;
+}
\ No newline at end of file
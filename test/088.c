@@ -0,0 +1,23 @@
+long big = 4294967296;
+
+int main() {
+  int i = 0, n = 0;
+  do {
+    i++;
+    if (i % 2)
+      continue;
+    n += i;
+  } while (i < 10);
+
+  unsigned int u = 4000000000;
+  unsigned long ul = u;
+  long a = 4294967296, b = 1;
+  int* p = &n;
+
+  if (big)
+    printf("big,");
+  if (0 != p)
+    printf("p,");
+  printf("%d,%d,%u,%u,%lu,%d,%d\n", i, n, u / 3, u % 7, ul, a > b, a == big);
+  return 0;
+}
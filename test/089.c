@@ -0,0 +1,57 @@
+int fib(int n) {
+  int a = 0, b = 1, i;
+  for (i = 0; i < n; i++) {
+    int t = a;
+    a = b;
+    b = t + b;
+  }
+  return a;
+}
+
+int swap(int n) {
+  int a = 1, b = 2;
+  while (n--) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  return a * 10 + b;
+}
+
+int last(int n) {
+  int x = 0, i = 0;
+  do {
+    x = i;
+    i++;
+  } while (i < n);
+  return x * 100 + i;
+}
+
+int scale(int x) {
+  int n = 16, debug = 0;
+  if (debug)
+    printf("debug,");
+  if (n > 10)
+    x = x * n;
+  else
+    x = 0;
+  return x;
+}
+
+int main() {
+  int k = 3, s = 0, i;
+  long l = 1;
+  char c = -56;
+  for (i = 0; i < 5; i++) {
+    if (k == 3)
+      s += 2;
+    else
+      s += 100;
+  }
+  for (i = 0; i < 40; i++)
+    l = l * 2;
+  printf("%d,%d,%d,%d,%d,%ld,%d,", fib(10), swap(3), last(5), scale(3), s, l,
+         c);
+  printf("%d,%d,%d\n", -7 / 2, -7 % 2, -16 >> 2);
+  return 0;
+}
@@ -0,0 +1,38 @@
+int count(int x) {
+  if (0)
+    printf("if,");
+  while (0)
+    printf("while,");
+  for (;;) {
+    if (x > 3)
+      break;
+    x++;
+    continue;
+    x = 100;
+  }
+  return x;
+  printf("return,");
+}
+
+int pick(int x) {
+  if (x)
+    return 1;
+  else
+    return 2;
+  return 3;
+}
+
+int skip(int n) {
+  int s = 0, i;
+  for (i = 0; i < n; i++) {
+    if (i == 2)
+      continue;
+    s += i;
+  }
+  return s;
+}
+
+int main() {
+  printf("%d,%d,%d,%d\n", count(1), pick(0), pick(5), skip(5));
+  return 0;
+}
@@ -0,0 +1,54 @@
+struct pair {
+  int x;
+  int y;
+};
+
+int overwrite(int n) {
+  int a[4], i;
+  a[0] = 1;
+  a[1] = 2;
+  a[2] = 3;
+  a[3] = 4;
+  for (i = 0; i < n; i++)
+    a[i % 4] = i;
+  return a[1];
+}
+
+int unread() {
+  int a[4];
+  a[0] = 5;
+  a[1] = 6;
+  return 0;
+}
+
+int copy(int x) {
+  struct pair p, q;
+  p.x = x;
+  p.y = 2;
+  q = p;
+  q.x = 9;
+  return q.y + p.x;
+}
+
+int through(int x) {
+  int y = 5;
+  int* p = &y;
+  *p = x;
+  return y;
+}
+
+int keep() {
+  volatile int v = 1;
+  int n = 0;
+  v;
+  v = 2;
+  n++;
+  n + 1;
+  return v + n;
+}
+
+int main() {
+  printf("%d,%d,%d,%d,%d\n", overwrite(3), unread(), copy(7), through(4),
+         keep());
+  return 0;
+}
@@ -0,0 +1,27 @@
+int g;
+
+int bump(int* a, int i, int n, int j) {
+  a[i * n + j]++;
+  ++a[i * n + j];
+  return a[i * n + j] + a[i * n + j];
+}
+
+int reload(int x) {
+  g = x;
+  return g + g;
+}
+
+int alias(int* p, int* q) {
+  int a = *p;
+  *q = 7;
+  return a + *p;
+}
+
+int main() {
+  int a[10], k, x = 1;
+  for (k = 0; k < 10; k++)
+    a[k] = k;
+  printf("%d,%d,%d,", bump(a, 1, 3, 2), a[5], reload(4));
+  printf("%d,%d\n", alias(&x, &x), x);
+  return 0;
+}
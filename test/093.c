@@ -0,0 +1,59 @@
+struct box {
+  int k;
+  int a[8];
+};
+
+int n = 8;
+int scale = 3;
+struct box box;
+
+int sum(int* p, int m) {
+  int i, t = 0;
+  for (i = 0; i < n; i++)
+    t += p[i] * scale + box.k * m + box.a[2];
+  return t;
+}
+
+int divide(int x, int d) {
+  int i = 0, t = 0;
+  while (i++ < 4) {
+    if (d)
+      t += x / d;
+    t += x / 7;
+  }
+  return t;
+}
+
+int guarded(int* p) {
+  int i, t = 0;
+  for (i = 0; i < 3; i++) {
+    if (p)
+      t += *p;
+  }
+  return t;
+}
+
+int written(int* p) {
+  int i = 0, t = 0;
+  do {
+    n = n + 1;
+    t += n;
+    *p = i;
+    t += scale;
+  } while (++i < 3);
+  return t;
+}
+
+int main() {
+  int a[8], i, r1, r2, r3, r4;
+  for (i = 0; i < 8; i++)
+    a[i] = i;
+  box.k = 2;
+  box.a[2] = 1;
+  r1 = sum(a, 5);
+  r2 = divide(20, 0);
+  r3 = guarded(0);
+  r4 = written(&scale);
+  printf("%d,%d,%d,%d,%d,%d\n", r1, r2, r3, r4, n, scale);
+  return 0;
+}
@@ -0,0 +1,87 @@
+struct point {
+  long x, y, z;
+};
+
+int a[20];
+long b[20];
+char* s = "strength";
+struct point pts[6];
+int grid[5][7];
+
+int sum(int* p, int n) {
+  int i, t = 0;
+  for (i = 0; i < n; i++)
+    t += p[i];
+  return t;
+}
+
+long sum_long(long* p, long n) {
+  long i, t = 0;
+  for (i = 0; i < n; i++)
+    t += p[i] * (i + 1);
+  return t;
+}
+
+long sum_z(struct point* p, int n) {
+  int i;
+  long t = 0;
+  for (i = 0; i < n; i++)
+    t += p[i].z - p[i].x;
+  return t;
+}
+
+int neighbours(int n) {
+  int i, t = 0;
+  for (i = 1; i + 1 < n; i += 2)
+    t += a[i - 1] * 3 + a[i] + a[i + 1];
+  return t;
+}
+
+int down(int n) {
+  int i, t = 0;
+  for (i = n - 1; i >= 0; i--)
+    t = t * 2 + a[i] % 5;
+  return t;
+}
+
+int bounds(int n) {
+  int i, t = 0;
+  for (i = 0; n > i; i++)
+    t += s[i];
+  for (i = 0; i <= n; i++)
+    t += s[i] * i;
+  for (i = 0; i != n; i++)
+    t -= s[i];
+  return t + i;
+}
+
+int matrix() {
+  int i, j, t = 0;
+  for (i = 0; i < 5; i++)
+    for (j = 0; j < 7; j++)
+      grid[i][j] = i * j + j;
+  for (j = 0; j < 7; j++)
+    for (i = 0; i < 5; i++)
+      t = t * 3 % 1000003 + grid[i][j];
+  return t;
+}
+
+int main() {
+  int i;
+  for (i = 0; i < 20; i++) {
+    a[i] = i * 7 % 11;
+    b[i] = 1000000007L * i;
+  }
+  for (i = 0; i < 6; i++) {
+    pts[i].x = i;
+    pts[i].z = i * i;
+  }
+  printf("%d %d %d\n", sum(a, 20), sum(a + 3, 5), sum(a, 0));
+  printf("%ld %ld\n", sum_long(b, 20), sum_long(b, -3));
+  printf("%ld %ld\n", sum_z(pts, 6), sum_z(pts + 2, 3));
+  printf("%d %d %d\n", neighbours(20), neighbours(7), neighbours(1));
+  printf("%d %d\n", down(20), down(0));
+  printf("%d %d\n", bounds(8), bounds(3));
+  printf("%d\n", matrix());
+  return 0;
+}
@@ -0,0 +1,65 @@
+struct triple {
+  int a, b, c;
+};
+
+struct triple t[10];
+
+int sdiv(int x) {
+  return x / 7 + x / -7 + x / 8 + x / -16 + x / 1000003 + x / -1;
+}
+
+int smod(int x) {
+  return x % 7 + x % -7 + x % 8 + x % -16 + x % 1000003 + x % 1;
+}
+
+unsigned udiv(unsigned x) {
+  return x / 3 + x / 10 + x / 16 + x % 7 + x % 32 + x / 4294967295u +
+         x % 2147483649u;
+}
+
+long ldiv(long x) {
+  return x / 3 + x / -10 + x / 1000000007L + x % 1000000007L + x % -64 +
+         x / 4611686018427387904L;
+}
+
+unsigned long uldiv(unsigned long x) {
+  return x / 7 + x % 10 + x / 1000000007UL + x % 9223372036854775809UL +
+         x / 64;
+}
+
+int hash(char* s) {
+  unsigned h = 0;
+  for (; *s; s++)
+    h = (h * 31 + *s) % 65521;
+  return h;
+}
+
+long scaled(long i, long j) {
+  return i * 3 + j * 5 + i * 9 + j * 8 + (i << 2) + (j >> 1) - 100 + i * -6;
+}
+
+int zeros(int x, long y) {
+  int n = 0;
+  if (x == 0)
+    n += 1;
+  if (x != 0)
+    n += 2;
+  if (y > 0)
+    n += 4;
+  if (0 < x)
+    n += 8;
+  return n;
+}
+
+int main() {
+  printf("%d %d %d %d\n", sdiv(0), sdiv(100), sdiv(-100), sdiv(2147483647));
+  printf("%d %d %d\n", sdiv(-2147483647), smod(1234567), smod(-1234567));
+  printf("%u %u %u\n", udiv(0), udiv(123456789), udiv(4294967295u));
+  printf("%ld %ld\n", ldiv(9000000000000000000L), ldiv(-123456789012345L));
+  printf("%lu %lu\n", uldiv(18446744073709551615UL), uldiv(12345));
+  printf("%d %d\n", hash("instruction selection"), hash(""));
+  printf("%ld %ld\n", scaled(3, -7), scaled(-100000, 100000));
+  printf("%d %d %d\n", zeros(0, 1), zeros(5, -1), zeros(-5, 0));
+  printf("%d %d\n", (int)(&t[7] - &t[2]), (int)(&t[1] - &t[9]));
+  return 0;
+}
@@ -0,0 +1,85 @@
+struct inner {
+  char tag;
+  int b[4];
+};
+
+struct elem {
+  long key;
+  int c;
+  struct inner a;
+};
+
+struct table {
+  int n;
+  struct elem e[6];
+  struct table* next;
+};
+
+struct table g;
+int grid[4][5];
+
+int get(struct table* t, long i) {
+  return t->e[i].a.b[2] + t->e[i].c - t->e[i + 1].a.tag;
+}
+
+void put(struct table* t, int i, int v) {
+  t->e[i].a.b[3] = v;
+  t->e[i].a.b[v & 3] += i;
+  t->e[2].c = 7;
+  t->e[i].a.tag = 97 + i;
+}
+
+int chain(struct table* t) {
+  return t->next->e[1].a.b[1] + t->next->next->n;
+}
+
+int globals(long i) {
+  g.e[i].key = i * 100;
+  g.e[3].c += 1;
+  grid[i][i + 1] = grid[i][i] + 3;
+  return g.e[i].key + g.e[3].c + grid[i][i + 1] + "address"[i];
+}
+
+int locals(int i) {
+  struct table l;
+  int a[8];
+  int j;
+  for (j = 0; j < 8; j++)
+    a[j] = j * j;
+  l.n = a[i] + a[i + 1];
+  l.e[i].a.b[i - 1] = l.n;
+  l.e[i].c = a[7 - i];
+  return l.e[i].a.b[i - 1] * 10 + l.e[i].c + l.n;
+}
+
+long sum(struct table* t) {
+  long s = 0;
+  int i;
+  for (i = 0; i < 6; i++)
+    s += t->e[i].key * t->e[i].c + t->e[i].a.b[i % 4];
+  return s;
+}
+
+int main() {
+  struct table t, u;
+  int i, j;
+  for (i = 0; i < 6; i++) {
+    t.e[i].key = i;
+    t.e[i].c = i * 2;
+    t.e[i].a.tag = 120;
+    for (j = 0; j < 4; j++)
+      t.e[i].a.b[j] = i + j;
+  }
+  t.next = &u;
+  u.next = &t;
+  u.e[1].a.b[1] = 40;
+  t.n = 2;
+  put(&t, 3, 9);
+  put(&t, 1, 2);
+  printf("%d %d %d\n", get(&t, 0), get(&t, 3), get(&t, 1));
+  printf("%d %c %c\n", chain(&t), t.e[3].a.tag, t.e[1].a.tag);
+  printf("%d %d\n", globals(2), globals(3));
+  printf("%d %d\n", locals(1), locals(5));
+  printf("%ld\n", sum(&t));
+  return 0;
+}
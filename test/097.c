@@ -0,0 +1,69 @@
+int calls;
+
+int f(int x) {
+  calls = calls * 10 + x;
+  return x;
+}
+
+int between(int lo, int x, int hi) {
+  return lo <= x && x < hi;
+}
+
+int count(int* a, int n, int lo, int hi) {
+  int c = 0;
+  for (int i = 0; i < n && a[i] >= 0; i++) {
+    if (!(a[i] < lo || a[i] >= hi))
+      c++;
+  }
+  return c;
+}
+
+int main() {
+  int* p = 0;
+  int a[8];
+  for (int i = 0; i < 8; i++)
+    a[i] = i * 3 - (i == 6) * 100;
+
+  // the right operand is only evaluated when needed
+  if (p && *p)
+    printf("bad\n");
+  if (!p || *p)
+    printf("ok\n");
+  calls = 0;
+  if (f(0) && f(1))
+    printf("bad\n");
+  printf("%d\n", calls);
+  calls = 0;
+  if (f(1) || f(2))
+    printf("%d\n", calls);
+  calls = 0;
+  if ((f(1) && f(0)) || (f(2) && f(3)) || f(4))
+    printf("%d\n", calls);
+  calls = 0;
+  if (!(f(0) || f(5)) || !f(6))
+    printf("bad\n");
+  printf("%d\n", calls);
+
+  // as values
+  int x = 3;
+  int t = x > 1 && x < 5;
+  int u = x < 1 || x > 5;
+  int v = !(x == 3) || f(7) && x;
+  printf("%d %d %d %d\n", t, u, v, between(1, 2, 3) + between(2, 3, 3));
+
+  // in loops and ternaries
+  printf("%d %d\n", count(a, 8, 2, 13), count(a, 5, 0, 100));
+  int n = 0;
+  while (n < 100 && (n % 7 || n == 0))
+    n++;
+  printf("%d\n", n);
+  do
+    n--;
+  while (n > 3 && !(n == 5));
+  printf("%d\n", n);
+  unsigned big = 4000000000u;
+  printf("%d %d\n", big > 5 && x ? 1 : 2, big < 5 || !x ? 1 : 2);
+  long l = -1;
+  printf("%d %d\n", l < 0 && (char)l == -1, (l & 1) != 0 && 0);
+  return 0;
+}
@@ -0,0 +1,79 @@
+int abs_of(int x) {
+  return x < 0 ? -x : x;
+}
+
+long max_of(long a, long b) {
+  return a > b ? a : b;
+}
+
+unsigned umin(unsigned a, unsigned b) {
+  return a < b ? a : b;
+}
+
+int sign(int x) {
+  return x > 0 ? 1 : x < 0 ? -1 : 0;
+}
+
+int is_zero(int* p) {
+  return !p;
+}
+
+int clamp(int x, int lo, int hi) {
+  if (x < lo)
+    x = lo;
+  if (x > hi)
+    x = hi;
+  return x;
+}
+
+int classify(int c) {
+  int digit = c >= 48 && c <= 57;
+  int upper = c >= 65 && c <= 90;
+  int lower = c >= 97 && c <= 122;
+  return digit ? 1 : (upper || lower) ? 2 : 0;
+}
+
+int divide(int a, int b) {
+  // the division must not run when b is 0
+  return b != 0 ? a / b : -1;
+}
+
+int deref(int* p) {
+  return p ? *p : 0;
+}
+
+int calls;
+
+int f(int x) {
+  calls++;
+  return x;
+}
+
+int main() {
+  int x = 7;
+  printf("%d %d %d\n", abs_of(-5), abs_of(5), abs_of(0));
+  printf("%ld %ld\n", max_of(-3, 2), max_of(10000000000, 3));
+  printf("%u %u\n", umin(4000000000u, 5), umin(1, 2));
+  printf("%d %d %d\n", sign(-9), sign(0), sign(9));
+  printf("%d %d\n", is_zero(&x), is_zero(0));
+  printf("%d %d %d\n", clamp(-5, 0, 10), clamp(5, 0, 10), clamp(50, 0, 10));
+  int counts[3];
+  counts[0] = counts[1] = counts[2] = 0;
+  for (int c = 0; c < 128; c++)
+    counts[classify(c)]++;
+  printf("%d %d %d\n", counts[0], counts[1], counts[2]);
+  printf("%d %d\n", divide(7, 2), divide(7, 0));
+  printf("%d %d\n", deref(&x), deref(0));
+
+  // the arms that call stay branches
+  calls = 0;
+  int y = x > 3 ? f(1) : f(2);
+  int z = x > 3 && f(3);
+  printf("%d %d %d\n", y, z, calls);
+
+  int s = 0;
+  for (int i = 0; i < 100; i++)
+    s += (i * 7 % 10) < 5 ? i : -i;
+  printf("%d\n", s);
+  return 0;
+}
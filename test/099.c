@@ -0,0 +1,87 @@
+struct point {
+  int x;
+  int y;
+};
+
+int counter;
+
+int get_x(struct point* p) {
+  return p->x;
+}
+
+void set_y(struct point* p, int y) {
+  p->y = y;
+}
+
+void bump() {
+  counter++;
+}
+
+int max(int a, int b) {
+  if (a > b)
+    return a;
+  return b;
+}
+
+long scale(long x, int k) {
+  return x * k;
+}
+
+int sum_local(int a, int b) {
+  // its array stays in memory, a copy is made in each caller
+  int t[2];
+  t[0] = a;
+  t[1] = b;
+  return t[0] + t[1];
+}
+
+int later(int x);
+
+int fact(int n) {
+  return n <= 1 ? 1 : n * fact(n - 1);
+}
+
+int is_odd(int n);
+
+int is_even(int n) {
+  return n == 0 ? 1 : is_odd(n - 1);
+}
+
+int is_odd(int n) {
+  return n == 0 ? 0 : is_even(n - 1);
+}
+
+int count_bits(unsigned x) {
+  int n = 0;
+  while (x) {
+    n += x & 1;
+    x >>= 1;
+  }
+  return n;
+}
+
+int main() {
+  struct point p;
+  p.x = 3;
+  p.y = 0;
+  set_y(&p, get_x(&p) * 2);
+  printf("%d %d\n", p.x, p.y);
+
+  for (int i = 0; i < 5; i++)
+    bump();
+  printf("%d\n", counter);
+
+  int m = 0;
+  for (int i = 0; i < 10; i++)
+    m = max(m, (i * 7) % 10);
+  printf("%d %ld\n", m, scale(100000000, 300));
+  printf("%d %d\n", sum_local(1, 2), sum_local(sum_local(3, 4), 5));
+  printf("%d %d\n", later(4), fact(6));
+  printf("%d %d\n", is_even(10), is_odd(7));
+  printf("%d %d\n", count_bits(255), count_bits(4096 + 3));
+  return 0;
+}
+
+int later(int x) {
+  return x * x + max(x, 10);
+}
@@ -0,0 +1,60 @@
+int gcd(int a, int b) {
+  if (b == 0)
+    return a;
+  return gcd(b, a % b);
+}
+
+long sum_to(long n, long acc) {
+  return n == 0 ? acc : sum_to(n - 1, acc + n);
+}
+
+int count;
+
+void walk(int n) {
+  if (n == 0)
+    return;
+  count++;
+  walk(n - 1);
+}
+
+int is_odd(int n);
+
+int is_even(int n) {
+  if (n == 0)
+    return 1;
+  return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+  if (n == 0)
+    return 0;
+  return is_even(n - 1);
+}
+
+int find(int* a, int n, int x, int i) {
+  if (i == n)
+    return -1;
+  if (a[i] == x)
+    return i;
+  return find(a, n, x, i + 1);
+}
+
+int first_local(int n) {
+  // the argument points into the frame, the call stays a call
+  int x = n;
+  return n == 0 ? 0 : find(&x, 1, n, 0) + first_local(n - 1);
+}
+
+int main() {
+  int a[5];
+  for (int i = 0; i < 5; i++)
+    a[i] = i * i;
+  printf("%d %d\n", gcd(1071, 462), gcd(17, 5));
+  printf("%ld\n", sum_to(30000, 0));
+  walk(30000);
+  printf("%d\n", count);
+  printf("%d %d\n", is_even(30000), is_odd(30001));
+  printf("%d %d\n", find(a, 5, 9, 0), find(a, 5, 10, 0));
+  printf("%d\n", first_local(10));
+  return 0;
+}
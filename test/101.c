@@ -0,0 +1,61 @@
+int twice(int x) {
+  return 2 * x;
+}
+
+int leaf(int a, int b, int c) {
+  int t[4];
+  t[0] = a;
+  t[1] = b;
+  t[2] = c;
+  t[3] = a + b + c;
+  return t[0] * t[3] - t[1] + t[2];
+}
+
+long eight(long a, long b, long c, long d, long e, long f, long g, long h) {
+  return a - b + c - d + e - f + g * 10 - h;
+}
+
+int big(int n) {
+  // too large for the red zone
+  int t[64];
+  for (int i = 0; i < 64; i++)
+    t[i] = i * n;
+  return t[63] - t[1];
+}
+
+int early(int* p, int n) {
+  if (!p || n <= 0)
+    return -1;
+  int s = 0;
+  for (int i = 0; i < n; i++)
+    s += twice(p[i]);
+  return s;
+}
+
+int fib_pair(int n) {
+  // the phis of the loop swap their values
+  int a = 0, b = 1;
+  for (int i = 0; i < n; i++) {
+    int t = a;
+    a = b;
+    b = t + b;
+  }
+  return a;
+}
+
+int calls_eight(int k) {
+  if (k == 0)
+    return 0;
+  return eight(1, 2, 3, 4, 5, 6, k, 8) + calls_eight(k - 1);
+}
+
+int main() {
+  int a[5];
+  for (int i = 0; i < 5; i++)
+    a[i] = i + 1;
+  printf("%d %ld %d\n", leaf(1, 2, 3), eight(1, 2, 3, 4, 5, 6, 7, 8), big(3));
+  printf("%d %d %d\n", early(a, 5), early(0, 5), early(a, 0));
+  printf("%d %d\n", fib_pair(10), fib_pair(40));
+  printf("%d\n", calls_eight(5));
+  return 0;
+}
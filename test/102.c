@@ -0,0 +1,211 @@
+enum state { IDLE, HEADER, LENGTH, PAYLOAD, CHECKSUM, DONE };
+
+// dense cases, dispatched through a jump table
+int next_state(enum state s, int byte) {
+  switch (s) {
+    case IDLE:
+      return byte == 126 ? HEADER : IDLE;
+    case HEADER:
+      return LENGTH;
+    case LENGTH:
+      if (byte == 0)
+        return CHECKSUM;
+      return PAYLOAD;
+    case PAYLOAD:
+      return byte == 125 ? CHECKSUM : PAYLOAD;
+    case CHECKSUM:
+      return DONE;
+    default:
+      return IDLE;
+  }
+}
+
+// sparse cases, dispatched by a binary search
+int opcode_length(unsigned op) {
+  switch (op) {
+    case 1:
+      return 2;
+    case 17:
+      return 3;
+    case 100:
+      return 1;
+    case 1000:
+      return 5;
+    case 4096:
+      return 4;
+    case 65536:
+      return 7;
+    case 0xfffffff0:
+      return 9;
+  }
+  return 0;
+}
+
+// a few cases, tested in turn, with fallthrough
+int fallthrough(int x) {
+  int r = 0;
+  switch (x) {
+    case 3:
+      r += 100;
+    case 2:
+      r += 10;
+      break;
+    default:
+      r = -1;
+    case -5:
+      r += 1;
+  }
+  return r;
+}
+
+// dense runs among sparse values, and holes in the tables
+int clusters(long x) {
+  switch (x) {
+    case -3:
+    case -2:
+    case -1:
+      return 1;
+    case 0:
+    case 2:
+    case 4:
+    case 5:
+      return 2;
+    case 1000:
+    case 1001:
+    case 1002:
+    case 1003:
+    case 1004:
+      return 3;
+    case 1L << 40:
+      return 4;
+  }
+  return 0;
+}
+
+int sum_of_cases(int n) {
+  int sum = 0;
+  for (int i = 0; i < n; i++) {
+    switch (i % 7) {
+      case 0:
+        continue;
+      case 1:
+        sum += 1;
+        break;
+      case 2:
+        sum += 20;
+        break;
+      case 4:
+        sum += 300;
+        break;
+      case 5:
+        if (i > 10)
+          break;
+        sum += 4000;
+      case 6:
+        sum += 50000;
+    }
+    sum++;
+  }
+  return sum;
+}
+
+int by_char(char c) {
+  switch (c) {
+    case -1:
+      return 1;
+    case (char)255 + 2:
+      return 2;
+    case ~1:
+      return 3;
+  }
+  return 0;
+}
+
+// labels using every operator of a constant expression
+int folded(long x) {
+  switch (x) {
+    case 10 / 2:
+      return 1;
+    case 7 % 4:
+      return 2;
+    case 1 < 2:
+      return 3;
+    case !0 + 10:
+      return 4;
+    case 1 ? 2 : 3:
+      return 5;
+    case -7 / 2:
+      return 6;
+    case -7 % 2 * 10:
+      return 7;
+    case 0u - 1 > 0 ? 20 : 21:
+      return 8;
+    case -1 < 0 ? 30 : 31:
+      return 9;
+    case (2 == 2) + 40:
+      return 10;
+    case 3 != 3 || 50 >= 50 ? 60 : 61:
+      return 11;
+    case 1 && 0 ? 70 : 71:
+      return 12;
+    case (1L << 40) / 3 % 1000 + 100 <= 100 ? 80 : 81:
+      return 13;
+    case (1L << 40) / 3:
+      return 14;
+    case (4000000000u / 3 > 0 && 2 > 1) + 90:
+      return 15;
+  }
+  return 0;
+}
+
+int main() {
+  int s = IDLE;
+  int input[9];
+  input[0] = 5;
+  input[1] = 126;
+  input[2] = 1;
+  input[3] = 3;
+  input[4] = 7;
+  input[5] = 125;
+  input[6] = 9;
+  input[7] = 0;
+  input[8] = 126;
+  for (int i = 0; i < 9; i++) {
+    s = next_state(s, input[i]);
+    printf("%d ", s);
+  }
+  printf("%d\n", next_state(42, 0));
+
+  printf("%d %d %d %d %d %d %d %d %d\n", opcode_length(1),
+         opcode_length(17), opcode_length(100), opcode_length(1000),
+         opcode_length(4096), opcode_length(65536),
+         opcode_length(0xfffffff0), opcode_length(2), opcode_length(-1));
+
+  for (int i = -6; i < 5; i++)
+    printf("%d ", fallthrough(i));
+  printf("\n");
+
+  for (long x = -5; x < 8; x++)
+    printf("%d ", clusters(x));
+  printf("%d %d %d %d %d\n", clusters(999), clusters(1002), clusters(1005),
+         clusters(1L << 40), clusters((1L << 40) + 1));
+
+  printf("%d\n", sum_of_cases(30));
+  printf("%d %d %d %d\n", by_char(-1), by_char(1), by_char(-2), by_char(0));
+
+  printf("%d %d %d %d %d %d %d %d\n", folded(5), folded(3), folded(1),
+         folded(11), folded(2), folded(-3), folded(-10), folded(20));
+  printf("%d %d %d %d %d %d %d %d\n", folded(30), folded(41), folded(60),
+         folded(71), folded(81), folded(366503875925L), folded(91),
+         folded(4));
+
+  int n = 0;
+  switch (n)
+    ;
+  switch (n) {
+    default:
+      n = 7;
+  }
+  printf("%d\n", n);
+  return 0;
+}
@@ -0,0 +1,31 @@
+// two constant phis in one block, the immediates made for the first one
+// come after the second
+int same(int c) {
+  int a, b;
+  if (c) {
+    a = 1;
+    b = 2;
+  } else {
+    a = 1;
+    b = 2;
+  }
+  return a * 10 + b;
+}
+
+int loop(int n) {
+  int a = 3, b = 4, t = 0;
+  for (int i = 0; i < n; i++) {
+    t += a * b;
+    if (i > 100) {
+      a = 3;
+      b = 4;
+    }
+  }
+  return t;
+}
+
+int main() {
+  printf("%d %d\n", same(0), same(5));
+  printf("%d %d\n", loop(0), loop(10));
+  return 0;
+}
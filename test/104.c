@@ -0,0 +1,28 @@
+// void * takes and gives any object pointer
+long sum(void* p, int n) {
+  long* q = p;
+  long s = 0;
+  for (int i = 0; i < n; i++)
+    s += q[i];
+  return s;
+}
+
+int first(void* p) {
+  int* q = p;
+  return *q;
+}
+
+int main() {
+  long a[4];
+  int b = 7;
+  void* p;
+  void* q;
+  for (int i = 0; i < 4; i++)
+    a[i] = i * 10 + 1;
+  p = a;
+  q = p;
+  printf("%ld %ld\n", sum(q, 4), sum(a + 1, 2));
+  p = &b;
+  printf("%d %d\n", first(p), first(&b));
+  return 0;
+}
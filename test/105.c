@@ -0,0 +1,88 @@
+// GNU extension: labels as values and computed goto
+
+// counts the digits of n that are 0, odd and even, one label each
+int digits(int n, int* counts) {
+  void* kind[10];
+  for (int i = 0; i < 10; i++)
+    kind[i] = i == 0 ? &&zero : i % 2 ? &&odd : &&even;
+  counts[0] = counts[1] = counts[2] = 0;
+  int d = n % 10;
+  goto *kind[d];
+zero:
+  counts[0]++;
+  goto next;
+odd:
+  counts[1]++;
+  goto next;
+even:
+  counts[2]++;
+next:
+  n /= 10;
+  if (!n)
+    return counts[0] + counts[1] + counts[2];
+  d = n % 10;
+  goto *kind[d];
+}
+
+int find(int a[4][4], int x) {
+  int r = -1;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      if (a[i][j] == x) {
+        r = i * 4 + j;
+        goto found;
+      }
+    }
+  }
+  printf("not found\n");
+  return r;
+found:
+  printf("found at %d\n", r);
+  return r;
+}
+
+int collatz(int n) {
+  int steps = 0;
+again:
+  if (n == 1)
+    goto done;
+  steps++;
+  if (n % 2)
+    goto odd;
+  n /= 2;
+  goto again;
+odd:
+  n = 3 * n + 1;
+  goto again;
+done:
+  return steps;
+}
+
+int same_label(int x) {
+  void* a = &&one;
+  void* b = x ? &&one : &&two;
+  if (a == b)
+    goto one;
+  goto *b;
+one:
+  return 1;
+two:
+  return 2;
+}
+
+int main() {
+  int counts[3];
+  int total = digits(1203456, counts);
+  printf("%d %d %d %d\n", total, counts[0], counts[1], counts[2]);
+
+  int a[4][4];
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++)
+      a[i][j] = i * j + i;
+  find(a, 8);
+  find(a, 100);
+
+  printf("%d %d\n", collatz(27), collatz(1));
+  printf("%d %d\n", same_label(1), same_label(0));
+  return 0;
+}
@@ -0,0 +1,106 @@
+// GNU extension: labels as values and computed goto
+
+enum op { PUSH, ADD, SUB, MUL, DUP, SWAP, OVER, JNZ, PRINT, HALT };
+
+// a direct-threaded interpreter, each opcode dispatches the next one, so
+// every label block is entered from every other one
+long run(int* code, int* operands) {
+  void* ops[10];
+  ops[PUSH] = &&push;
+  ops[ADD] = &&add;
+  ops[SUB] = &&sub;
+  ops[MUL] = &&mul;
+  ops[DUP] = &&dup;
+  ops[SWAP] = &&swap;
+  ops[OVER] = &&over;
+  ops[JNZ] = &&jnz;
+  ops[PRINT] = &&print;
+  ops[HALT] = &&halt;
+
+  long stack[16];
+  long t;
+  int sp = 0;
+  int pc = 0;
+  long steps = 0;
+  goto *ops[code[pc]];
+
+push:
+  stack[sp++] = operands[pc++];
+  steps++;
+  goto *ops[code[pc]];
+add:
+  sp--;
+  stack[sp - 1] += stack[sp];
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+sub:
+  sp--;
+  stack[sp - 1] -= stack[sp];
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+mul:
+  sp--;
+  stack[sp - 1] *= stack[sp];
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+dup:
+  stack[sp] = stack[sp - 1];
+  sp++;
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+swap:
+  t = stack[sp - 1];
+  stack[sp - 1] = stack[sp - 2];
+  stack[sp - 2] = t;
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+over:
+  stack[sp] = stack[sp - 2];
+  sp++;
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+jnz:
+  steps++;
+  if (stack[--sp])
+    pc = operands[pc];
+  else
+    pc++;
+  goto *ops[code[pc]];
+print:
+  printf("%ld\n", stack[sp - 1]);
+  pc++;
+  steps++;
+  goto *ops[code[pc]];
+halt:
+  return steps;
+}
+
+int main() {
+  // the products of 10 * 9 * ... * 1, with the counter on top
+  int code[20];
+  int operands[20];
+  int n = 0;
+  code[n] = PUSH, operands[n++] = 1;
+  code[n] = PUSH, operands[n++] = 10;
+  int loop = n;
+  code[n] = SWAP, operands[n++] = 0;
+  code[n] = OVER, operands[n++] = 0;
+  code[n] = MUL, operands[n++] = 0;
+  code[n] = PRINT, operands[n++] = 0;
+  code[n] = SWAP, operands[n++] = 0;
+  code[n] = PUSH, operands[n++] = 1;
+  code[n] = SUB, operands[n++] = 0;
+  code[n] = DUP, operands[n++] = 0;
+  code[n] = JNZ, operands[n++] = loop;
+  code[n] = ADD, operands[n++] = 0;
+  code[n] = PRINT, operands[n++] = 0;
+  code[n] = HALT, operands[n++] = 0;
+  printf("%ld steps\n", run(code, operands));
+  return 0;
+}
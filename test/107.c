@@ -0,0 +1,146 @@
+struct s3 {
+  char c[3];
+};
+struct s12 {
+  char c[12];
+};
+struct s16 {
+  char c[16];
+};
+struct s40 {
+  char c[40];
+};
+struct s64 {
+  char c[64];
+};
+struct s100 {
+  char c[100];
+};
+struct s513 {
+  char c[513];
+};
+struct s4096 {
+  char c[4096];
+};
+
+void fill(char* p, int n, int seed) {
+  for (int i = 0; i < n; i++)
+    p[i] = seed + i * 7;
+}
+
+int hash(char* p, int n) {
+  int h = 0;
+  for (int i = 0; i < n; i++)
+    h = h * 31 + p[i];
+  return h;
+}
+
+// a copy must not write past its block
+struct guarded12 {
+  char before[5];
+  struct s12 x;
+  char after[5];
+};
+struct guarded100 {
+  char before[5];
+  struct s100 x;
+  char after[5];
+};
+
+int copies() {
+  struct s3 a3, b3;
+  struct s16 a16, b16;
+  struct s40 a40, b40;
+  struct s64 a64, b64;
+  struct s4096 a4096, b4096;
+  struct guarded12 g12;
+  struct guarded100 g100;
+  struct s12 a12;
+  struct s100 a100;
+
+  fill(a3.c, 3, 1);
+  fill(a16.c, 16, 2);
+  fill(a40.c, 40, 3);
+  fill(a64.c, 64, 4);
+  fill(a4096.c, 4096, 5);
+  fill(a12.c, 12, 6);
+  fill(a100.c, 100, 7);
+  fill(g12.before, 22, 8);
+  fill(g100.before, 110, 9);
+
+  b3 = a3;
+  b16 = a16;
+  b40 = a40;
+  b64 = a64;
+  b4096 = a4096;
+  g12.x = a12;
+  g100.x = a100;
+  printf("%d %d %d %d %d\n", hash(b3.c, 3), hash(b16.c, 16), hash(b40.c, 40),
+         hash(b64.c, 64), hash(b4096.c, 4096));
+  printf("%d %d\n", hash(g12.before, 22), hash(g100.before, 110));
+  return 0;
+}
+
+void copy513(struct s513* to, struct s513* from) {
+  *to = *from;
+}
+
+int chained() {
+  struct s40 a, b, c;
+  fill(a.c, 40, 10);
+  c = b = a;
+  c.c[39] = 0;
+  return hash(a.c, 40) - hash(b.c, 40) + hash(c.c, 40);
+}
+
+int zeroes() {
+  int total = 0;
+  for (int i = 0; i < 3; i++) {
+    struct s3 z3 = {0};
+    struct s12 z12 = {0};
+    struct s100 z100 = {0};
+    long big[300] = {0};
+    int small[5] = {0,};
+    total += hash(z3.c, 3) + hash(z12.c, 12) + hash(z100.c, 100) +
+             hash((char*)big, 2400) + hash((char*)small, 20);
+    fill(z3.c, 3, i);
+    fill(z12.c, 12, i);
+    fill(z100.c, 100, i);
+    fill((char*)big, 2400, i);
+    fill((char*)small, 20, i);
+    total += hash(z100.c, 100) + hash((char*)big, 2400);
+  }
+  return total;
+}
+
+struct s64 zero64 = {0};
+
+// the size comes from the one element
+int unsized_global[] = {0};
+
+int unsized() {
+  int total = 0;
+  for (int i = 0; i < 3; i++) {
+    char before = 1;
+    int one[] = {0,};
+    char after = 2;
+    total += sizeof(one) + one[0] + before + after;
+    one[0] = 100;
+    total += one[0] + before + after;
+  }
+  return total + sizeof(unsized_global) + unsized_global[0];
+}
+
+int main() {
+  copies();
+
+  struct s513 a, b;
+  fill(a.c, 513, 11);
+  copy513(&b, &a);
+  printf("%d\n", hash(b.c, 513));
+
+  printf("%d\n", chained());
+  printf("%d %d\n", zeroes(), hash(zero64.c, 64));
+  printf("%d\n", unsized());
+  return 0;
+}
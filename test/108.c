@@ -0,0 +1,167 @@
+struct span {
+  long* data;
+  long len;
+};
+struct handle {
+  int id;
+};
+struct rgb {
+  char r;
+  char g;
+  char b;
+};
+struct s7 {
+  char c[7];
+};
+struct s12 {
+  int a;
+  int b;
+  int c;
+};
+struct big {
+  long a[5];
+};
+
+// recursive, so the calls stay calls
+long sum(struct span s) {
+  if (s.len == 0)
+    return 0;
+  s.len--;
+  return s.data[s.len] + sum(s);
+}
+
+struct span slice(struct span s, long from, long to) {
+  s.data = s.data + from;
+  s.len = to - from;
+  return s;
+}
+
+struct handle next_handle(struct handle h, int depth) {
+  if (depth)
+    return next_handle(h, depth - 1);
+  h.id++;
+  return h;
+}
+
+struct rgb mix(struct rgb x, struct rgb y, int depth) {
+  struct rgb m;
+  if (depth)
+    return mix(y, x, depth - 1);
+  m.r = (x.r + y.r) / 2;
+  m.g = (x.g + y.g) / 2;
+  m.b = (x.b + y.b) / 2;
+  return m;
+}
+
+struct s7 reverse7(struct s7 x, int depth) {
+  struct s7 r;
+  if (depth)
+    return reverse7(x, depth - 1);
+  for (int i = 0; i < 7; i++)
+    r.c[i] = x.c[6 - i];
+  return r;
+}
+
+struct s12 rotate(struct s12 t, int depth) {
+  int a = t.a;
+  if (depth)
+    return rotate(t, depth - 1);
+  t.a = t.b;
+  t.b = t.c;
+  t.c = a;
+  return t;
+}
+
+struct big make_big(long seed, int depth) {
+  struct big b;
+  if (depth)
+    return make_big(seed + 1, depth - 1);
+  for (int i = 0; i < 5; i++)
+    b.a[i] = seed * (i + 1);
+  return b;
+}
+
+struct big twice(struct big b, int depth) {
+  if (depth) {
+    struct big r = twice(b, depth - 1);
+    return r;
+  }
+  for (int i = 0; i < 5; i++)
+    b.a[i] *= 2;
+  return b;
+}
+
+long big_sum(struct big b) {
+  long s = 0;
+  for (int i = 0; i < 5; i++)
+    s += b.a[i];
+  return s;
+}
+
+// the span needs two registers when only one is left, so it goes on the
+// stack and f takes the last register
+long many(long a, long b, long c, long d, long e, struct span s, long f,
+          struct s12 t, long g, struct handle h, int depth) {
+  if (depth)
+    return many(a, b, c, d, e, s, f, t, g, h, depth - 1);
+  return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * sum(s) + 7 * f +
+         8 * (t.a + t.b + t.c) + 9 * g + 10 * h.id;
+}
+
+struct span pick(int first, struct span x, struct span y) {
+  return first ? x : y;
+}
+
+int main() {
+  long data[6];
+  for (int i = 0; i < 6; i++)
+    data[i] = i * i + 1;
+  struct span all;
+  all.data = data;
+  all.len = 6;
+
+  printf("%ld %ld\n", sum(all), all.len);
+  struct span mid = slice(all, 1, 4);
+  printf("%ld %ld %ld\n", sum(mid), mid.len, slice(all, 2, 6).len);
+
+  struct handle h;
+  h.id = 41;
+  h = next_handle(h, 3);
+  printf("%d %d\n", h.id, next_handle(h, 0).id);
+
+  struct rgb red, blue;
+  red.r = 120;
+  red.g = 0;
+  red.b = 10;
+  blue.r = 0;
+  blue.g = 20;
+  blue.b = 100;
+  struct rgb purple = mix(red, blue, 2);
+  printf("%d %d %d\n", purple.r, purple.g, purple.b);
+
+  struct s7 word;
+  for (int i = 0; i < 7; i++)
+    word.c[i] = 97 + i;
+  struct s7 drow = reverse7(word, 1);
+  for (int i = 0; i < 7; i++)
+    printf("%c", drow.c[i]);
+  printf(" %c\n", reverse7(word, 0).c[0]);
+
+  struct s12 t;
+  t.a = 1;
+  t.b = 2;
+  t.c = 3;
+  t = rotate(t, 2);
+  printf("%d %d %d\n", t.a, t.b, t.c);
+
+  struct big b = make_big(10, 3);
+  printf("%ld %ld\n", big_sum(b), make_big(1, 0).a[4]);
+  struct big c = twice(b, 2);
+  printf("%ld %ld %ld\n", big_sum(c), big_sum(b), big_sum(twice(c, 0)));
+  b = twice(b, 1);
+  printf("%ld\n", b.a[0]);
+
+  printf("%ld\n", many(1, 2, 3, 4, 5, all, 6, t, 7, h, 2));
+  printf("%ld %ld\n", sum(pick(1, mid, all)), sum(pick(0, mid, all)));
+  return 0;
+}
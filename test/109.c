@@ -0,0 +1,116 @@
+struct cl {
+  char c;
+  long l;
+};
+struct sic {
+  short s;
+  int i;
+  char c;
+};
+struct nest {
+  char c;
+  struct sic s;
+  char d;
+  struct cl x[2];
+};
+struct tail {
+  int i;
+  char c[5];
+};
+struct chars {
+  char a;
+  char b[3];
+};
+union u {
+  char c[5];
+  int i;
+};
+struct withu {
+  char c;
+  union u u;
+  short s;
+};
+struct ptrs {
+  char c;
+  int* p;
+  const int ci;
+};
+
+long aligned(long p, long a) {
+  return p % a == 0;
+}
+
+// mixed locals of every alignment, each must land on its own
+int frame(int depth) {
+  char c1 = depth;
+  long l = depth * 3;
+  short s = depth + 1;
+  char c2 = 2;
+  int i = depth * 5;
+  struct cl x;
+  char buf[20];
+  int ok = aligned((long)&l, 8) && aligned((long)&s, 2) &&
+           aligned((long)&i, 4) && aligned((long)&x, 8) &&
+           aligned((long)&buf, 16);
+  x.c = c1;
+  x.l = l;
+  buf[19] = c2;
+  if (depth)
+    ok = ok && frame(depth - 1);
+  return ok && x.c == depth && x.l == depth * 3 && s == depth + 1 &&
+         i == depth * 5 && buf[19] == 2;
+}
+
+long sum_cl(struct cl a, struct sic b) {
+  return a.c + a.l + b.s + b.i + b.c;
+}
+
+struct tail make_tail(int i) {
+  struct tail t;
+  t.i = i;
+  for (int k = 0; k < 5; k++)
+    t.c[k] = i + k;
+  return t;
+}
+
+long g_long;
+char g_char;
+int g_int = 3;
+
+int main() {
+  struct cl cl;
+  struct sic sic;
+  struct nest nest;
+  struct tail tail;
+  struct chars chars;
+  union u u;
+  struct withu withu;
+  struct ptrs* ptrs = 0;
+
+  printf("%ld %ld\n", sizeof(cl), (long)&cl.l - (long)&cl);
+  printf("%ld %ld %ld\n", sizeof(sic), (long)&sic.i - (long)&sic,
+         (long)&sic.c - (long)&sic);
+  printf("%ld %ld %ld %ld %ld\n", sizeof(nest), (long)&nest.s - (long)&nest,
+         (long)&nest.d - (long)&nest, (long)&nest.x - (long)&nest,
+         (long)&nest.x[1].l - (long)&nest);
+  printf("%ld %ld\n", sizeof(tail), (long)&tail.c - (long)&tail);
+  printf("%ld %ld\n", sizeof(chars), (long)&chars.b - (long)&chars);
+  printf("%ld %ld %ld %ld\n", sizeof(u), sizeof(withu),
+         (long)&withu.u - (long)&withu, (long)&withu.s - (long)&withu);
+  printf("%ld %ld\n", sizeof(struct ptrs), (long)&ptrs->ci - (long)ptrs);
+  printf("%ld %ld\n", sizeof(struct cl[3]), sizeof(struct tail[2]));
+
+  printf("%d\n", frame(3));
+  printf("%ld %ld %ld\n", aligned((long)&g_long, 8), aligned((long)&g_int, 4),
+         aligned((long)&g_char, 1));
+
+  cl.c = 1;
+  cl.l = 20;
+  sic.s = 300;
+  sic.i = 4000;
+  sic.c = 5;
+  printf("%ld\n", sum_cl(cl, sic));
+  tail = make_tail(7);
+  printf("%d %d %d\n", tail.i, tail.c[0], tail.c[4]);
+  return 0;
+}
@@ -0,0 +1,20 @@
+// pointer differences and compares against the address of an array, with
+// the address an operand of the 32 bit instruction
+int g[8];
+
+int local(int k) {
+  int a[4];
+  int* p = a + k;
+  return (int)(p - a);
+}
+
+int global(int k) {
+  int* p = g + k;
+  return (int)(p - g) + (p == g) + (g < p);
+}
+
+int main() {
+  printf("%d %d\n", local(2), local(0));
+  printf("%d %d\n", global(5), global(0));
+  return 0;
+}
@@ -1,5 +1,14 @@
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <unistd.h>
+
 #include "inc.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
 static const char* token_str[] = {
     // punctuation
     [TK_OPENING_BRACES] = "{",
@@ -65,9 +74,13 @@ static const char* token_str[] = {
     [TK_SIZEOF] = "sizeof",
     [TK_IF] = "if",
     [TK_ELSE] = "else",
+    [TK_SWITCH] = "switch",
+    [TK_CASE] = "case",
+    [TK_DEFAULT] = "default",
     [TK_WHILE] = "while",
     [TK_DO] = "do",
     [TK_FOR] = "for",
+    [TK_GOTO] = "goto",
     [TK_BREAK] = "break",
     [TK_CONTINUE] = "continue",
     [TK_RETURN] = "return",
@@ -118,24 +131,377 @@ Token consume(int kind) {
   return NULL;
 }
 
-static char* cc;  // character currently being processed
-static char* ec;  // last character
-static char* buff;
+static char* buff;  // for escape
+
+const char* escape(const char* s) {
+  char* out = buff;
+  for (; *s; s++) {
+    switch (*s) {
+      case '\\':
+        *out++ = '\\';
+        *out++ = '\\';
+        break;
+      case '"':
+        *out++ = '\\';
+        *out++ = '"';
+        break;
+      case '\a':
+        *out++ = '\\';
+        *out++ = 'a';
+        break;
+      case '\b':
+        *out++ = '\\';
+        *out++ = 'b';
+        break;
+      case '\f':
+        *out++ = '\\';
+        *out++ = 'f';
+        break;
+      case '\n':
+        *out++ = '\\';
+        *out++ = 'n';
+        break;
+      case '\r':
+        *out++ = '\\';
+        *out++ = 'r';
+        break;
+      case '\t':
+        *out++ = '\\';
+        *out++ = 't';
+        break;
+      case '\v':
+        *out++ = '\\';
+        *out++ = 'v';
+        break;
+      default:
+        *out++ = *s;
+    }
+  }
+  return stringn(buff, out - buff);
+}
+
+/**********************
+ *  scanning kernels  *
+ **********************/
+
+// character classes, used instead of the locale dependent <ctype.h> functions
+enum {
+  CH_SPACE = 1 << 0,  // ' ', '\t', '\v', '\r' ('\n' is handled separately)
+  CH_DIGIT = 1 << 1,  // 0-9
+  CH_ALPHA = 1 << 2,  // a-z A-Z
+  CH_IDENT = 1 << 3,  // a-z A-Z 0-9 _
+  CH_PUNCT = 1 << 4,  // same as ispunct() in the "C" locale
+};
+static unsigned char chclass[256];
+#define is_class(c, cls) (chclass[(unsigned char)(c)] & (cls))
+
+// The kernels below scan a span of characters of one class and return the
+// first character not belonging to it (or the end of the buffer). They work on
+// 32(AVX2), 16(SSE2) or 8(SWAR) bytes at a time and fall back to the table for
+// the remaining tail.
+
+static const char* span_class(const char* p, const char* e, int cls) {
+  while (p < e && is_class(*p, cls))
+    ++p;
+  return p;
+}
+
+// find "*/" in [p, e), the newlines before it are counted into *line_no and
+// *line is set to the beginning of the last line
+static const char* comment_end_tail(const char* p,
+                                    const char* e,
+                                    int* line_no,
+                                    const char** line) {
+  for (; p < e; ++p) {
+    if (*p == '\n') {
+      ++*line_no;
+      *line = p + 1;
+    } else if (*p == '*' && p + 1 < e && p[1] == '/') {
+      return p;
+    }
+  }
+  return e;
+}
+
+// SWAR, each byte of the result is 0x80 if the corresponding byte of x matches
+#define ONES 0x0101010101010101ull
+#define HIGHS 0x8080808080808080ull
+
+static uint64_t swar_zero(uint64_t x) {
+  return ~(((x & ~HIGHS) + ~HIGHS) | x) & HIGHS;
+}
+
+static uint64_t swar_eq(uint64_t x, unsigned char c) {
+  return swar_zero(x ^ (ONES * c));
+}
+
+// lo <= byte <= hi, requires hi < 0x80
+static uint64_t swar_range(uint64_t x, unsigned char lo, unsigned char hi) {
+  uint64_t low7 = x & ~HIGHS;
+  uint64_t ge = low7 + ONES * (0x80 - lo);
+  uint64_t gt = low7 + ONES * (0x7f - hi);
+  return ge & ~gt & ~x & HIGHS;
+}
+
+static uint64_t swar_load(const char* p) {
+  uint64_t x;
+  memcpy(&x, p, 8);
+  return x;
+}
+
+static const char* span_space_swar(const char* p, const char* e) {
+  for (; e - p >= 8; p += 8) {
+    uint64_t x = swar_load(p);
+    if ((swar_eq(x, ' ') | swar_eq(x, '\t') | swar_eq(x, '\v') |
+         swar_eq(x, '\r')) != HIGHS)
+      break;
+  }
+  return span_class(p, e, CH_SPACE);
+}
+
+static const char* span_ident_swar(const char* p, const char* e) {
+  for (; e - p >= 8; p += 8) {
+    uint64_t x = swar_load(p);
+    if ((swar_range(x | ONES * 0x20, 'a', 'z') | swar_range(x, '0', '9') |
+         swar_eq(x, '_')) != HIGHS)
+      break;
+  }
+  return span_class(p, e, CH_IDENT);
+}
+
+static const char* span_digit_swar(const char* p, const char* e) {
+  for (; e - p >= 8; p += 8) {
+    if (swar_range(swar_load(p), '0', '9') != HIGHS)
+      break;
+  }
+  return span_class(p, e, CH_DIGIT);
+}
+
+static const char* comment_end_swar(const char* p,
+                                    const char* e,
+                                    int* line_no,
+                                    const char** line) {
+  for (; e - p >= 8; p += 8) {
+    uint64_t x = swar_load(p);
+    if (!(swar_eq(x, '*') | swar_eq(x, '\n')))
+      continue;
+    // only the word with the match is looked at a byte at a time
+    const char* end = comment_end_tail(p, p + 8, line_no, line);
+    if (end < p + 8)
+      return end;
+    if (p[7] == '*' && e - p > 8 && p[8] == '/')  // across the two words
+      return p + 7;
+  }
+  return comment_end_tail(p, e, line_no, line);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_X86_SIMD
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+// bit i of the mask is set if byte i matches
+SSE2 static unsigned space_mask_sse2(const char* p) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\v')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  return _mm_movemask_epi8(m);
+}
+
+// lo <= byte <= hi, by biasing to the signed compare
+SSE2 static __m128i range_sse2(__m128i v, char lo, char hi) {
+  return _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(0x80 - lo)),
+                        _mm_set1_epi8(hi - lo - 127));
+}
+
+SSE2 static unsigned ident_mask_sse2(const char* p) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i m = range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  m = _mm_or_si128(m, range_sse2(v, '0', '9'));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  return _mm_movemask_epi8(m);
+}
+
+SSE2 static unsigned digit_mask_sse2(const char* p) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  return _mm_movemask_epi8(range_sse2(v, '0', '9'));
+}
+
+SSE2 static unsigned eq_mask_sse2(const char* p, char c) {
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+AVX2 static unsigned space_mask_avx2(const char* p) {
+  __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+  return _mm256_movemask_epi8(m);
+}
+
+AVX2 static __m256i range_avx2(__m256i v, char lo, char hi) {
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(hi - lo - 127),
+                           _mm256_add_epi8(v, _mm256_set1_epi8(0x80 - lo)));
+}
+
+AVX2 static unsigned ident_mask_avx2(const char* p) {
+  __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  __m256i m = range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+  m = _mm256_or_si256(m, range_avx2(v, '0', '9'));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+  return _mm256_movemask_epi8(m);
+}
+
+AVX2 static unsigned digit_mask_avx2(const char* p) {
+  __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  return _mm256_movemask_epi8(range_avx2(v, '0', '9'));
+}
+
+AVX2 static unsigned eq_mask_avx2(const char* p, char c) {
+  __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+// instantiate the span and comment kernels for one instruction set
+#define SPAN_KERNEL(target, name, width, mask, cls)              \
+  target static const char* name(const char* p, const char* e) { \
+    for (; e - p >= width; p += width) {                         \
+      unsigned m = ~mask(p) & (unsigned)((1ull << width) - 1);   \
+      if (m)                                                     \
+        return p + __builtin_ctz(m);                             \
+    }                                                            \
+    return span_class(p, e, cls);                                \
+  }
+
+#define COMMENT_KERNEL(target, name, width, eq_mask)               \
+  target static const char* name(const char* p, const char* e,     \
+                                 int* line_no, const char** line) { \
+    for (; e - p > width; p += width) {                            \
+      unsigned nl = eq_mask(p, '\n');                              \
+      unsigned end = eq_mask(p, '*') & eq_mask(p + 1, '/');        \
+      if (end)                                                     \
+        nl &= (1u << __builtin_ctz(end)) - 1;                      \
+      if (nl) {                                                    \
+        *line_no += __builtin_popcount(nl);                        \
+        *line = p + (31 - __builtin_clz(nl)) + 1;                  \
+      }                                                            \
+      if (end)                                                     \
+        return p + __builtin_ctz(end);                             \
+    }                                                              \
+    return comment_end_tail(p, e, line_no, line);                  \
+  }
 
-static Token mktoken(int kind, const char* name) {
-  Token t = malloc(sizeof(struct token));
+SPAN_KERNEL(SSE2, span_space_sse2, 16, space_mask_sse2, CH_SPACE)
+SPAN_KERNEL(SSE2, span_ident_sse2, 16, ident_mask_sse2, CH_IDENT)
+SPAN_KERNEL(SSE2, span_digit_sse2, 16, digit_mask_sse2, CH_DIGIT)
+COMMENT_KERNEL(SSE2, comment_end_sse2, 16, eq_mask_sse2)
+SPAN_KERNEL(AVX2, span_space_avx2, 32, space_mask_avx2, CH_SPACE)
+SPAN_KERNEL(AVX2, span_ident_avx2, 32, ident_mask_avx2, CH_IDENT)
+SPAN_KERNEL(AVX2, span_digit_avx2, 32, digit_mask_avx2, CH_DIGIT)
+COMMENT_KERNEL(AVX2, comment_end_avx2, 32, eq_mask_avx2)
+#endif
+
+// kernels selected at runtime according to the cpu
+static struct scanner {
+  const char* (*space)(const char* p, const char* e);
+  const char* (*ident)(const char* p, const char* e);
+  const char* (*digit)(const char* p, const char* e);
+  const char* (*comment_end)(const char* p,
+                             const char* e,
+                             int* line_no,
+                             const char** line);
+} scan = {span_space_swar, span_ident_swar, span_digit_swar, comment_end_swar};
+
+static void init_scanner() {
+  for (int c = 0; c < 256; c++) {
+    if (c == ' ' || c == '\t' || c == '\v' || c == '\r')
+      chclass[c] |= CH_SPACE;
+    if (c >= '0' && c <= '9')
+      chclass[c] |= CH_DIGIT | CH_IDENT;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      chclass[c] |= CH_ALPHA | CH_IDENT;
+    if (c == '_')
+      chclass[c] |= CH_IDENT;
+    if (c > ' ' && c < 0x7f && !(chclass[c] & (CH_DIGIT | CH_ALPHA)))
+      chclass[c] |= CH_PUNCT;
+  }
+
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    scan = (struct scanner){span_space_avx2, span_ident_avx2, span_digit_avx2,
+                            comment_end_avx2};
+  else
+    scan = (struct scanner){span_space_sse2, span_ident_sse2, span_digit_sse2,
+                            comment_end_sse2};
+#endif
+}
+
+/*************
+ *   lexer   *
+ *************/
+
+// Large sources are split into chunks at line boundaries and lexed in
+// parallel. Every chunk has its own lexer state, tokens are allocated from the
+// chunk's token arrays and errors are recorded instead of reported, because a
+// chunk is lexed speculatively: it's assumed to start outside of any comment.
+typedef struct lexer* Lexer;
+struct lexer {
+  const char* begin;  // first character of the chunk
+  const char* end;    // one past the last character of the chunk
+  const char* cc;     // character currently being processed
+  const char* line;   // beginning of current line
+  int line_no;        // current line number
+  int first_line;     // line number of the chunk's first line
+  int lines;          // newlines in the chunk
+  int in_comment;     // start(input) or end(output) inside a block comment
+  char* buff;         // string literal value being built
+
+  Token head;
+  Token* tail;
+  Token pool;  // current token array
+  int npool;   // free tokens in the pool
+
+  char* err;  // error message, lexing stops at the first error
+  jmp_buf env;
+};
+
+static void lex_error(Lexer L, char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  L->err = malloc(256);
+  vsnprintf(L->err, 256, fmt, ap);
+  va_end(ap);
+  longjmp(L->env, 1);
+}
+
+#define TOKEN_POOL 4096
+static Token mktoken(Lexer L, int kind, const char* name) {
+  if (!L->npool) {
+    L->pool = malloc(TOKEN_POOL * sizeof(struct token));
+    L->npool = TOKEN_POOL;
+  }
+  Token t = L->pool++;
+  L->npool--;
   t->kind = kind;
   t->name = name;
   t->next = NULL;
   return t;
 }
 
-static Token string_literal() {
+static Token string_literal(Lexer L) {
+  const char* cc = L->cc;
+  const char* ec = L->end;
   char quote = *cc++;
-  char* out = buff;
+  char* out = L->buff;
   while (cc < ec && *cc != quote && *cc != '\n') {
     if (!*cc) {
-      error("null character");
+      lex_error(L, "null character");
     } else if (*cc == '\\') {  // escape-sequence
       cc++;
       switch (*cc) {
@@ -167,7 +533,7 @@ static Token string_literal() {
         default:
           // TODO other escape sequence
           // http://port70.net/~nsz/c/c99/n1256.html#6.4.4.4
-          error("unknown escape sequence");
+          lex_error(L, "unknown escape sequence");
           break;
       }
     } else {
@@ -177,62 +543,17 @@ static Token string_literal() {
   }
 
   if (*cc++ != quote)
-    error("missing terminating %c character", quote);
+    lex_error(L, "missing terminating %c character", quote);
 
-  return mktoken(TK_STRING, stringn(buff, out - buff));
+  L->cc = cc;
+  return mktoken(L, TK_STRING, stringn(L->buff, out - L->buff));
 }
 
-const char* escape(const char* s) {
-  char* out = buff;
-  for (; *s; s++) {
-    switch (*s) {
-      case '\\':
-        *out++ = '\\';
-        *out++ = '\\';
-        break;
-      case '"':
-        *out++ = '\\';
-        *out++ = '"';
-        break;
-      case '\a':
-        *out++ = '\\';
-        *out++ = 'a';
-        break;
-      case '\b':
-        *out++ = '\\';
-        *out++ = 'b';
-        break;
-      case '\f':
-        *out++ = '\\';
-        *out++ = 'f';
-        break;
-      case '\n':
-        *out++ = '\\';
-        *out++ = 'n';
-        break;
-      case '\r':
-        *out++ = '\\';
-        *out++ = 'r';
-        break;
-      case '\t':
-        *out++ = '\\';
-        *out++ = 't';
-        break;
-      case '\v':
-        *out++ = '\\';
-        *out++ = 'v';
-        break;
-      default:
-        *out++ = *s;
-    }
-  }
-  return stringn(buff, out - buff);
-}
-
-static Token integer_constant() {
+static Token integer_constant(Lexer L) {
+  const char* cc = L->cc;
   const char* begin = cc;
 
-  if (*cc == '0' && isdigit(cc[1])) {  // octal
+  if (*cc == '0' && is_class(cc[1], CH_DIGIT)) {  // octal
     while (*cc >= '0' && *cc <= '7')
       ++cc;
   } else if (*cc == '0' && (cc[1] == 'x' || cc[1] == 'X')) {  // hexadecimal
@@ -241,107 +562,238 @@ static Token integer_constant() {
            (*cc >= 'A' && *cc <= 'F'))
       ++cc;
   } else {  // decimal
-    while ((*cc >= '0' && *cc <= '9'))
-      ++cc;
+    cc = scan.digit(cc, L->end);
   }
 
   while (*cc == 'l' || *cc == 'L' || *cc == 'u' || *cc == 'U')
     cc++;
-  return mktoken(TK_NUM, stringn(begin, cc - begin));
+  L->cc = cc;
+  return mktoken(L, TK_NUM, stringn(begin, cc - begin));
 }
 
-void tokenize() {
-  int length = read_source(&cc);
-  ec = cc + length;
-  buff = malloc(length);
+// punctuations starting with each character, longer ones first
+static int puncts[128][8];
+static int punct_len[TK_TILDE + 1];
+// interned keywords, identifiers are compared with them by address
+static const char* keywords[TK_RETURN + 1];
+
+static void init_tokens() {
+  for (int k = TK_OPENING_BRACES; k <= TK_TILDE; k++) {
+    int* p = puncts[(unsigned char)token_str[k][0]];
+    while (*p)
+      p++;
+    *p = k + 1;  // 0 terminates the list
+    punct_len[k] = strlen(token_str[k]);
+  }
+  for (int k = TK_VOID; k <= TK_RETURN; k++)
+    keywords[k] = string(token_str[k]);
+}
 
-  Token* tail = &ct;
-  int line_no = 1;
-  const char* line = cc;
+static Token punctuation(Lexer L) {
+  for (int* p = puncts[(unsigned char)*L->cc]; *p; p++) {
+    int k = *p - 1;
+    if (!strncmp(L->cc, token_str[k], punct_len[k])) {
+      L->cc += punct_len[k];
+      return mktoken(L, k, token_str[k]);
+    }
+  }
+  return NULL;
+}
+
+static Token identifier(Lexer L) {
+  const char* b = L->cc;
+  L->cc = scan.ident(L->cc + 1, L->end);
+  const char* name = stringn(b, L->cc - b);
+  for (int kind = TK_VOID; kind <= TK_RETURN; kind++) {
+    if (name == keywords[kind])
+      return mktoken(L, kind, name);
+  }
+  return mktoken(L, TK_IDENT, name);
+}
+
+// skip the rest of a block comment, return 0 if it's not terminated in chunk
+static int comment(Lexer L) {
+  L->cc = scan.comment_end(L->cc, L->end, &L->line_no, &L->line);
+  if (L->cc == L->end)
+    return 0;
+  L->cc += 2;
+  return 1;
+}
 
-  while (cc < ec) {
+// lex the chunk from the beginning, starting in the state L->in_comment
+static void lex(Lexer L) {
+  L->cc = L->line = L->begin;
+  L->line_no = L->first_line;
+  L->head = NULL;
+  L->tail = &L->head;
+  L->err = NULL;
+  if (setjmp(L->env))
+    return;
+
+  if (L->in_comment && !comment(L))
+    return;
+  L->in_comment = 0;
+
+  const char* ec = L->end;
+  while (L->cc < ec) {
+    const char* cc = L->cc;
     Token n = NULL;
 
     if (!*cc)
-      error("null character");
+      lex_error(L, "null character");
 
     // space
-    if (*cc == ' ' || *cc == '\t' || *cc == '\v' || *cc == '\r') {
-      ++cc;
+    if (is_class(*cc, CH_SPACE)) {
+      L->cc = scan.space(cc + 1, ec);
       continue;
     }
 
     // new line
     if (*cc == '\n') {
-      line = ++cc;
-      ++line_no;
+      L->line = L->cc = cc + 1;
+      ++L->line_no;
       continue;
     }
 
     // comments
     if (*cc == '/' && cc[1] == '/') {
-      while (cc < ec && *cc != '\n')
-        ++cc;
+      const char* nl = memchr(cc, '\n', ec - cc);
+      L->cc = nl ? nl : ec;
       continue;
     }
 
     if (*cc == '/' && cc[1] == '*') {
-      cc += 2;
-      while (cc < ec && !(*cc == '*' && cc[1] == '/')) {
-        ++cc;
-        if (*cc == '\n') {
-          ++line_no;
-          line = cc;
-        }
+      L->cc = cc + 2;
+      if (!comment(L)) {
+        L->in_comment = 1;
+        return;
       }
-
-      if (*cc != '*' || cc[1] != '/')
-        error("unterminated comment");
-      cc += 2;
       continue;
     }
 
-    int char_no = cc - line;
+    int char_no = cc - L->line;
     // number
-    if (isdigit(*cc)) {  // 0-9
-      n = integer_constant();
+    if (is_class(*cc, CH_DIGIT)) {  // 0-9
+      n = integer_constant(L);
     }
     // string literal
     else if (*cc == '"') {
-      n = string_literal();
+      n = string_literal(L);
     }
     // punc
-    else if (ispunct(*cc)) {
-      for (int k = TK_OPENING_BRACES; k <= TK_TILDE; k++) {
-        int len = strlen(token_str[k]);
-        if (!strncmp(cc, token_str[k], len)) {
-          cc += len;
-          n = mktoken(k, token_str[k]);
-          break;
-        }
-      }
+    else if (is_class(*cc, CH_PUNCT)) {
+      n = punctuation(L);
     }
     // keywords or identifer
-    else if (isalpha(*cc)) {
-      const char* b = cc;
-      do {
-        cc++;
-      } while (isalpha(*cc) || isdigit(*cc) || *cc == '_');
-      const char* name = stringn(b, cc - b);
-      n = NULL;
-      for (int kind = TK_VOID; kind <= TK_RETURN; kind++) {
-        if (name == string(token_str[kind]))
-          n = mktoken(kind, name);
-      }
-      n = n ? n : mktoken(TK_IDENT, name);
+    else if (is_class(*cc, CH_ALPHA)) {
+      n = identifier(L);
     }
 
     if (!n)
-      error("tokenize: syntax error, unknown \"%c\"", *cc);
-    n->line = line;
+      lex_error(L, "tokenize: syntax error, unknown \"%c\"", *cc);
+    n->line = L->line;
     n->char_no = char_no;
-    n->line_no = line_no;
+    n->line_no = L->line_no;
 
-    tail = &(*tail = n)->next;
+    L->tail = &(*L->tail = n)->next;
+  }
+}
+
+/**********************
+ *   chunked lexing   *
+ **********************/
+
+// chunks smaller than this are not worth a thread
+#define MIN_CHUNK (1 << 20)
+
+static void* count_lines(void* arg) {
+  Lexer L = arg;
+  L->lines = 0;
+  for (const char* p = L->begin; (p = memchr(p, '\n', L->end - p)); p++)
+    L->lines++;
+  return NULL;
+}
+
+static void* lex_chunk(void* arg) {
+  Lexer L = arg;
+  L->buff = malloc(L->end - L->begin + 1);
+  lex(L);
+  return NULL;
+}
+
+// run fn for each chunk, chunk 0 runs in the calling thread
+static void run_chunks(void* (*fn)(void*), struct lexer* chunks, int n) {
+  pthread_t* threads = calloc(n, sizeof(pthread_t));
+  int* started = calloc(n, sizeof(int));
+  for (int i = 1; i < n; i++)
+    started[i] = !pthread_create(&threads[i], NULL, fn, &chunks[i]);
+  fn(&chunks[0]);
+  for (int i = 1; i < n; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      fn(&chunks[i]);
+  }
+  free(threads);
+  free(started);
+}
+
+static int chunk_count(int length) {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int n = length / MIN_CHUNK;
+  if (ncpu > 0 && n > ncpu)
+    n = ncpu;
+  return n > 1 ? n : 1;
+}
+
+void tokenize() {
+  char* src;
+  int length = read_source(&src);
+  buff = malloc(2 * length + 1);
+  init_scanner();
+  init_tokens();
+
+  // split at newlines, every chunk starts at the beginning of a line
+  int n = chunk_count(length);
+  struct lexer* chunks = calloc(n, sizeof(struct lexer));
+  const char* p = src;
+  for (int i = 0; i < n; i++) {
+    const char* e = src + (long)length * (i + 1) / n;
+    if (e < p)
+      e = p;
+    const char* nl = i == n - 1 ? NULL : memchr(e, '\n', src + length - e);
+    chunks[i].begin = p;
+    chunks[i].end = p = nl ? nl + 1 : src + length;
+  }
+
+  // line number of each chunk's first line
+  run_chunks(count_lines, chunks, n);
+  int line_no = 1;
+  for (int i = 0; i < n; i++) {
+    chunks[i].first_line = line_no;
+    line_no += chunks[i].lines;
+  }
+
+  run_chunks(lex_chunk, chunks, n);
+
+  // a chunk starting inside a comment that was opened by a previous chunk was
+  // lexed in the wrong state, lex it again. then join the token lists.
+  Token* tail = &ct;
+  int in_comment = 0;
+  for (int i = 0; i < n; i++) {
+    Lexer L = &chunks[i];
+    if (in_comment) {
+      L->in_comment = 1;
+      lex(L);
+    }
+    if (L->err)
+      error("%s", L->err);
+    in_comment = L->in_comment;
+    if (L->head) {
+      *tail = L->head;
+      tail = L->tail;
+    }
   }
+  if (in_comment)
+    error("unterminated comment");
 }
@@ -1,15 +1,22 @@
 #include "inc.h"
 
-Type voidtype = &(struct type){TY_VOID, 0, NULL, "void"};
-Type chartype = &(struct type){TY_CHAR, 1, NULL, "char"};
-Type shorttype = &(struct type){TY_SHRT, 2, NULL, "short"};
-Type inttype = &(struct type){TY_INT, 4, NULL, "int"};
-Type longtype = &(struct type){TY_LONG, 8, NULL, "long"};
-Type uchartype = &(struct type){TY_UCHAR, 1, NULL, "unsigned char"};
-Type ushorttype = &(struct type){TY_USHRT, 2, NULL, "unsigned short"};
-Type uinttype = &(struct type){TY_UINT, 4, NULL, "unsigned int"};
-Type ulongtype = &(struct type){TY_ULONG, 8, NULL, "unsigned long"};
-Type voidptrtype = &(struct type){TY_POINTER, 8, NULL, "void *"};
+#define SIGNED (TF_SIGNED | TF_INTEGER | TF_SCALAR)
+#define UNSIGNED (TF_UNSIGNED | TF_INTEGER | TF_SCALAR)
+
+Type voidtype = &(struct type){TY_VOID, 0, 1, NULL, "void"};
+Type chartype = &(struct type){TY_CHAR, 1, 1, NULL, "char", SIGNED};
+Type shorttype = &(struct type){TY_SHRT, 2, 2, NULL, "short", SIGNED};
+Type inttype = &(struct type){TY_INT, 4, 4, NULL, "int", SIGNED};
+Type longtype = &(struct type){TY_LONG, 8, 8, NULL, "long", SIGNED};
+Type uchartype =
+    &(struct type){TY_UCHAR, 1, 1, NULL, "unsigned char", UNSIGNED};
+Type ushorttype =
+    &(struct type){TY_USHRT, 2, 2, NULL, "unsigned short", UNSIGNED};
+Type uinttype = &(struct type){TY_UINT, 4, 4, NULL, "unsigned int", UNSIGNED};
+Type ulongtype =
+    &(struct type){TY_ULONG, 8, 8, NULL, "unsigned long", UNSIGNED};
+Type voidptrtype =
+    &(struct type){TY_POINTER, 8, 8, NULL, "void *", TF_POINTER | TF_SCALAR};
 
 #define TTSIZE 128
 static struct type_entry {
@@ -17,46 +24,109 @@ static struct type_entry {
   struct type_entry* next;
 } * type_table[TTSIZE];
 
+// type strings are only for diagnostics, long ones are truncated
+#define TSTRSIZE 4096
+
+static int append(char* buffer, int i, const char* fmt, ...) {
+  if (i >= TSTRSIZE)
+    return i;
+  va_list ap;
+  va_start(ap, fmt);
+  i += vsnprintf(buffer + i, TSTRSIZE - i, fmt, ap);
+  va_end(ap);
+  return i;
+}
+
+// The string is built on first use and cached in t->str.
 const char* type_str(Type t) {
-  static char buffer[4096];
-  if (t->kind <= 8)
+  char buffer[TSTRSIZE];
+  int i = 0;
+  if (t->str)
     return t->str;
 
   if (t->kind == TY_POINTER) {
-    sprintf(buffer, "ptr{%s}", t->base->str);
+    append(buffer, i, "ptr{%s}", type_str(t->base));
   } else if (t->kind == TY_ARRAY) {
-    sprintf(buffer, "array[%d]{%s}", t->size / t->base->size, t->base->str);
+    append(buffer, i, "array[%d]{%s}", t->size / t->base->size,
+           type_str(t->base));
   } else if (t->kind == TY_CONST) {
-    sprintf(buffer, "const{%s}", t->base->str);
+    append(buffer, i, "const{%s}", type_str(t->base));
+  } else if (t->kind == TY_VOLATILE) {
+    append(buffer, i, "volatile{%s}", type_str(t->base));
   } else if (t->kind == TY_VARARG) {
-    sprintf(buffer, "...");
+    append(buffer, i, "...");
   } else if (t->kind == TY_FUNCTION) {
-    int i = 0;
     Proto p = t->proto;
-    i += sprintf(buffer, "function{%s}{", t->base->str);
+    i = append(buffer, i, "function{%s}{", type_str(t->base));
     if (p) {
-      i += sprintf(buffer + i, "%s %s", p->type->str, p->name ? p->name : "");
+      i = append(buffer, i, "%s %s", type_str(p->type), p->name ? p->name : "");
       p = p->next;
     }
     while (p) {
-      i += sprintf(buffer + i, ",%s %s", p->type->str, p->name ? p->name : "");
+      i = append(buffer, i, ",%s %s", type_str(p->type),
+                 p->name ? p->name : "");
       p = p->next;
     }
-    sprintf(buffer + i, "}");
+    append(buffer, i, "}");
   } else if (t->kind == TY_STRUCT || t->kind == TY_UNION) {
-    int i = 0;
-    Member m = t->member;
-    i += sprintf(buffer, "%s %s{", t->kind == TY_STRUCT ? "struct" : "union",
-                 t->tag ? t->tag : "");
-    while (m) {
-      i += sprintf(buffer + i, "%s %s;", m->type->str, m->name);
-      m = m->next;
-    }
-    sprintf(buffer + i, "}");
+    const char* kind = t->kind == TY_STRUCT ? "struct" : "union";
+    const char* tag = t->tag ? t->tag : "";
+
+    // a member may refer back to this type
+    append(buffer, i, "%s %s", kind, tag);
+    t->str = string(buffer);
+
+    i = append(buffer, i, "%s %s{", kind, tag);
+    for (Member m = t->member; m; m = m->next)
+      i = append(buffer, i, "%s %s;", type_str(m->type), m->name);
+    append(buffer, i, "}");
+  } else if (t->kind == TY_ENUM) {
+    append(buffer, i, "enum %s", t->tag ? t->tag : "");
   } else
     error("what kind of type?");
 
-  return string(buffer);
+  return t->str = string(buffer);
+}
+
+static int type_flags(int kind, Type base) {
+  switch (kind) {
+    case TY_CHAR:
+    case TY_SHRT:
+    case TY_INT:
+    case TY_LONG:
+    case TY_ENUM:
+      return SIGNED;
+    case TY_UCHAR:
+    case TY_USHRT:
+    case TY_UINT:
+    case TY_ULONG:
+      return UNSIGNED;
+    case TY_POINTER:
+    case TY_ARRAY:
+      return TF_POINTER | TF_SCALAR;
+    case TY_CONST:
+    case TY_VOLATILE: {
+      int q = kind == TY_VOLATILE ? TF_QUALIFIED | TF_VOLATILE : TF_QUALIFIED;
+      // a qualified array is not a pointer, see is_ptr()
+      if (base->kind == TY_ARRAY)
+        return q;
+      return q | base->flags;
+    }
+    case TY_STRUCT:
+    case TY_UNION:
+      return TF_AGGREGATE;
+  }
+  return 0;
+}
+
+// scalars are aligned to their size, derived types to what they are built of;
+// a struct or union is realigned as its members are laid out
+static int align_of(int kind, Type base, int size) {
+  if (kind == TY_ARRAY || kind == TY_CONST || kind == TY_VOLATILE)
+    return unqual(base)->align;
+  if (kind == TY_FUNCTION || kind == TY_STRUCT || kind == TY_UNION)
+    return 1;
+  return size;
 }
 
 Type type(int kind, Type base, int size) {
@@ -74,9 +144,10 @@ Type type(int kind, Type base, int size) {
   t->kind = kind;
   t->base = base;
   t->size = size;
+  t->align = align_of(kind, base, size);
+  t->flags = type_flags(kind, base);
   if (kind != TY_FUNCTION && kind != TY_STRUCT && kind != TY_UNION &&
       kind != TY_ENUM) {
-    t->str = type_str(t);
     struct type_entry* e = calloc(1, sizeof(struct type_entry));
     e->t = t;
     e->next = type_table[h];
@@ -89,7 +160,9 @@ Type type(int kind, Type base, int size) {
 Type ptr_type(Type base) {
   if (base == voidtype)
     return voidptrtype;
-  return type(TY_POINTER, base, 8);
+  if (!base->ptr)
+    base->ptr = type(TY_POINTER, base, 8);
+  return base->ptr;
 }
 
 Type deref_type(Type ptr) {
@@ -117,18 +190,29 @@ Type function_type(Type t, Proto p) {
     error("function return what?");
   t = type(TY_FUNCTION, t, 0);
   t->proto = p;
-  t->str = type_str(t);  // add the proto
   return t;
 }
 
 Type const_type(Type t) {
   if (is_const(t))
     return t;
-  return type(TY_CONST, t, t->size);
+  if (!t->qual)
+    t->qual = type(TY_CONST, t, t->size);
+  return t->qual;
+}
+
+Type volatile_type(Type t) {
+  if (is_volatile(t))
+    return t;
+  if (is_const(t))  // keep const outside
+    return const_type(volatile_type(t->base));
+  return type(TY_VOLATILE, t, t->size);
 }
 
 Type unqual(Type t) {
-  return is_qual(t) ? t->base : t;
+  while (is_qual(t))
+    t = t->base;
+  return t;
 }
 
 Type struct_or_union_type(Member member, const char* tag, int kind) {
@@ -138,26 +222,61 @@ Type struct_or_union_type(Member member, const char* tag, int kind) {
   return ty;
 }
 
+static unsigned member_hash(const char* name) {
+  return ((unsigned long)name >> 3) * 2654435761u;
+}
+
 Member get_struct_or_union_member(Type t, const char* name) {
-  for (Member m = unqual(t)->member; m; m = m->next) {
-    if (m->name == name)
-      return m;
+  t = unqual(t);
+  if (!t->member_index)
+    return NULL;
+  for (unsigned h = member_hash(name) & t->member_mask; t->member_index[h];
+       h = (h + 1) & t->member_mask) {
+    if (t->member_index[h]->name == name)
+      return t->member_index[h];
   }
   return NULL;
 }
 
+// keep the table at most half full
+static void index_members(Type ty) {
+  unsigned size = 8, n = 0;
+  for (Member m = ty->member; m; m = m->next)
+    n++;
+  while (size < 2 * n)
+    size <<= 1;
+
+  ty->member_index = n ? calloc(size, sizeof(Member)) : NULL;
+  ty->member_mask = size - 1;
+  for (Member m = ty->member; m; m = m->next) {
+    unsigned h = member_hash(m->name) & ty->member_mask;
+    for (; ty->member_index[h]; h = (h + 1) & ty->member_mask) {
+      if (ty->member_index[h]->name == m->name)
+        errorat(m->token, "redefinition of member %s", m->name);
+    }
+    ty->member_index[h] = m;
+  }
+}
+
 void update_struct_or_union_type(Type ty, Member member) {
   ty->member = member;
+  index_members(ty);
+
+  // members at their natural alignment, the size padded to the largest one
+  // so that arrays of the type stay aligned, as in the SysV ABI
   ty->size = 0;
+  ty->align = 1;
   for (Member m = ty->member; m; m = m->next) {
     if (m->type->size == 0)
       error("not implemented");
 
-    m->offset = is_struct(ty) ? ty->size : 0;
-    ty->size =
-        is_struct(ty) ? ty->size + m->type->size : max(ty->size, m->type->size);
+    int align = unqual(m->type)->align;
+    m->offset = is_struct(ty) ? align_to(ty->size, align) : 0;
+    ty->size = max(ty->size, m->offset + m->type->size);
+    ty->align = max(ty->align, align);
   }
-  ty->str = type_str(ty);
+  ty->size = align_to(ty->size, ty->align);
+  ty->str = NULL;  // rebuilt with the new members
 }
 
 Type enum_type(const char* tag) {
@@ -167,7 +286,7 @@ Type enum_type(const char* tag) {
 }
 
 int is_ptr(Type t) {
-  return unqual(t)->kind == TY_POINTER || is_array(t);
+  return (t->flags & TF_POINTER) != 0;
 }
 
 int is_array(Type t) {
@@ -179,17 +298,15 @@ int is_funcion(Type t) {
 }
 
 int is_signed(Type t) {
-  return unqual(t) == chartype || unqual(t) == shorttype ||
-         unqual(t) == inttype || unqual(t) == longtype || is_enum(t);
+  return (t->flags & TF_SIGNED) != 0;
 }
 
 int is_unsigned(Type t) {
-  return unqual(t) == uchartype || unqual(t) == ushorttype ||
-         unqual(t) == uinttype || unqual(t) == ulongtype;
+  return (t->flags & TF_UNSIGNED) != 0;
 }
 
 int is_integer(Type t) {
-  return is_signed(t) || is_unsigned(t) || is_enum(t);
+  return (t->flags & TF_INTEGER) != 0;
 }
 
 int is_arithmetic(Type t) {
@@ -197,17 +314,21 @@ int is_arithmetic(Type t) {
 }
 
 int is_scalar(Type t) {
-  return is_arithmetic(t) || is_ptr(t);
+  return (t->flags & TF_SCALAR) != 0;
 }
 
 int is_qual(Type t) {
-  return t->kind == TY_CONST;
+  return (t->flags & TF_QUALIFIED) != 0;
 }
 
 int is_const(Type t) {
   return t->kind == TY_CONST;
 }
 
+int is_volatile(Type t) {
+  return (t->flags & TF_VOLATILE) != 0;
+}
+
 int is_struct(Type t) {
   return unqual(t)->kind == TY_STRUCT;
 }
@@ -217,7 +338,7 @@ int is_union(Type t) {
 }
 
 int is_struct_or_union(Type t) {
-  return unqual(t)->kind == TY_STRUCT || unqual(t)->kind == TY_UNION;
+  return (t->flags & TF_AGGREGATE) != 0;
 }
 
 int is_enum(Type t) {
@@ -234,6 +355,14 @@ int is_struct_with_const_member(Type t) {
   return 0;
 }
 
+// SysV x86-64 classes a struct or union above 16 bytes as MEMORY: it's
+// passed on the stack, and returned where a hidden first argument points.
+// With no floating types, a smaller one is of the INTEGER class and goes
+// in general registers, an eightbyte each.
+int is_memory_class(Type t) {
+  return is_struct_or_union(t) && unqual(t)->size > MAX_REG_STRUCT;
+}
+
 int is_compatible_type(Type t1, Type t2) {
   if (t1 == t2)
     return 1;
@@ -243,9 +372,7 @@ int is_compatible_type(Type t1, Type t2) {
 
   // http://port70.net/~nsz/c/c99/n1256.html#6.7.3p9
   if (is_qual(t1))
-    return (is_const(t1) ^ is_const(t2))
-               ? 0
-               : is_compatible_type(unqual(t1), unqual(t2));
+    return is_compatible_type(t1->base, t2->base);
 
   // http://port70.net/~nsz/c/c99/n1256.html#6.7.5.2p6
   if (is_array(t1)) {
@@ -294,6 +421,8 @@ int is_compatible_type(Type t1, Type t2) {
   if (is_struct_or_union(t1)) {
     if (t1->tag != t2->tag)
       return 0;
+    if (t1->member == t2->member)  // a tag completed by a later definition
+      return 1;
     Member m1 = t1->member, m2 = t2->member;
     for (; m1 && m2; m1 = m1->next, m2 = m2->next) {
       if (m1->name != m2->name)
@@ -1,3 +1,5 @@
+#include <pthread.h>
+
 #include "inc.h"
 
 static void msg(char* kind, char* fmt, va_list ap) {
@@ -70,26 +72,45 @@ static unsigned long hash(unsigned char* str, unsigned n) {
   return hash;
 }
 
-#define STSIZE 128
+// the table is shared by the lexing threads, each lock guards the buckets
+// having the same index modulo NLOCKS
+#define STSIZE (1 << 16)
+#define NLOCKS 256
 static struct string {
   char* s;
+  int n;
   struct string* next;
 } * string_table[STSIZE];
+static pthread_mutex_t string_locks[NLOCKS];
+static pthread_once_t string_once = PTHREAD_ONCE_INIT;
+
+static void init_string_locks() {
+  for (int i = 0; i < NLOCKS; i++)
+    pthread_mutex_init(&string_locks[i], NULL);
+}
 
 const char* stringn(const char* s, int n) {
   unsigned h = hash((unsigned char*)s, n) % STSIZE;
-  for (struct string* i = string_table[h]; i; i = i->next) {
-    if (strlen(i->s) == n && strncmp(i->s, s, n) == 0)
-      return i->s;
+  pthread_once(&string_once, init_string_locks);
+  pthread_mutex_t* lock = &string_locks[h % NLOCKS];
+  pthread_mutex_lock(lock);
+  struct string* i;
+  for (i = string_table[h]; i; i = i->next) {
+    if (i->n == n && memcmp(i->s, s, n) == 0)
+      break;
   }
 
-  struct string* new = malloc(sizeof(struct string));
-  new->s = calloc(n + 1, sizeof(char));
-  strncpy(new->s, s, n);
-  new->next = string_table[h];
-  string_table[h] = new;
+  if (!i) {
+    i = malloc(sizeof(struct string));
+    i->s = calloc(n + 1, sizeof(char));
+    i->n = n;
+    memcpy(i->s, s, n);
+    i->next = string_table[h];
+    string_table[h] = i;
+  }
+  pthread_mutex_unlock(lock);
 
-  return new->s;
+  return i->s;
 }
 
 const char* string(const char* s) {
@@ -148,11 +169,28 @@ static char* strdup(const char* name) {
 struct options options;
 void parse_arguments(int argc, char* argv[]) {
   int idx = 1;
+  options.inline_limit = 30;
   while (idx < argc) {
     if (strcmp(argv[idx], "-o") == 0) {
       if (++idx == argc)
         error("missing file name after -o");
       options.output_filename = argv[idx++];
+    } else if (strcmp(argv[idx], "--dump-ir") == 0) {
+      options.dump_ir = 1;
+      idx++;
+    } else if (strcmp(argv[idx], "--omit-frame-pointer") == 0) {
+      options.omit_frame_pointer = 1;
+      idx++;
+    } else if (strcmp(argv[idx], "--inline-limit") == 0) {
+      if (++idx == argc)
+        error("missing size after --inline-limit");
+      options.inline_limit = atoi(argv[idx++]);
+    } else if (strcmp(argv[idx], "--no-inline") == 0) {
+      if (++idx == argc)
+        error("missing function name after --no-inline");
+      options.no_inline =
+          realloc(options.no_inline, (options.nno_inline + 1) * sizeof(char*));
+      options.no_inline[options.nno_inline++] = string(argv[idx++]);
     } else {
       if (options.input_filename)
         error("more than one input file");